@@ -0,0 +1,156 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef DBG_MOD_ID
+#undef DBG_MOD_ID
+#endif
+#define DBG_MOD_ID DBG_MOD_COMB1(RK_ID_MB)
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "test_comm_mb_chain.h"
+
+#include "rk_debug.h"
+#include "rk_mpi_mb.h"
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C" {
+#endif
+#endif /* End of #ifdef __cplusplus */
+
+TEST_MB_CHAIN_S *TEST_COMM_MbChainCreate() {
+    TEST_MB_CHAIN_S *pstChain = reinterpret_cast<TEST_MB_CHAIN_S *>(malloc(sizeof(TEST_MB_CHAIN_S)));
+    if (pstChain == RK_NULL) {
+        return RK_NULL;
+    }
+    pstChain->s32RefCnt = 1;
+    pstChain->u32SegCnt = 0;
+    pstChain->u64Length = 0;
+    return pstChain;
+}
+
+RK_VOID TEST_COMM_MbChainRef(TEST_MB_CHAIN_S *pstChain) {
+    if (pstChain != RK_NULL) {
+        __atomic_add_fetch(&pstChain->s32RefCnt, 1, __ATOMIC_ACQ_REL);
+    }
+}
+
+RK_VOID TEST_COMM_MbChainUnref(TEST_MB_CHAIN_S *pstChain) {
+    if (pstChain == RK_NULL || __atomic_sub_fetch(&pstChain->s32RefCnt, 1, __ATOMIC_ACQ_REL) > 0) {
+        return;
+    }
+    for (RK_U32 i = 0; i < pstChain->u32SegCnt; i++) {
+        RK_MPI_MB_ReleaseMB(pstChain->apMbBlk[i]);
+    }
+    free(pstChain);
+}
+
+RK_S32 TEST_COMM_MbChainAppend(TEST_MB_CHAIN_S *pstChain, MB_BLK pMbBlk, RK_U32 u32Offset, RK_U32 u32Len) {
+    if (pstChain == RK_NULL || pMbBlk == MB_INVALID_HANDLE) {
+        return RK_ERR_MB_NULL_PTR;
+    }
+    if (u32Len == 0) {
+        return RK_SUCCESS;
+    }
+    RK_U8 *pu8Data = reinterpret_cast<RK_U8 *>(RK_MPI_MB_Handle2VirAddr(pMbBlk));
+    if (pu8Data == RK_NULL || (RK_U64)u32Offset + u32Len > RK_MPI_MB_GetSize(pMbBlk)) {
+        RK_LOGE("segment offset %d len %d is out of mb %p", u32Offset, u32Len, pMbBlk);
+        return RK_ERR_MB_ILLEGAL_PARAM;
+    }
+    pu8Data += u32Offset;
+
+    if (pstChain->u32SegCnt > 0) {
+        struct iovec *pstLast = &pstChain->astIov[pstChain->u32SegCnt - 1];
+        if (pstChain->apMbBlk[pstChain->u32SegCnt - 1] == pMbBlk
+                && reinterpret_cast<RK_U8 *>(pstLast->iov_base) + pstLast->iov_len == pu8Data) {
+            pstLast->iov_len += u32Len;
+            pstChain->u64Length += u32Len;
+            return RK_SUCCESS;
+        }
+    }
+    if (pstChain->u32SegCnt >= TEST_MB_CHAIN_MAX_SEG) {
+        RK_LOGE("chain is full, max %d segments", TEST_MB_CHAIN_MAX_SEG);
+        return RK_ERR_MB_NOBUF;
+    }
+    if (RK_MPI_MB_AddUserCnt(pMbBlk) != RK_SUCCESS) {
+        return RK_ERR_MB_UNEXIST;
+    }
+    pstChain->apMbBlk[pstChain->u32SegCnt] = pMbBlk;
+    pstChain->astIov[pstChain->u32SegCnt].iov_base = pu8Data;
+    pstChain->astIov[pstChain->u32SegCnt].iov_len = u32Len;
+    pstChain->u32SegCnt++;
+    pstChain->u64Length += u32Len;
+    return RK_SUCCESS;
+}
+
+RK_S32 TEST_COMM_MbChainAppendVencStream(TEST_MB_CHAIN_S *pstChain, const VENC_STREAM_S *pstStream) {
+    if (pstStream == RK_NULL || pstStream->pstPack == RK_NULL) {
+        return RK_ERR_MB_NULL_PTR;
+    }
+    for (RK_U32 i = 0; i < pstStream->u32PackCount; i++) {
+        const VENC_PACK_S *pstPack = &pstStream->pstPack[i];
+        RK_S32 s32Ret = TEST_COMM_MbChainAppend(pstChain, pstPack->pMbBlk, pstPack->u32Offset, pstPack->u32Len);
+        if (s32Ret != RK_SUCCESS) {
+            return s32Ret;
+        }
+    }
+    return RK_SUCCESS;
+}
+
+RK_S64 TEST_COMM_MbChainWrite(const TEST_MB_CHAIN_S *pstChain, RK_S32 s32Fd) {
+    struct iovec astIov[TEST_MB_CHAIN_MAX_SEG];
+    struct iovec *pstIov = astIov;
+    RK_S32 s32Cnt = 0;
+    RK_S64 s64Total = 0;
+
+    if (pstChain == RK_NULL || s32Fd < 0) {
+        return RK_FAILURE;
+    }
+    /* short writes advance a private copy of the vector */
+    s32Cnt = pstChain->u32SegCnt;
+    memcpy(astIov, pstChain->astIov, sizeof(struct iovec) * s32Cnt);
+    while (s32Cnt > 0) {
+        ssize_t written = writev(s32Fd, pstIov, s32Cnt);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            RK_LOGE("writev %d segments failed, error: %s", s32Cnt, strerror(errno));
+            return RK_FAILURE;
+        }
+        s64Total += written;
+        while (s32Cnt > 0 && (size_t)written >= pstIov->iov_len) {
+            written -= pstIov->iov_len;
+            pstIov++;
+            s32Cnt--;
+        }
+        if (s32Cnt > 0) {
+            pstIov->iov_base = reinterpret_cast<RK_U8 *>(pstIov->iov_base) + written;
+            pstIov->iov_len -= written;
+        }
+    }
+    return s64Total;
+}
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* End of #ifdef __cplusplus */
@@ -0,0 +1,144 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef DBG_MOD_ID
+#undef DBG_MOD_ID
+#endif
+#define DBG_MOD_ID DBG_MOD_COMB1(RK_ID_MB)
+
+#include <string.h>
+
+#include "test_comm_mb_dirty.h"
+
+#include "rk_debug.h"
+#include "rk_mpi_mb.h"
+#include "rk_mpi_mmz.h"
+#include "rk_mpi_sys.h"
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C" {
+#endif
+#endif /* End of #ifdef __cplusplus */
+
+RK_VOID TEST_COMM_MbDirtyInit(TEST_MB_DIRTY_S *pstDirty, MB_BLK pMbBlk) {
+    memset(pstDirty, 0, sizeof(TEST_MB_DIRTY_S));
+    pstDirty->pMbBlk = pMbBlk;
+    /* pool blocks may not answer, only an explicit 0 is left untracked */
+    pstDirty->bCached = (RK_BOOL)(pMbBlk != MB_INVALID_HANDLE && RK_MPI_MMZ_IsCacheable(pMbBlk) != 0);
+}
+
+RK_VOID TEST_COMM_MbDirtyMark(TEST_MB_DIRTY_S *pstDirty, RK_U32 u32Offset, RK_U32 u32Len) {
+    RK_U32 u32Start = u32Offset;
+    RK_U32 u32End = u32Offset + u32Len;
+    RK_U32 i = 0;
+
+    if (pstDirty == RK_NULL || !pstDirty->bCached || u32Len == 0) {
+        return;
+    }
+    /* absorb every range it touches, the list stays sorted and disjoint */
+    while (i < pstDirty->u32RangeCnt && pstDirty->astRange[i].u32End < u32Start) {
+        i++;
+    }
+    RK_U32 j = i;
+    while (j < pstDirty->u32RangeCnt && pstDirty->astRange[j].u32Start <= u32End) {
+        if (pstDirty->astRange[j].u32Start < u32Start) {
+            u32Start = pstDirty->astRange[j].u32Start;
+        }
+        if (pstDirty->astRange[j].u32End > u32End) {
+            u32End = pstDirty->astRange[j].u32End;
+        }
+        j++;
+    }
+    if (j > i) {
+        pstDirty->astRange[i].u32Start = u32Start;
+        pstDirty->astRange[i].u32End = u32End;
+        memmove(&pstDirty->astRange[i + 1], &pstDirty->astRange[j],
+                sizeof(TEST_MB_RANGE_S) * (pstDirty->u32RangeCnt - j));
+        pstDirty->u32RangeCnt -= j - i - 1;
+        return;
+    }
+
+    if (pstDirty->u32RangeCnt == TEST_MB_DIRTY_MAX_RANGE) {
+        /* full, close the smallest gap to make room */
+        RK_U32 u32Merge = 0;
+        for (RK_U32 k = 1; k + 1 < TEST_MB_DIRTY_MAX_RANGE; k++) {
+            if (pstDirty->astRange[k + 1].u32Start - pstDirty->astRange[k].u32End
+                    < pstDirty->astRange[u32Merge + 1].u32Start - pstDirty->astRange[u32Merge].u32End) {
+                u32Merge = k;
+            }
+        }
+        pstDirty->astRange[u32Merge].u32End = pstDirty->astRange[u32Merge + 1].u32End;
+        memmove(&pstDirty->astRange[u32Merge + 1], &pstDirty->astRange[u32Merge + 2],
+                sizeof(TEST_MB_RANGE_S) * (TEST_MB_DIRTY_MAX_RANGE - u32Merge - 2));
+        pstDirty->u32RangeCnt--;
+        /* the merged range may now reach the new one */
+        TEST_COMM_MbDirtyMark(pstDirty, u32Offset, u32Len);
+        return;
+    }
+    memmove(&pstDirty->astRange[i + 1], &pstDirty->astRange[i],
+            sizeof(TEST_MB_RANGE_S) * (pstDirty->u32RangeCnt - i));
+    pstDirty->astRange[i].u32Start = u32Start;
+    pstDirty->astRange[i].u32End = u32End;
+    pstDirty->u32RangeCnt++;
+}
+
+RK_VOID TEST_COMM_MbDirtyMarkRows(TEST_MB_DIRTY_S *pstDirty, RK_U32 u32PlaneOffset, RK_U32 u32Stride,
+                                  RK_U32 u32Y, RK_U32 u32Height) {
+    TEST_COMM_MbDirtyMark(pstDirty, u32PlaneOffset + u32Y * u32Stride, u32Height * u32Stride);
+}
+
+RK_S32 TEST_COMM_MbDirtySync(TEST_MB_DIRTY_S *pstDirty, RK_U32 u32Count, RK_U64 *pu64Bytes) {
+    RK_S32 s32Ret = RK_SUCCESS;
+    RK_U64 u64Bytes = 0;
+
+    if (pstDirty == RK_NULL) {
+        return RK_ERR_MB_NULL_PTR;
+    }
+    for (RK_U32 i = 0; i < u32Count; i++) {
+        TEST_MB_DIRTY_S *pstBlk = &pstDirty[i];
+        for (RK_U32 j = 0; j < pstBlk->u32RangeCnt; j++) {
+            RK_U32 u32Len = pstBlk->astRange[j].u32End - pstBlk->astRange[j].u32Start;
+            RK_S32 s32FlushRet = RK_MPI_MMZ_FlushCacheEnd(pstBlk->pMbBlk, pstBlk->astRange[j].u32Start,
+                                                          u32Len, RK_MMZ_SYNC_WRITEONLY);
+            if (s32FlushRet != RK_SUCCESS) {
+                /* no range flush for this block, clean all of it as before */
+                RK_LOGD("flush mb %p offset %d len %d failed 0x%x, flush the whole mb",
+                         pstBlk->pMbBlk, pstBlk->astRange[j].u32Start, u32Len, s32FlushRet);
+                s32FlushRet = RK_MPI_SYS_MmzFlushCache(pstBlk->pMbBlk, RK_FALSE);
+                if (s32FlushRet != RK_SUCCESS) {
+                    RK_LOGE("flush mb %p failed 0x%x", pstBlk->pMbBlk, s32FlushRet);
+                    s32Ret = s32FlushRet;
+                } else {
+                    u64Bytes += RK_MPI_MB_GetSize(pstBlk->pMbBlk);
+                }
+                break;
+            }
+            u64Bytes += u32Len;
+        }
+        pstBlk->u32RangeCnt = 0;
+    }
+    if (pu64Bytes != RK_NULL) {
+        *pu64Bytes = u64Bytes;
+    }
+    return s32Ret;
+}
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* End of #ifdef __cplusplus */
@@ -22,6 +22,7 @@
 #include <unistd.h>
 
 #include "test_comm_utils.h"
+#include "test_comm_mb_dirty.h"
 #include "rk_mpi_cal.h"
 #include "rk_mpi_mb.h"
 #include "rk_mpi_sys.h"
@@ -182,6 +183,7 @@ RK_S32 TEST_COMM_FileReadOneFrame(const char *pFileName, VIDEO_FRAME_INFO_S *pst
     FILE *fp = RK_NULL;
     PIC_BUF_ATTR_S stPicBufAttr;
     MB_PIC_CAL_S stMbPicCalResult;
+    TEST_MB_DIRTY_S stDirty;
 
     if (!pFileName || !pstVideoFrame) {
         return RK_FAILURE;
@@ -217,7 +219,10 @@ RK_S32 TEST_COMM_FileReadOneFrame(const char *pFileName, VIDEO_FRAME_INFO_S *pst
         goto __FAILED;
     }
 
-    RK_MPI_SYS_MmzFlushCache(pstVideoFrame->stVFrame.pMbBlk, RK_FALSE);
+    // only the bytes read are dirty, the rest of the block needs no clean
+    TEST_COMM_MbDirtyInit(&stDirty, pstVideoFrame->stVFrame.pMbBlk);
+    TEST_COMM_MbDirtyMark(&stDirty, 0, u32ReadSize);
+    TEST_COMM_MbDirtySync(&stDirty, 1, RK_NULL);
 
 __FAILED:
     if (fp) {
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TESTS_RT_MPI_COMMON_TEST_COMM_MB_CHAIN_H_
+#define SRC_TESTS_RT_MPI_COMMON_TEST_COMM_MB_CHAIN_H_
+
+#include <sys/uio.h>
+
+#include "rk_comm_mb.h"
+#include "rk_comm_venc.h"
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C" {
+#endif
+#endif /* End of #ifdef __cplusplus */
+
+#define TEST_MB_CHAIN_MAX_SEG       64
+
+/*
+ * scatter-gather view of one stream over several MB_BLK segments, e.g.
+ * the packs of a multi pack VENC frame. every segment holds one user of
+ * its block, the chain itself has a single refcount for the consumers.
+ * adjacent ranges of the same block are merged into one segment, so a
+ * frame is written with a single writev() and no copy.
+ */
+typedef struct _rkTEST_MB_CHAIN_S {
+    RK_S32          s32RefCnt;
+    RK_U32          u32SegCnt;
+    RK_U64          u64Length;
+    MB_BLK          apMbBlk[TEST_MB_CHAIN_MAX_SEG];
+    struct iovec    astIov[TEST_MB_CHAIN_MAX_SEG];
+} TEST_MB_CHAIN_S;
+
+TEST_MB_CHAIN_S *TEST_COMM_MbChainCreate();
+RK_VOID TEST_COMM_MbChainRef(TEST_MB_CHAIN_S *pstChain);
+/* the last unref releases the users taken on the segment blocks. */
+RK_VOID TEST_COMM_MbChainUnref(TEST_MB_CHAIN_S *pstChain);
+
+RK_S32 TEST_COMM_MbChainAppend(TEST_MB_CHAIN_S *pstChain, MB_BLK pMbBlk, RK_U32 u32Offset, RK_U32 u32Len);
+/* every pack of the stream, in order. */
+RK_S32 TEST_COMM_MbChainAppendVencStream(TEST_MB_CHAIN_S *pstChain, const VENC_STREAM_S *pstStream);
+
+/* writes the whole chain to fd, bytes written or RK_FAILURE. */
+RK_S64 TEST_COMM_MbChainWrite(const TEST_MB_CHAIN_S *pstChain, RK_S32 s32Fd);
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* End of #ifdef __cplusplus */
+
+#endif  // SRC_TESTS_RT_MPI_COMMON_TEST_COMM_MB_CHAIN_H_
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TESTS_RT_MPI_COMMON_TEST_COMM_MB_DIRTY_H_
+#define SRC_TESTS_RT_MPI_COMMON_TEST_COMM_MB_DIRTY_H_
+
+#include "rk_comm_mb.h"
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C" {
+#endif
+#endif /* End of #ifdef __cplusplus */
+
+#define TEST_MB_DIRTY_MAX_RANGE     4
+
+typedef struct _rkTEST_MB_RANGE_S {
+    RK_U32          u32Start;
+    RK_U32          u32End;
+} TEST_MB_RANGE_S;
+
+/*
+ * byte ranges the cpu wrote to a cached block since its last sync. a sync
+ * cleans only those ranges and skips a block that was not written or is
+ * reported uncached, a block without range flush gets a full flush. more
+ * ranges than TEST_MB_DIRTY_MAX_RANGE merge the two closest ones, e.g.
+ * the y and uv rows of a nv12 roi stay apart.
+ */
+typedef struct _rkTEST_MB_DIRTY_S {
+    MB_BLK          pMbBlk;
+    RK_BOOL         bCached;
+    RK_U32          u32RangeCnt;
+    TEST_MB_RANGE_S astRange[TEST_MB_DIRTY_MAX_RANGE];
+} TEST_MB_DIRTY_S;
+
+RK_VOID TEST_COMM_MbDirtyInit(TEST_MB_DIRTY_S *pstDirty, MB_BLK pMbBlk);
+RK_VOID TEST_COMM_MbDirtyMark(TEST_MB_DIRTY_S *pstDirty, RK_U32 u32Offset, RK_U32 u32Len);
+/* rows [u32Y, u32Y + u32Height) of a plane, columns are not tracked. */
+RK_VOID TEST_COMM_MbDirtyMarkRows(TEST_MB_DIRTY_S *pstDirty, RK_U32 u32PlaneOffset, RK_U32 u32Stride,
+                                  RK_U32 u32Y, RK_U32 u32Height);
+
+/*
+ * makes the cpu writes of every block visible to the device in one pass
+ * and resets the ranges. pu64Bytes, if set, returns the bytes cleaned.
+ */
+RK_S32 TEST_COMM_MbDirtySync(TEST_MB_DIRTY_S *pstDirty, RK_U32 u32Count, RK_U64 *pu64Bytes);
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* End of #ifdef __cplusplus */
+
+#endif  // SRC_TESTS_RT_MPI_COMMON_TEST_COMM_MB_DIRTY_H_
@@ -18,7 +18,10 @@
 #endif
 #define DBG_MOD_ID DBG_MOD_COMB1(RK_ID_MB)
 
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 #include <cstring>
 #include <vector>
@@ -28,10 +31,21 @@
 #include "rk_mpi_sys.h"
 
 #include "test_comm_argparse.h"
+#include "test_comm_mb_chain.h"
 
 #define MB_POOL_COUNT           10
 #define MB_POOL_MB_COUNT        10
 #define MB_POOL_MB_SIZE         1280 * 720 * 2
+#define MB_BENCH_HOLD_COUNT     2
+#define MB_BENCH_DUMP_SIZE      (16 * 1024)
+/* 4K H.265 at 30 fps and about 16 Mbps, gop 60, one pack per slice */
+#define MB_CHAIN_BLK_SIZE       (1024 * 1024)
+#define MB_CHAIN_BLK_COUNT      4
+#define MB_CHAIN_GOP            60
+#define MB_CHAIN_I_FRAME_SIZE   (384 * 1024)
+#define MB_CHAIN_P_FRAME_SIZE   (48 * 1024)
+#define MB_CHAIN_SLICE_COUNT    8
+#define MB_CHAIN_PACK_ALIGN     64
 
 typedef struct _rkTestMbCtx {
     RK_S32      s32MbCount;
@@ -43,8 +57,20 @@ typedef struct _rkTestMbCtx {
     RK_S32      s32RemapMode;
     RK_S32      s32AllocType;
     RK_S32      ss2DmaType;
+    RK_S32      s32BenchThreads;
+    RK_S32      s32BenchLoops;
+    RK_S32      s32BenchIdleMs;
+    RK_S32      s32ChainFrames;
+    const char *pChainOutput;
 } TEST_MB_CTX_S;
 
+typedef struct _rkTestMbBenchCtx {
+    MB_POOL     pool;
+    RK_U64      u64MbSize;
+    RK_S32      s32Loops;
+    RK_S32      s32Failed;
+} TEST_MB_BENCH_CTX_S;
+
 RK_S32 unit_test_mpi_mb(const TEST_MB_CTX_S *pstCtx) {
     MB_POOL_CONFIG_S pstMbPoolCfg;
     std::vector<MB_BLK> vector;
@@ -179,6 +205,254 @@ __FAILED:
     return s32Ret;
 }
 
+static void *unit_test_mpi_mb_bench_proc(void *pArgs) {
+    TEST_MB_BENCH_CTX_S *pstBench = reinterpret_cast<TEST_MB_BENCH_CTX_S *>(pArgs);
+    MB_BLK blks[MB_BENCH_HOLD_COUNT];
+
+    /* like a decoder, hold the reference and the current frame at once */
+    for (RK_S32 i = 0; i < pstBench->s32Loops; i++) {
+        for (RK_S32 j = 0; j < MB_BENCH_HOLD_COUNT; j++) {
+            blks[j] = RK_MPI_MB_GetMB(pstBench->pool, pstBench->u64MbSize, RK_TRUE);
+            if (blks[j] == MB_INVALID_HANDLE) {
+                pstBench->s32Failed++;
+            }
+        }
+        for (RK_S32 j = 0; j < MB_BENCH_HOLD_COUNT; j++) {
+            if (blks[j] != MB_INVALID_HANDLE) {
+                RK_MPI_MB_ReleaseMB(blks[j]);
+            }
+        }
+    }
+    return RK_NULL;
+}
+
+static void unit_test_mpi_mb_dump() {
+    RK_CHAR *pDump = reinterpret_cast<RK_CHAR *>(malloc(MB_BENCH_DUMP_SIZE));
+    if (pDump != RK_NULL) {
+        if (RK_MPI_SYS_DumpSys("dumpsys mb", pDump, MB_BENCH_DUMP_SIZE) == RK_SUCCESS) {
+            RK_LOGI("\n%s", pDump);
+        }
+        free(pDump);
+    }
+}
+
+RK_S32 unit_test_mpi_mb_bench(const TEST_MB_CTX_S *pstCtx) {
+    MB_POOL_CONFIG_S stMbPoolCfg;
+    TEST_MB_BENCH_CTX_S stBench;
+    std::vector<pthread_t> threads;
+    struct timespec stBegin, stEnd;
+    RK_S32 s32Ret = RK_SUCCESS;
+
+    memset(&stMbPoolCfg, 0, sizeof(MB_POOL_CONFIG_S));
+    stMbPoolCfg.u64MBSize   = pstCtx->s32MbSize;
+    stMbPoolCfg.u32MBCnt    = pstCtx->s32MbCount;
+    stMbPoolCfg.bPreAlloc   = pstCtx->bPreAlloc;
+    stMbPoolCfg.enRemapMode = (MB_REMAP_MODE_E)pstCtx->s32RemapMode;
+    stMbPoolCfg.enAllocType = (MB_ALLOC_TYPE_E)pstCtx->s32AllocType;
+    stMbPoolCfg.enDmaType   = (MB_DMA_TYPE_E)(pstCtx->ss2DmaType << 12);
+    /* fewer blocks than holders would deadlock the blocking gets */
+    if (stMbPoolCfg.u32MBCnt < (RK_U32)(pstCtx->s32BenchThreads * MB_BENCH_HOLD_COUNT)) {
+        stMbPoolCfg.u32MBCnt = pstCtx->s32BenchThreads * MB_BENCH_HOLD_COUNT;
+    }
+
+    memset(&stBench, 0, sizeof(TEST_MB_BENCH_CTX_S));
+    stBench.pool = RK_MPI_MB_CreatePool(&stMbPoolCfg);
+    if (stBench.pool == MB_INVALID_POOLID) {
+        return RK_ERR_MB_2MPOOLS;
+    }
+    stBench.u64MbSize = stMbPoolCfg.u64MBSize;
+    stBench.s32Loops = pstCtx->s32BenchLoops;
+
+    std::vector<TEST_MB_BENCH_CTX_S> benches(pstCtx->s32BenchThreads, stBench);
+    clock_gettime(CLOCK_MONOTONIC, &stBegin);
+    for (RK_S32 i = 0; i < pstCtx->s32BenchThreads; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, RK_NULL, unit_test_mpi_mb_bench_proc, &benches[i]) != 0) {
+            s32Ret = RK_ERR_MB_BUSY;
+            break;
+        }
+        threads.push_back(thread);
+    }
+    for (RK_U32 i = 0; i < threads.size(); i++) {
+        pthread_join(threads[i], RK_NULL);
+        if (benches[i].s32Failed > 0) {
+            RK_LOGE("bench thread %d failed %d gets", i, benches[i].s32Failed);
+            s32Ret = RK_ERR_MB_NOBUF;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stEnd);
+
+    RK_DOUBLE elapsed = (stEnd.tv_sec - stBegin.tv_sec) + (stEnd.tv_nsec - stBegin.tv_nsec) / 1e9;
+    RK_DOUBLE pairs = (RK_DOUBLE)threads.size() * pstCtx->s32BenchLoops * MB_BENCH_HOLD_COUNT;
+    RK_LOGI("bench threads(%d) mb_count(%d) get/release pairs(%.0f) elapsed(%.3f s) "
+            "%.0f pairs/s %.1f ns/pair",
+             pstCtx->s32BenchThreads, stMbPoolCfg.u32MBCnt, pairs, elapsed,
+             (elapsed > 0) ? pairs / elapsed : 0, (pairs > 0) ? elapsed * 1e9 / pairs : 0);
+
+    unit_test_mpi_mb_dump();
+    /* with idle trimming on, the idle blocks of the burst are unmapped by now */
+    if (pstCtx->s32BenchIdleMs > 0) {
+        usleep(pstCtx->s32BenchIdleMs * 1000);
+        RK_LOGI("after %d ms idle", pstCtx->s32BenchIdleMs);
+        unit_test_mpi_mb_dump();
+    }
+    RK_MPI_MB_DestroyPool(stBench.pool);
+    return s32Ret;
+}
+
+typedef enum _rkTestMbChainMode {
+    MB_CHAIN_MODE_FWRITE = 0,   /* fwrite and fflush per pack */
+    MB_CHAIN_MODE_COPY,         /* packs copied to one buffer, one write */
+    MB_CHAIN_MODE_WRITEV,       /* TEST_MB_CHAIN_S, one writev */
+    MB_CHAIN_MODE_BUTT,
+} TEST_MB_CHAIN_MODE_E;
+
+/* write syscalls of this process, -1 without /proc/self/io. */
+static RK_S64 unit_test_mpi_mb_syscw() {
+    RK_CHAR line[128];
+    RK_S64 s64Syscw = -1;
+    FILE *fp = fopen("/proc/self/io", "r");
+    if (fp == RK_NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp) != RK_NULL) {
+        if (sscanf(line, "syscw: %lld", reinterpret_cast<long long *>(&s64Syscw)) == 1) {
+            break;
+        }
+    }
+    fclose(fp);
+    return s64Syscw;
+}
+
+/* packs of one frame like a multi pack VENC_STREAM_S, aligned and apart. */
+static RK_U32 unit_test_mpi_mb_chain_frame(MB_BLK blk, RK_S32 s32Frame, VENC_PACK_S *pstPacks) {
+    RK_U32 u32FrameSize = (s32Frame % MB_CHAIN_GOP == 0) ? MB_CHAIN_I_FRAME_SIZE : MB_CHAIN_P_FRAME_SIZE;
+    RK_U32 u32SliceSize = u32FrameSize / MB_CHAIN_SLICE_COUNT;
+    RK_U32 u32Offset = 0;
+
+    for (RK_U32 i = 0; i < MB_CHAIN_SLICE_COUNT; i++) {
+        memset(&pstPacks[i], 0, sizeof(VENC_PACK_S));
+        pstPacks[i].pMbBlk = blk;
+        pstPacks[i].u32Offset = u32Offset;
+        /* slices never end on the alignment, the next pack starts apart */
+        pstPacks[i].u32Len = u32SliceSize - (i + 1) * 7;
+        pstPacks[i].bFrameEnd = (RK_BOOL)(i == MB_CHAIN_SLICE_COUNT - 1);
+        u32Offset += (pstPacks[i].u32Len + MB_CHAIN_PACK_ALIGN - 1) & ~(MB_CHAIN_PACK_ALIGN - 1);
+    }
+    return MB_CHAIN_SLICE_COUNT;
+}
+
+RK_S32 unit_test_mpi_mb_chain_bench(const TEST_MB_CTX_S *pstCtx) {
+    static const char *modes[] = { "fwrite", "copy", "writev" };
+    MB_POOL_CONFIG_S stMbPoolCfg;
+    MB_BLK blks[MB_CHAIN_BLK_COUNT] = { MB_INVALID_HANDLE };
+    VENC_PACK_S astPacks[MB_CHAIN_SLICE_COUNT];
+    VENC_STREAM_S stStream;
+    RK_U8 *pu8Copy = RK_NULL;
+    RK_S32 s32Ret = RK_SUCCESS;
+    MB_POOL pool = MB_INVALID_POOLID;
+
+    memset(&stMbPoolCfg, 0, sizeof(MB_POOL_CONFIG_S));
+    stMbPoolCfg.u64MBSize   = MB_CHAIN_BLK_SIZE;
+    stMbPoolCfg.u32MBCnt    = MB_CHAIN_BLK_COUNT;
+    stMbPoolCfg.bPreAlloc   = RK_TRUE;
+    stMbPoolCfg.enRemapMode = (MB_REMAP_MODE_E)pstCtx->s32RemapMode;
+    stMbPoolCfg.enAllocType = (MB_ALLOC_TYPE_E)pstCtx->s32AllocType;
+    pool = RK_MPI_MB_CreatePool(&stMbPoolCfg);
+    if (pool == MB_INVALID_POOLID) {
+        return RK_ERR_MB_2MPOOLS;
+    }
+    for (RK_S32 i = 0; i < MB_CHAIN_BLK_COUNT; i++) {
+        blks[i] = RK_MPI_MB_GetMB(pool, MB_CHAIN_BLK_SIZE, RK_TRUE);
+        if (blks[i] == MB_INVALID_HANDLE) {
+            s32Ret = RK_ERR_MB_NOBUF;
+            goto __FAILED;
+        }
+        memset(RK_MPI_MB_Handle2VirAddr(blks[i]), 0x5a + i, MB_CHAIN_BLK_SIZE);
+    }
+    pu8Copy = reinterpret_cast<RK_U8 *>(malloc(MB_CHAIN_BLK_SIZE));
+    if (pu8Copy == RK_NULL) {
+        s32Ret = RK_ERR_MB_NOMEM;
+        goto __FAILED;
+    }
+    memset(&stStream, 0, sizeof(VENC_STREAM_S));
+    stStream.pstPack = astPacks;
+
+    for (RK_S32 mode = 0; mode < MB_CHAIN_MODE_BUTT; mode++) {
+        struct timespec stBegin, stEnd;
+        RK_U64 u64Bytes = 0, u64Copied = 0, u64Packs = 0;
+        FILE *fp = fopen(pstCtx->pChainOutput, "wb");
+        if (fp == RK_NULL) {
+            RK_LOGE("open %s failed", pstCtx->pChainOutput);
+            s32Ret = RK_FAILURE;
+            goto __FAILED;
+        }
+        RK_S64 s64Syscw = unit_test_mpi_mb_syscw();
+        clock_gettime(CLOCK_MONOTONIC, &stBegin);
+        for (RK_S32 frame = 0; frame < pstCtx->s32ChainFrames; frame++) {
+            MB_BLK blk = blks[frame % MB_CHAIN_BLK_COUNT];
+            RK_U8 *pu8Data = reinterpret_cast<RK_U8 *>(RK_MPI_MB_Handle2VirAddr(blk));
+            stStream.u32PackCount = unit_test_mpi_mb_chain_frame(blk, frame, astPacks);
+            u64Packs += stStream.u32PackCount;
+
+            if (mode == MB_CHAIN_MODE_FWRITE) {
+                for (RK_U32 i = 0; i < stStream.u32PackCount; i++) {
+                    u64Bytes += fwrite(pu8Data + astPacks[i].u32Offset, 1, astPacks[i].u32Len, fp);
+                    fflush(fp);
+                }
+            } else if (mode == MB_CHAIN_MODE_COPY) {
+                RK_U32 u32Len = 0;
+                for (RK_U32 i = 0; i < stStream.u32PackCount; i++) {
+                    memcpy(pu8Copy + u32Len, pu8Data + astPacks[i].u32Offset, astPacks[i].u32Len);
+                    u32Len += astPacks[i].u32Len;
+                }
+                u64Copied += u32Len;
+                u64Bytes += write(fileno(fp), pu8Copy, u32Len);
+            } else {
+                TEST_MB_CHAIN_S *pstChain = TEST_COMM_MbChainCreate();
+                if (pstChain == RK_NULL || TEST_COMM_MbChainAppendVencStream(pstChain, &stStream) != RK_SUCCESS) {
+                    TEST_COMM_MbChainUnref(pstChain);
+                    s32Ret = RK_FAILURE;
+                    break;
+                }
+                RK_S64 s64Written = TEST_COMM_MbChainWrite(pstChain, fileno(fp));
+                TEST_COMM_MbChainUnref(pstChain);
+                if (s64Written < 0) {
+                    s32Ret = RK_FAILURE;
+                    break;
+                }
+                u64Bytes += s64Written;
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &stEnd);
+        RK_S64 s64Syscalls = unit_test_mpi_mb_syscw();
+        s64Syscalls = (s64Syscw >= 0 && s64Syscalls >= 0) ? s64Syscalls - s64Syscw : -1;
+        fclose(fp);
+
+        RK_DOUBLE elapsed = (stEnd.tv_sec - stBegin.tv_sec) + (stEnd.tv_nsec - stBegin.tv_nsec) / 1e9;
+        RK_LOGI("chain bench %-6s frames(%d) packs(%llu) bytes(%llu) write syscalls(%lld) "
+                "memcpy bytes(%llu) elapsed(%.3f ms) %.1f us/frame",
+                 modes[mode], pstCtx->s32ChainFrames, u64Packs, u64Bytes, s64Syscalls,
+                 u64Copied, elapsed * 1e3,
+                 (pstCtx->s32ChainFrames > 0) ? elapsed * 1e6 / pstCtx->s32ChainFrames : 0);
+        if (s32Ret != RK_SUCCESS) {
+            goto __FAILED;
+        }
+    }
+
+__FAILED:
+    if (pu8Copy != RK_NULL) {
+        free(pu8Copy);
+    }
+    for (RK_S32 i = 0; i < MB_CHAIN_BLK_COUNT; i++) {
+        if (blks[i] != MB_INVALID_HANDLE) {
+            RK_MPI_MB_ReleaseMB(blks[i]);
+        }
+    }
+    RK_MPI_MB_DestroyPool(pool);
+    return s32Ret;
+}
+
 static const char *const usages[] = {
     "./rk_mpi_mb_test [-c MB_COUNT] [-s MB_SIZE]...",
     NULL,
@@ -197,6 +471,11 @@ RK_S32 main(RK_S32 argc, const char **argv) {
     stMbCtx.s32RemapMode = MB_REMAP_MODE_CACHED;
     stMbCtx.s32AllocType = MB_ALLOC_TYPE_DMA;
     stMbCtx.ss2DmaType = MB_DMA_TYPE_NONE;
+    stMbCtx.s32BenchThreads = 0;
+    stMbCtx.s32BenchLoops = 100000;
+    stMbCtx.s32BenchIdleMs = 0;
+    stMbCtx.s32ChainFrames = 0;
+    stMbCtx.pChainOutput = "/dev/null";
 
     struct argparse_option options[] = {
         OPT_HELP(),
@@ -212,6 +491,18 @@ RK_S32 main(RK_S32 argc, const char **argv) {
                     "alloc type. default(0). 0: DMA, 1: malloc", NULL, 0, 0),
         OPT_INTEGER('d', "dma_type", &(stMbCtx.ss2DmaType),
                     "dma type. default(0). 0: IOMMU, 1: CMA", NULL, 0, 0),
+        OPT_INTEGER('T', "bench_threads", &(stMbCtx.s32BenchThreads),
+                    "threads of the get/release throughput bench, replaces the unit test. default(0).",
+                    NULL, 0, 0),
+        OPT_INTEGER('L', "bench_loops", &(stMbCtx.s32BenchLoops),
+                    "loops of every bench thread. default(100000).", NULL, 0, 0),
+        OPT_INTEGER('I', "bench_idle_ms", &(stMbCtx.s32BenchIdleMs),
+                    "idle time before the bench dumps the pools again. default(0).", NULL, 0, 0),
+        OPT_INTEGER('C', "chain_frames", &(stMbCtx.s32ChainFrames),
+                    "frames of the 4K H.265 stream save bench, fwrite vs copy vs mb chain writev, "
+                    "replaces the unit test. default(0).", NULL, 0, 0),
+        OPT_STRING('o', "chain_output", &(stMbCtx.pChainOutput),
+                   "output file of the stream save bench. default(/dev/null).", NULL, 0, 0),
         OPT_END(),
     };
 
@@ -227,7 +518,13 @@ RK_S32 main(RK_S32 argc, const char **argv) {
         goto __FAILED;
     }
 
-    s32Ret = unit_test_mpi_mb(&stMbCtx);
+    if (stMbCtx.s32ChainFrames > 0) {
+        s32Ret = unit_test_mpi_mb_chain_bench(&stMbCtx);
+    } else if (stMbCtx.s32BenchThreads > 0) {
+        s32Ret = unit_test_mpi_mb_bench(&stMbCtx);
+    } else {
+        s32Ret = unit_test_mpi_mb(&stMbCtx);
+    }
     if (s32Ret != RK_SUCCESS) {
         goto __FAILED;
     }
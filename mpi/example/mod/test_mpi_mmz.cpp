@@ -16,6 +16,7 @@
 #include <stdint.h>
 #include <inttypes.h>
 #include <stdio.h>
+#include <time.h>
 #include <unistd.h>
 #include <cstring>
 #include <vector>
@@ -23,12 +24,18 @@
 #include "rk_debug.h"
 #include "rk_comm_mb.h"
 #include "rk_mpi_mmz.h"
+#include "rk_mpi_sys.h"
 
 #include "test_comm_argparse.h"
+#include "test_comm_mb_dirty.h"
 
 #define MB_POOL_COUNT           10
 #define MB_POOL_MB_COUNT        10
 #define MB_POOL_MB_SIZE         1280 * 720 * 2
+/* frames in flight, and an osd box the cpu draws into each of them */
+#define MMZ_FLUSH_BUF_COUNT     4
+#define MMZ_FLUSH_ROI_WIDTH     256
+#define MMZ_FLUSH_ROI_HEIGHT    128
 
 typedef struct _rkTestMMZCtx {
     RK_S32      s32MmzCount;
@@ -39,8 +46,16 @@ typedef struct _rkTestMMZCtx {
     RK_BOOL     bPreAlloc;
     RK_S32      s32RemapMode;
     RK_S32      s32AllocType;
+    RK_S32      s32FlushFrames;
 } TEST_MMZ_CTX_S;
 
+typedef enum _rkTestMmzFlushMode {
+    MMZ_FLUSH_MODE_FULL = 0,    /* RK_MPI_SYS_MmzFlushCache on every frame */
+    MMZ_FLUSH_MODE_ROI,         /* dirty ranges of the roi, all frames in one sync */
+    MMZ_FLUSH_MODE_ONE,         /* roi drawn into one frame, the others untouched */
+    MMZ_FLUSH_MODE_BUTT,
+} TEST_MMZ_FLUSH_MODE_E;
+
 #define vaddr_to_fd_offset(vaddr, fd, offset) do {\
     MB_BLK __blk = RK_MPI_MMZ_VirAddr2Handle(vaddr); \
     if (__blk != (MB_BLK)RK_NULL) { \
@@ -146,6 +161,86 @@ RK_S32 unit_test_mpi_mmz(const TEST_MMZ_CTX_S *pCtx) {
 }
 
 
+static RK_S32 unit_test_mpi_mmz_flush(const TEST_MMZ_CTX_S *pCtx, RK_U32 u32Width, RK_U32 u32Height) {
+    static const char *modes[] = { "full", "roi", "one" };
+    MB_BLK blks[MMZ_FLUSH_BUF_COUNT] = { MB_INVALID_HANDLE };
+    TEST_MB_DIRTY_S astDirty[MMZ_FLUSH_BUF_COUNT];
+    RK_U32 u32Size = u32Width * u32Height * 3 / 2;
+    RK_U32 u32RoiX = (u32Width - MMZ_FLUSH_ROI_WIDTH) / 2;
+    RK_U32 u32RoiY = (u32Height - MMZ_FLUSH_ROI_HEIGHT) / 2 & ~1;
+    RK_S32 s32Ret = RK_SUCCESS;
+
+    for (RK_S32 i = 0; i < MMZ_FLUSH_BUF_COUNT; i++) {
+        s32Ret = RK_MPI_MMZ_Alloc(&blks[i], u32Size, RK_MMZ_ALLOC_CACHEABLE);
+        if (s32Ret != RK_SUCCESS) {
+            goto __FAILED;
+        }
+    }
+
+#ifdef USE_ROCKIT_MB_SIM
+    /* host caches are coherent, the sim skips the cache line walk */
+    RK_LOGW("sim backend, us/frame is the call overhead without cache maintenance");
+#endif
+    for (RK_S32 mode = 0; mode < MMZ_FLUSH_MODE_BUTT; mode++) {
+        RK_U64 u64FlushNs = 0, u64Bytes = 0;
+        for (RK_S32 i = 0; i < MMZ_FLUSH_BUF_COUNT; i++) {
+            TEST_COMM_MbDirtyInit(&astDirty[i], blks[i]);
+        }
+        for (RK_S32 frame = 0; frame < pCtx->s32FlushFrames; frame++) {
+            struct timespec stBegin, stEnd;
+            for (RK_S32 i = 0; i < MMZ_FLUSH_BUF_COUNT; i++) {
+                RK_U8 *pu8Y = reinterpret_cast<RK_U8 *>(RK_MPI_MMZ_Handle2VirAddr(blks[i]));
+                RK_U8 *pu8UV = pu8Y + u32Width * u32Height;
+                if (mode == MMZ_FLUSH_MODE_ONE && i > 0) {
+                    continue;
+                }
+                for (RK_U32 y = 0; y < MMZ_FLUSH_ROI_HEIGHT; y++) {
+                    memset(pu8Y + (u32RoiY + y) * u32Width + u32RoiX, frame, MMZ_FLUSH_ROI_WIDTH);
+                }
+                for (RK_U32 y = 0; y < MMZ_FLUSH_ROI_HEIGHT / 2; y++) {
+                    memset(pu8UV + (u32RoiY / 2 + y) * u32Width + u32RoiX, 0x80, MMZ_FLUSH_ROI_WIDTH);
+                }
+                TEST_COMM_MbDirtyMarkRows(&astDirty[i], 0, u32Width, u32RoiY, MMZ_FLUSH_ROI_HEIGHT);
+                TEST_COMM_MbDirtyMarkRows(&astDirty[i], u32Width * u32Height, u32Width,
+                                          u32RoiY / 2, MMZ_FLUSH_ROI_HEIGHT / 2);
+            }
+
+            clock_gettime(CLOCK_MONOTONIC, &stBegin);
+            if (mode == MMZ_FLUSH_MODE_FULL) {
+                for (RK_S32 i = 0; i < MMZ_FLUSH_BUF_COUNT; i++) {
+                    RK_MPI_SYS_MmzFlushCache(blks[i], RK_FALSE);
+                    u64Bytes += RK_MPI_MMZ_GetSize(blks[i]);
+                }
+            } else {
+                RK_U64 u64Synced = 0;
+                TEST_COMM_MbDirtySync(astDirty, MMZ_FLUSH_BUF_COUNT, &u64Synced);
+                u64Bytes += u64Synced;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &stEnd);
+            u64FlushNs += (stEnd.tv_sec - stBegin.tv_sec) * 1000000000llu + stEnd.tv_nsec - stBegin.tv_nsec;
+        }
+        RK_LOGI("flush bench nv12 %dx%d %-4s frames(%d) x %d bufs flushed %llu bytes/frame %.1f us/frame",
+                 u32Width, u32Height, modes[mode], pCtx->s32FlushFrames, MMZ_FLUSH_BUF_COUNT,
+                 (unsigned long long)(u64Bytes / pCtx->s32FlushFrames), u64FlushNs / 1e3 / pCtx->s32FlushFrames);
+    }
+
+__FAILED:
+    for (RK_S32 i = 0; i < MMZ_FLUSH_BUF_COUNT; i++) {
+        if (blks[i] != MB_INVALID_HANDLE) {
+            RK_MPI_MMZ_Free(blks[i]);
+        }
+    }
+    return s32Ret;
+}
+
+RK_S32 unit_test_mpi_mmz_flush_bench(const TEST_MMZ_CTX_S *pCtx) {
+    RK_S32 s32Ret = unit_test_mpi_mmz_flush(pCtx, 1920, 1080);
+    if (s32Ret != RK_SUCCESS) {
+        return s32Ret;
+    }
+    return unit_test_mpi_mmz_flush(pCtx, 3840, 2160);
+}
+
 static const char *const usages[] = {
     "./rk_mpi_mmz_test [-c MB_COUNT] [-s MB_SIZE]...",
     NULL,
@@ -160,6 +255,9 @@ RK_S32 main(RK_S32 argc, const char **argv) {
     struct argparse_option options[] = {
         OPT_HELP(),
         OPT_GROUP("basic options:"),
+        OPT_INTEGER('F', "flush_frames", &(stMmzCtx.s32FlushFrames),
+                    "frames of the 1080p/4K nv12 flush cost bench, full vs dirty range flush, "
+                    "replaces the unit test. default(0).", NULL, 0, 0),
         OPT_END(),
     };
 
@@ -170,7 +268,11 @@ RK_S32 main(RK_S32 argc, const char **argv) {
 
     argc = argparse_parse(&argparse, argc, argv);
 
-    s32Ret = unit_test_mpi_mmz(&stMmzCtx);
+    if (stMmzCtx.s32FlushFrames > 0) {
+        s32Ret = unit_test_mpi_mmz_flush_bench(&stMmzCtx);
+    } else {
+        s32Ret = unit_test_mpi_mmz(&stMmzCtx);
+    }
     if (s32Ret != RK_SUCCESS) {
         goto __FAILED;
     }
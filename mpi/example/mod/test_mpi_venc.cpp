@@ -31,6 +31,7 @@
 
 #include "test_comm_argparse.h"
 #include "test_comm_imgproc.h"
+#include "test_comm_mb_chain.h"
 #include "test_comm_venc.h"
 #include "test_comm_utils.h"
 
@@ -266,11 +267,25 @@ void* venc_get_stream(void *pArgs) {
                              stFrame.pstPack[i].DataType,
                              stFrame.pstPack[i].u32Offset,
                              stFrame.pstPack[i].u32Len);
-                    if (pstCtx->dstFilePath != RK_NULL) {
-                        pData = (char *)RK_MPI_MB_Handle2VirAddr(stFrame.pstPack[i].pMbBlk);
-                        fwrite(pData + stFrame.pstPack[i].u32Offset, 1, stFrame.pstPack[i].u32Len, fp);
-                        fflush(fp);
+                }
+                // one writev for all packs instead of a write per pack
+                if (pstCtx->dstFilePath != RK_NULL) {
+                    TEST_MB_CHAIN_S *pstChain = TEST_COMM_MbChainCreate();
+                    if (pstChain != RK_NULL
+                            && TEST_COMM_MbChainAppendVencStream(pstChain, &stFrame) == RK_SUCCESS) {
+                        if (TEST_COMM_MbChainWrite(pstChain, fileno(fp)) != (RK_S64)pstChain->u64Length) {
+                            RK_LOGE("chn(%d) stream(%d) write %lld bytes failed",
+                                     u32Ch, s32StreamCnt, (RK_S64)pstChain->u64Length);
+                        }
+                    } else {
+                        RK_LOGE("chn(%d) stream(%d) mb chain failed, write pack by pack", u32Ch, s32StreamCnt);
+                        for (RK_U32 i = 0; i < stFrame.u32PackCount; i++) {
+                            pData = (char *)RK_MPI_MB_Handle2VirAddr(stFrame.pstPack[i].pMbBlk);
+                            fwrite(pData + stFrame.pstPack[i].u32Offset, 1, stFrame.pstPack[i].u32Len, fp);
+                            fflush(fp);
+                        }
                     }
+                    TEST_COMM_MbChainUnref(pstChain);
                 }
             }
             RK_MPI_VENC_ReleaseStream(u32Ch, &stFrame);
@@ -0,0 +1,293 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef DBG_MOD_ID
+#undef DBG_MOD_ID
+#endif
+#define DBG_MOD_ID DBG_MOD_COMB1(RK_ID_MB)
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <map>
+
+#include "rk_debug.h"
+#include "sim_mb.h"
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC                 0x0001U
+#endif
+
+/* first synthetic physical address, blocks are a guard page apart. */
+#define SIM_MB_PHY_BASE             0x10000000ULL
+
+typedef struct _rkSIM_MB_REGISTRY_S {
+    pthread_mutex_t                 mutex;
+    std::map<uintptr_t, SIM_MB_S *> vaddr;
+    std::map<RK_U64, SIM_MB_S *>    paddr;
+    std::map<RK_S32, SIM_MB_S *>    fd;
+    std::map<RK_S32, SIM_MB_S *>    uid;
+    RK_U64                          u64NextPhyAddr;
+    RK_S32                          s32NextUniqueId;
+    SIM_MB_STAT_S                   stStat;
+} SIM_MB_REGISTRY_S;
+
+static SIM_MB_REGISTRY_S *sim_mb_registry() {
+    static SIM_MB_REGISTRY_S *pstRegistry = RK_NULL;
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    struct Init {
+        static void run() {
+            pstRegistry = new SIM_MB_REGISTRY_S();
+            pthread_mutex_init(&pstRegistry->mutex, RK_NULL);
+            pstRegistry->u64NextPhyAddr = SIM_MB_PHY_BASE;
+            pstRegistry->s32NextUniqueId = 1;
+            memset(&pstRegistry->stStat, 0, sizeof(SIM_MB_STAT_S));
+        }
+    };
+    pthread_once(&once, Init::run);
+    return pstRegistry;
+}
+
+/* the block whose [start, start + size) holds key, keys are range starts. */
+template <typename K>
+static SIM_MB_S *sim_mb_find_range(const std::map<K, SIM_MB_S *> &ranges, K key, K start(const SIM_MB_S *)) {
+    typename std::map<K, SIM_MB_S *>::const_iterator it = ranges.upper_bound(key);
+    if (it == ranges.begin()) {
+        return RK_NULL;
+    }
+    --it;
+    SIM_MB_S *pstMb = it->second;
+    if (key - start(pstMb) >= pstMb->u64Size) {
+        return RK_NULL;
+    }
+    return pstMb;
+}
+
+static uintptr_t sim_mb_vaddr_start(const SIM_MB_S *pstMb) {
+    return reinterpret_cast<uintptr_t>(pstMb->pu8VirAddr);
+}
+
+static RK_U64 sim_mb_paddr_start(const SIM_MB_S *pstMb) {
+    return pstMb->u64PhyAddr;
+}
+
+RK_S32 SIM_MB_Map(SIM_MB_S *pstMb) {
+    SIM_MB_REGISTRY_S *pstRegistry = sim_mb_registry();
+    RK_U64 u64MapSize = (pstMb->u64Size + SIM_MB_PAGE_SIZE - 1) & ~((RK_U64)SIM_MB_PAGE_SIZE - 1);
+    RK_S32 s32Fd = -1;
+    RK_VOID *pVirAddr = MAP_FAILED;
+
+    if (pstMb->bShared) {
+        s32Fd = syscall(__NR_memfd_create, "rk_mb_sim", MFD_CLOEXEC);
+        if (s32Fd < 0 || ftruncate(s32Fd, u64MapSize) != 0) {
+            RK_LOGW("memfd for %llu bytes failed, fall back to anonymous memory",
+                    (unsigned long long)pstMb->u64Size);
+            if (s32Fd >= 0) {
+                close(s32Fd);
+            }
+            s32Fd = -1;
+        }
+    }
+    if (s32Fd >= 0) {
+        pVirAddr = mmap(RK_NULL, u64MapSize, PROT_READ | PROT_WRITE, MAP_SHARED, s32Fd, 0);
+    } else {
+        pVirAddr = mmap(RK_NULL, u64MapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (pVirAddr == MAP_FAILED) {
+        RK_LOGE("map %llu bytes failed", (unsigned long long)u64MapSize);
+        if (s32Fd >= 0) {
+            close(s32Fd);
+        }
+        return RK_ERR_MB_NOMEM;
+    }
+
+    pstMb->pu8VirAddr  = reinterpret_cast<RK_U8 *>(pVirAddr);
+    pstMb->s32Fd       = s32Fd;
+    pstMb->u64MapSize  = u64MapSize;
+
+    pthread_mutex_lock(&pstRegistry->mutex);
+    pstMb->u64PhyAddr  = pstRegistry->u64NextPhyAddr;
+    pstMb->s32UniqueId = pstRegistry->s32NextUniqueId++;
+    pstRegistry->u64NextPhyAddr += u64MapSize + SIM_MB_PAGE_SIZE;
+    pstRegistry->vaddr[sim_mb_vaddr_start(pstMb)] = pstMb;
+    pstRegistry->paddr[pstMb->u64PhyAddr] = pstMb;
+    pstRegistry->uid[pstMb->s32UniqueId] = pstMb;
+    if (s32Fd >= 0) {
+        pstRegistry->fd[s32Fd] = pstMb;
+    }
+    pstRegistry->stStat.u64AllocCnt++;
+    pstRegistry->stStat.u64LiveBytes += u64MapSize;
+    if (pstRegistry->stStat.u64LiveBytes > pstRegistry->stStat.u64PeakBytes) {
+        pstRegistry->stStat.u64PeakBytes = pstRegistry->stStat.u64LiveBytes;
+    }
+    pthread_mutex_unlock(&pstRegistry->mutex);
+    return RK_SUCCESS;
+}
+
+RK_VOID SIM_MB_Unmap(SIM_MB_S *pstMb) {
+    SIM_MB_REGISTRY_S *pstRegistry = sim_mb_registry();
+
+    if (pstMb->pu8VirAddr == RK_NULL) {
+        return;
+    }
+    pthread_mutex_lock(&pstRegistry->mutex);
+    pstRegistry->vaddr.erase(sim_mb_vaddr_start(pstMb));
+    pstRegistry->paddr.erase(pstMb->u64PhyAddr);
+    pstRegistry->uid.erase(pstMb->s32UniqueId);
+    if (pstMb->s32Fd >= 0) {
+        pstRegistry->fd.erase(pstMb->s32Fd);
+    }
+    pstRegistry->stStat.u64FreeCnt++;
+    pstRegistry->stStat.u64LiveBytes -= pstMb->u64MapSize;
+    pthread_mutex_unlock(&pstRegistry->mutex);
+
+    munmap(pstMb->pu8VirAddr, pstMb->u64MapSize);
+    if (pstMb->s32Fd >= 0) {
+        close(pstMb->s32Fd);
+    }
+    pstMb->pu8VirAddr = RK_NULL;
+    pstMb->s32Fd = -1;
+    pstMb->u64PhyAddr = 0;
+    pstMb->s32UniqueId = -1;
+}
+
+SIM_MB_S *SIM_MB_Alloc(RK_U64 u64Size, RK_BOOL bShared, RK_BOOL bCached, MB_POOL pool) {
+    if (u64Size == 0) {
+        return RK_NULL;
+    }
+    SIM_MB_S *pstMb = new SIM_MB_S;
+    memset(pstMb, 0, sizeof(SIM_MB_S));
+    pstMb->u32Magic    = SIM_MB_MAGIC;
+    pstMb->pool        = pool;
+    pstMb->u64Size     = u64Size;
+    pstMb->bShared     = bShared;
+    pstMb->bCached     = bCached;
+    if (SIM_MB_Map(pstMb) != RK_SUCCESS) {
+        delete pstMb;
+        return RK_NULL;
+    }
+    return pstMb;
+}
+
+RK_VOID SIM_MB_Free(SIM_MB_S *pstMb) {
+    if (pstMb == RK_NULL) {
+        return;
+    }
+    SIM_MB_Unmap(pstMb);
+    pstMb->u32Magic = 0;
+    delete pstMb;
+}
+
+SIM_MB_S *SIM_MB_FromHandle(MB_BLK mb) {
+    SIM_MB_S *pstMb = reinterpret_cast<SIM_MB_S *>(mb);
+    if (pstMb == RK_NULL || pstMb->u32Magic != SIM_MB_MAGIC) {
+        return RK_NULL;
+    }
+    return pstMb;
+}
+
+SIM_MB_S *SIM_MB_FindVirAddr(const RK_VOID *pVirAddr) {
+    SIM_MB_REGISTRY_S *pstRegistry = sim_mb_registry();
+    pthread_mutex_lock(&pstRegistry->mutex);
+    SIM_MB_S *pstMb = sim_mb_find_range<uintptr_t>(pstRegistry->vaddr,
+                            reinterpret_cast<uintptr_t>(pVirAddr), sim_mb_vaddr_start);
+    pthread_mutex_unlock(&pstRegistry->mutex);
+    return pstMb;
+}
+
+SIM_MB_S *SIM_MB_FindPhyAddr(RK_U64 u64PhyAddr) {
+    SIM_MB_REGISTRY_S *pstRegistry = sim_mb_registry();
+    pthread_mutex_lock(&pstRegistry->mutex);
+    SIM_MB_S *pstMb = sim_mb_find_range<RK_U64>(pstRegistry->paddr, u64PhyAddr, sim_mb_paddr_start);
+    pthread_mutex_unlock(&pstRegistry->mutex);
+    return pstMb;
+}
+
+SIM_MB_S *SIM_MB_FindFd(RK_S32 s32Fd) {
+    SIM_MB_REGISTRY_S *pstRegistry = sim_mb_registry();
+    SIM_MB_S *pstMb = RK_NULL;
+    pthread_mutex_lock(&pstRegistry->mutex);
+    std::map<RK_S32, SIM_MB_S *>::iterator it = pstRegistry->fd.find(s32Fd);
+    if (it != pstRegistry->fd.end()) {
+        pstMb = it->second;
+    }
+    pthread_mutex_unlock(&pstRegistry->mutex);
+    return pstMb;
+}
+
+SIM_MB_S *SIM_MB_FindUniqueId(RK_S32 s32UniqueId) {
+    SIM_MB_REGISTRY_S *pstRegistry = sim_mb_registry();
+    SIM_MB_S *pstMb = RK_NULL;
+    pthread_mutex_lock(&pstRegistry->mutex);
+    std::map<RK_S32, SIM_MB_S *>::iterator it = pstRegistry->uid.find(s32UniqueId);
+    if (it != pstRegistry->uid.end()) {
+        pstMb = it->second;
+    }
+    pthread_mutex_unlock(&pstRegistry->mutex);
+    return pstMb;
+}
+
+RK_S32 SIM_MB_Flush(SIM_MB_S *pstMb, RK_U64 u64Offset, RK_U64 u64Length) {
+    SIM_MB_REGISTRY_S *pstRegistry = sim_mb_registry();
+
+    if (pstMb == RK_NULL) {
+        return RK_ERR_MB_NULL_PTR;
+    }
+    if (u64Offset > pstMb->u64Size) {
+        return RK_ERR_MB_ILLEGAL_PARAM;
+    }
+    if (u64Length == 0 || u64Length > pstMb->u64Size - u64Offset) {
+        u64Length = pstMb->u64Size - u64Offset;
+    }
+    /* host caches are coherent, only order the cpu accesses around the sync */
+    __sync_synchronize();
+    __atomic_add_fetch(&pstRegistry->stStat.u64FlushCnt, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&pstRegistry->stStat.u64FlushBytes, u64Length, __ATOMIC_RELAXED);
+    return RK_SUCCESS;
+}
+
+RK_S32 SIM_MB_Put(SIM_MB_S *pstMb) {
+    if (pstMb == RK_NULL) {
+        return RK_ERR_MB_NULL_PTR;
+    }
+    RK_S32 s32UserCnt = __atomic_sub_fetch(&pstMb->s32UserCnt, 1, __ATOMIC_ACQ_REL);
+    if (s32UserCnt > 0) {
+        return RK_SUCCESS;
+    }
+    if (s32UserCnt < 0) {
+        RK_LOGE("mb %p released more often than referenced", pstMb);
+        return RK_ERR_MB_NOT_PERM;
+    }
+    if (pstMb->pool != MB_INVALID_POOLID) {
+        SIM_MB_PoolPut(pstMb);
+    } else {
+        SIM_MB_Free(pstMb);
+    }
+    return RK_SUCCESS;
+}
+
+RK_VOID SIM_MB_GetStat(SIM_MB_STAT_S *pstStat) {
+    SIM_MB_REGISTRY_S *pstRegistry = sim_mb_registry();
+    pthread_mutex_lock(&pstRegistry->mutex);
+    *pstStat = pstRegistry->stStat;
+    pthread_mutex_unlock(&pstRegistry->mutex);
+    pstStat->u64FlushCnt = __atomic_load_n(&pstRegistry->stStat.u64FlushCnt, __ATOMIC_RELAXED);
+    pstStat->u64FlushBytes = __atomic_load_n(&pstRegistry->stStat.u64FlushBytes, __ATOMIC_RELAXED);
+}
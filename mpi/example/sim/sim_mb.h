@@ -0,0 +1,91 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TESTS_RT_MPI_SIM_SIM_MB_H_
+#define SRC_TESTS_RT_MPI_SIM_SIM_MB_H_
+
+#include "rk_comm_mb.h"
+
+/*
+ * software MB backend, see CMakeLists.txt (USE_ROCKIT_MB_SIM).
+ *
+ * every block is plain memory: DMA blocks are memfd backed and mapped
+ * shared so Handle2Fd()/UniqueId2Fd() return a real, mmap-able fd, malloc
+ * blocks are anonymous mappings without fd. physical addresses are
+ * synthetic but unique and page aligned, so PhyAddr2Handle() and the
+ * paddr flush calls resolve like on the device. cache maintenance has no
+ * work to do on a coherent host, it is range checked and counted.
+ */
+
+#define SIM_MB_MAGIC                0x53494d42  /* "SIMB" */
+#define SIM_MB_MAX_POOLS            256
+#define SIM_MB_PAGE_SIZE            4096
+
+typedef struct _rkSIM_MB_S {
+    RK_U32          u32Magic;
+    MB_POOL         pool;           /* MB_INVALID_POOLID: mmz or standalone block */
+    RK_U8          *pu8VirAddr;
+    RK_U64          u64PhyAddr;
+    RK_S32          s32Fd;
+    RK_S32          s32UniqueId;
+    RK_U64          u64Size;
+    RK_U64          u64MapSize;
+    RK_U32          u32Offset;
+    RK_U32          u32HorStride;
+    RK_U32          u32VerStride;
+    RK_BOOL         bShared;
+    RK_BOOL         bCached;
+    RK_S32          s32UserCnt;     /* atomic */
+    RK_U32          u32Index;       /* slot in its pool */
+    RK_U32          u32NextFree;    /* pool free list link, index + 1 */
+    struct _rkSIM_MB_S *pNext;
+} SIM_MB_S;
+
+typedef struct _rkSIM_MB_STAT_S {
+    RK_U64          u64AllocCnt;
+    RK_U64          u64FreeCnt;
+    RK_U64          u64LiveBytes;
+    RK_U64          u64PeakBytes;
+    RK_U64          u64FlushCnt;
+    RK_U64          u64FlushBytes;
+} SIM_MB_STAT_S;
+
+/* memory of one block, bShared gives a memfd backed shared mapping. */
+SIM_MB_S *SIM_MB_Alloc(RK_U64 u64Size, RK_BOOL bShared, RK_BOOL bCached, MB_POOL pool);
+RK_VOID   SIM_MB_Free(SIM_MB_S *pstMb);
+
+/* memory of a block without its descriptor, the handle stays valid. */
+RK_S32    SIM_MB_Map(SIM_MB_S *pstMb);
+RK_VOID   SIM_MB_Unmap(SIM_MB_S *pstMb);
+
+/* RK_NULL for anything that is not a live block of this backend. */
+SIM_MB_S *SIM_MB_FromHandle(MB_BLK mb);
+SIM_MB_S *SIM_MB_FindVirAddr(const RK_VOID *pVirAddr);
+SIM_MB_S *SIM_MB_FindPhyAddr(RK_U64 u64PhyAddr);
+SIM_MB_S *SIM_MB_FindFd(RK_S32 s32Fd);
+SIM_MB_S *SIM_MB_FindUniqueId(RK_S32 s32UniqueId);
+
+/* u64Length 0 means up to the end of the block. */
+RK_S32    SIM_MB_Flush(SIM_MB_S *pstMb, RK_U64 u64Offset, RK_U64 u64Length);
+
+/* drops one user, a pool block goes back to its pool, others are freed. */
+RK_S32    SIM_MB_Put(SIM_MB_S *pstMb);
+RK_VOID   SIM_MB_PoolPut(SIM_MB_S *pstMb);
+
+RK_VOID   SIM_MB_GetStat(SIM_MB_STAT_S *pstStat);
+RK_S32    SIM_MB_DumpPools(RK_CHAR *pBuf, RK_U32 u32Size);
+
+#endif  // SRC_TESTS_RT_MPI_SIM_SIM_MB_H_
@@ -0,0 +1,773 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef DBG_MOD_ID
+#undef DBG_MOD_ID
+#endif
+#define DBG_MOD_ID DBG_MOD_COMB1(RK_ID_MB)
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rk_debug.h"
+#include "rk_mpi_mb.h"
+#include "sim_mb.h"
+
+/*
+ * every pool keeps its idle blocks on a free list under its own mutex,
+ * so pools do not contend with each other; gMbLock is left for pool
+ * create/destroy, the dump and the trim thread, and is always taken
+ * before a pool lock. a GetMB that finds the lock taken counts as
+ * contended in dumpsys mb.
+ *
+ * destroying a pool while other threads still get from it is not
+ * supported, blocks in use at destroy time are freed on release.
+ *
+ * adaptive mode, rk_mb_sim_idle_ms=<ms>: pools ignore bPreAlloc and map
+ * blocks on demand up to u32MBCnt, a trim thread unmaps the idle blocks
+ * above the high-water mark of the last <ms>. the descriptor of an
+ * unmapped block waits on a second list to be mapped again.
+ *
+ * every pool tracks its high-water mark and largest request; dumpsys mb
+ * prints an MB_CONFIG_S sized from them, and rk_mb_sim_profile=<file>
+ * writes it at RK_MPI_MB_Exit() as the result of a profiling run.
+ */
+#define SIM_MB_WAIT_US              10000
+#define SIM_MB_MAX_PROFILES         64
+#define SIM_MB_PROFILE_BUF_SIZE     (16 * 1024)
+
+typedef struct _rkSIM_MB_POOL_S {
+    RK_BOOL             bUsed;
+    RK_BOOL             bDestroying;
+    RK_BOOL             bCommon;
+    MB_POOL_CONFIG_S    stConfig;
+    pthread_mutex_t     lock;           /* guards everything below */
+    pthread_cond_t      cond;
+    RK_U32              u32Total;       /* blocks mapped, in use or idle */
+    RK_U32              u32NextIndex;   /* descriptors created */
+    SIM_MB_S          **ppstBlocks;
+    RK_U32              u32FreeHead;    /* index + 1, 0 is empty */
+    RK_U32              u32UnmappedHead;/* descriptors without memory, same format */
+    RK_S32              s32Waiters;
+    RK_U64              u64GetCnt;
+    RK_U64              u64ContendCnt;  /* gets that found the lock taken */
+    RK_U64              u64WaitCnt;
+    RK_U64              u64FailCnt;
+    RK_BOOL             bAdaptive;
+    RK_U32              u32InUse;
+    RK_U32              u32HighWater;
+    RK_U32              u32WindowHigh;  /* high-water since the last trim */
+    RK_U64              u64MaxReqSize;
+    RK_U64              u64TrimCnt;
+} SIM_MB_POOL_S;
+
+/* what a pool needed, kept after it is destroyed. */
+typedef struct _rkSIM_MB_PROFILE_S {
+    RK_BOOL             bCommon;
+    RK_U64              u64MBSize;
+    RK_U32              u32MBCnt;
+    RK_U32              u32HighWater;
+    RK_U64              u64MaxReqSize;
+} SIM_MB_PROFILE_S;
+
+static pthread_mutex_t  gMbLock = PTHREAD_MUTEX_INITIALIZER;
+static SIM_MB_POOL_S    gMbPools[SIM_MB_MAX_POOLS];
+static MB_CONFIG_S      gMbConfig;
+static MB_CONFIG_S      gMbModConfig[MB_UID_BUTT];
+static RK_BOOL          gMbInited = RK_FALSE;
+static RK_U32           gMbIdleMs = 0;
+static SIM_MB_PROFILE_S gMbProfiles[SIM_MB_MAX_PROFILES];
+static RK_U32           gMbProfileCnt = 0;
+
+static void *sim_mb_trim_proc(void *pArgs);
+static RK_S32 sim_mb_recommend(RK_CHAR *pBuf, RK_U32 u32Size);
+
+static void sim_mb_pools_init() {
+    const char *env = getenv("rk_mb_sim_idle_ms");
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    for (RK_U32 i = 0; i < SIM_MB_MAX_POOLS; i++) {
+        pthread_mutex_init(&gMbPools[i].lock, RK_NULL);
+        pthread_cond_init(&gMbPools[i].cond, &attr);
+    }
+    pthread_condattr_destroy(&attr);
+
+    gMbIdleMs = (env != RK_NULL) ? atoi(env) : 0;
+    if (gMbIdleMs > 0) {
+        pthread_t thread;
+        if (pthread_create(&thread, RK_NULL, sim_mb_trim_proc, RK_NULL) == 0) {
+            pthread_detach(thread);
+        } else {
+            gMbIdleMs = 0;
+        }
+    }
+}
+
+static SIM_MB_POOL_S *sim_mb_pool(MB_POOL pool) {
+    if (pool >= SIM_MB_MAX_POOLS || !__atomic_load_n(&gMbPools[pool].bUsed, __ATOMIC_ACQUIRE)
+            || __atomic_load_n(&gMbPools[pool].bDestroying, __ATOMIC_ACQUIRE)) {
+        return RK_NULL;
+    }
+    return &gMbPools[pool];
+}
+
+/* merges pools of the same kind and size, called with gMbLock held. */
+static void sim_mb_profile_merge(SIM_MB_PROFILE_S *pstProfiles, RK_U32 *pu32Cnt,
+                                 const SIM_MB_POOL_S *pstPool) {
+    SIM_MB_PROFILE_S *pstProfile = RK_NULL;
+    for (RK_U32 i = 0; i < *pu32Cnt; i++) {
+        if (pstProfiles[i].bCommon == pstPool->bCommon
+                && pstProfiles[i].u64MBSize == pstPool->stConfig.u64MBSize) {
+            pstProfile = &pstProfiles[i];
+            break;
+        }
+    }
+    if (pstProfile == RK_NULL) {
+        if (*pu32Cnt >= SIM_MB_MAX_PROFILES) {
+            return;
+        }
+        pstProfile = &pstProfiles[(*pu32Cnt)++];
+        memset(pstProfile, 0, sizeof(SIM_MB_PROFILE_S));
+        pstProfile->bCommon = pstPool->bCommon;
+        pstProfile->u64MBSize = pstPool->stConfig.u64MBSize;
+    }
+    if (pstPool->stConfig.u32MBCnt > pstProfile->u32MBCnt) {
+        pstProfile->u32MBCnt = pstPool->stConfig.u32MBCnt;
+    }
+    if (pstPool->u32HighWater > pstProfile->u32HighWater) {
+        pstProfile->u32HighWater = pstPool->u32HighWater;
+    }
+    if (pstPool->u64MaxReqSize > pstProfile->u64MaxReqSize) {
+        pstProfile->u64MaxReqSize = pstPool->u64MaxReqSize;
+    }
+}
+
+/*
+ * called with gMbLock held once no block of the pool is mapped any more,
+ * the lock and the condition stay valid for later pools.
+ */
+static void sim_mb_pool_release(SIM_MB_POOL_S *pstPool) {
+    sim_mb_profile_merge(gMbProfiles, &gMbProfileCnt, pstPool);
+    for (RK_U32 i = 0; i < pstPool->u32NextIndex; i++) {
+        SIM_MB_Free(pstPool->ppstBlocks[i]);
+    }
+    delete[] pstPool->ppstBlocks;
+    __atomic_store_n(&pstPool->bUsed, RK_FALSE, __ATOMIC_RELEASE);
+    __atomic_store_n(&pstPool->bDestroying, RK_FALSE, __ATOMIC_RELAXED);
+    pstPool->bCommon = RK_FALSE;
+    memset(&pstPool->stConfig, 0, sizeof(MB_POOL_CONFIG_S));
+    pstPool->u32Total = 0;
+    pstPool->u32NextIndex = 0;
+    pstPool->ppstBlocks = RK_NULL;
+    pstPool->u32FreeHead = 0;
+    pstPool->u32UnmappedHead = 0;
+    pstPool->s32Waiters = 0;
+    pstPool->u64GetCnt = 0;
+    pstPool->u64ContendCnt = 0;
+    pstPool->u64WaitCnt = 0;
+    pstPool->u64FailCnt = 0;
+    pstPool->bAdaptive = RK_FALSE;
+    pstPool->u32InUse = 0;
+    pstPool->u32HighWater = 0;
+    pstPool->u32WindowHigh = 0;
+    pstPool->u64MaxReqSize = 0;
+    pstPool->u64TrimCnt = 0;
+}
+
+/* the list helpers below are called with the pool lock held. */
+static SIM_MB_S *sim_mb_list_pop(SIM_MB_POOL_S *pstPool, RK_U32 *pu32Head) {
+    if (*pu32Head == 0) {
+        return RK_NULL;
+    }
+    SIM_MB_S *pstMb = pstPool->ppstBlocks[*pu32Head - 1];
+    *pu32Head = pstMb->u32NextFree;
+    return pstMb;
+}
+
+static void sim_mb_list_push(RK_U32 *pu32Head, SIM_MB_S *pstMb) {
+    pstMb->u32NextFree = *pu32Head;
+    *pu32Head = pstMb->u32Index + 1;
+}
+
+/* descriptor for a new slot of the pool, memory is mapped separately. */
+static SIM_MB_S *sim_mb_new_block(MB_POOL pool, const SIM_MB_POOL_S *pstPool, RK_U32 u32Index) {
+    SIM_MB_S *pstMb = new SIM_MB_S;
+    memset(pstMb, 0, sizeof(SIM_MB_S));
+    pstMb->u32Magic    = SIM_MB_MAGIC;
+    pstMb->pool        = pool;
+    pstMb->s32Fd       = -1;
+    pstMb->s32UniqueId = -1;
+    pstMb->u64Size     = pstPool->stConfig.u64MBSize;
+    pstMb->bShared     = (RK_BOOL)(pstPool->stConfig.enAllocType != MB_ALLOC_TYPE_MALLOC);
+    pstMb->bCached     = (RK_BOOL)(pstPool->stConfig.enRemapMode == MB_REMAP_MODE_CACHED);
+    pstMb->u32Index    = u32Index;
+    return pstMb;
+}
+
+/*
+ * maps one more block while the pool is below its count, reusing the
+ * descriptor of a trimmed block when there is one.
+ */
+static SIM_MB_S *sim_mb_grow(MB_POOL pool, SIM_MB_POOL_S *pstPool) {
+    if (pstPool->u32Total >= pstPool->stConfig.u32MBCnt) {
+        return RK_NULL;
+    }
+    SIM_MB_S *pstMb = sim_mb_list_pop(pstPool, &pstPool->u32UnmappedHead);
+    if (pstMb == RK_NULL) {
+        pstMb = sim_mb_new_block(pool, pstPool, pstPool->u32NextIndex);
+        pstPool->ppstBlocks[pstPool->u32NextIndex++] = pstMb;
+    }
+    if (SIM_MB_Map(pstMb) != RK_SUCCESS) {
+        sim_mb_list_push(&pstPool->u32UnmappedHead, pstMb);
+        return RK_NULL;
+    }
+    pstPool->u32Total++;
+    return pstMb;
+}
+
+/* unmaps the idle blocks above what the pool needed since the last trim. */
+static void sim_mb_trim(SIM_MB_POOL_S *pstPool) {
+    RK_U32 u32Keep = pstPool->u32WindowHigh;
+    if (u32Keep < pstPool->u32InUse) {
+        u32Keep = pstPool->u32InUse;
+    }
+    pstPool->u32WindowHigh = pstPool->u32InUse;
+    while (pstPool->u32Total > u32Keep) {
+        SIM_MB_S *pstMb = sim_mb_list_pop(pstPool, &pstPool->u32FreeHead);
+        if (pstMb == RK_NULL) {
+            break;
+        }
+        SIM_MB_Unmap(pstMb);
+        sim_mb_list_push(&pstPool->u32UnmappedHead, pstMb);
+        pstPool->u32Total--;
+        pstPool->u64TrimCnt++;
+    }
+}
+
+static void *sim_mb_trim_proc(void *pArgs) {
+    (void)pArgs;
+    while (1) {
+        usleep(gMbIdleMs * 1000);
+        pthread_mutex_lock(&gMbLock);
+        for (RK_U32 i = 0; i < SIM_MB_MAX_POOLS; i++) {
+            SIM_MB_POOL_S *pstPool = &gMbPools[i];
+            if (pstPool->bUsed && !pstPool->bDestroying && pstPool->bAdaptive) {
+                pthread_mutex_lock(&pstPool->lock);
+                sim_mb_trim(pstPool);
+                pthread_mutex_unlock(&pstPool->lock);
+            }
+        }
+        pthread_mutex_unlock(&gMbLock);
+    }
+    return RK_NULL;
+}
+
+static MB_POOL sim_mb_create_pool(const MB_POOL_CONFIG_S *pstMbPoolCfg, RK_BOOL bCommon) {
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    MB_POOL pool = MB_INVALID_POOLID;
+    SIM_MB_S **ppstBlocks = RK_NULL;
+
+    pthread_once(&once, sim_mb_pools_init);
+    if (pstMbPoolCfg == RK_NULL || pstMbPoolCfg->u64MBSize == 0 || pstMbPoolCfg->u32MBCnt == 0) {
+        RK_LOGE("illegal pool config");
+        return MB_INVALID_POOLID;
+    }
+    ppstBlocks = new SIM_MB_S *[pstMbPoolCfg->u32MBCnt]();
+
+    pthread_mutex_lock(&gMbLock);
+    for (RK_U32 i = 0; i < SIM_MB_MAX_POOLS; i++) {
+        if (!gMbPools[i].bUsed) {
+            SIM_MB_POOL_S *pstPool = &gMbPools[i];
+            pstPool->bCommon = bCommon;
+            pstPool->stConfig = *pstMbPoolCfg;
+            pstPool->ppstBlocks = ppstBlocks;
+            pstPool->bAdaptive = (RK_BOOL)(gMbIdleMs > 0);
+            __atomic_store_n(&pstPool->bUsed, RK_TRUE, __ATOMIC_RELEASE);
+            pool = i;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&gMbLock);
+    if (pool == MB_INVALID_POOLID) {
+        RK_LOGE("no free pool slot, max %d", SIM_MB_MAX_POOLS);
+        delete[] ppstBlocks;
+        return MB_INVALID_POOLID;
+    }
+
+    if (pstMbPoolCfg->bPreAlloc && !gMbPools[pool].bAdaptive) {
+        SIM_MB_POOL_S *pstPool = &gMbPools[pool];
+        pthread_mutex_lock(&pstPool->lock);
+        for (RK_U32 i = 0; i < pstMbPoolCfg->u32MBCnt; i++) {
+            SIM_MB_S *pstMb = sim_mb_grow(pool, pstPool);
+            if (pstMb == RK_NULL) {
+                pthread_mutex_unlock(&pstPool->lock);
+                RK_MPI_MB_DestroyPool(pool);
+                return MB_INVALID_POOLID;
+            }
+            sim_mb_list_push(&pstPool->u32FreeHead, pstMb);
+        }
+        pthread_mutex_unlock(&pstPool->lock);
+    }
+    return pool;
+}
+
+MB_POOL RK_MPI_MB_CreatePool(MB_POOL_CONFIG_S *pstMbPoolCfg) {
+    return sim_mb_create_pool(pstMbPoolCfg, RK_FALSE);
+}
+
+RK_S32 RK_MPI_MB_DestroyPool(MB_POOL pool) {
+    pthread_mutex_lock(&gMbLock);
+    SIM_MB_POOL_S *pstPool = sim_mb_pool(pool);
+    if (pstPool == RK_NULL) {
+        pthread_mutex_unlock(&gMbLock);
+        return RK_ERR_MB_UNEXIST;
+    }
+    pthread_mutex_lock(&pstPool->lock);
+    __atomic_store_n(&pstPool->bDestroying, RK_TRUE, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&pstPool->cond);
+    /* blocks still in use are unmapped when their last user releases them. */
+    SIM_MB_S *pstMb = RK_NULL;
+    while ((pstMb = sim_mb_list_pop(pstPool, &pstPool->u32FreeHead)) != RK_NULL) {
+        SIM_MB_Unmap(pstMb);
+        pstPool->u32Total--;
+    }
+    RK_BOOL bRelease = (RK_BOOL)(pstPool->u32Total == 0);
+    pthread_mutex_unlock(&pstPool->lock);
+    if (bRelease) {
+        sim_mb_pool_release(pstPool);
+    }
+    pthread_mutex_unlock(&gMbLock);
+    return RK_SUCCESS;
+}
+
+RK_VOID SIM_MB_PoolPut(SIM_MB_S *pstMb) {
+    SIM_MB_POOL_S *pstPool = &gMbPools[pstMb->pool];
+    RK_BOOL bRelease = RK_FALSE;
+
+    pthread_mutex_lock(&pstPool->lock);
+    pstPool->u32InUse--;
+    if (pstPool->bDestroying) {
+        /* the destroy saw this block in use and left the release to us */
+        SIM_MB_Unmap(pstMb);
+        bRelease = (RK_BOOL)(--pstPool->u32Total == 0);
+    } else {
+        sim_mb_list_push(&pstPool->u32FreeHead, pstMb);
+        if (pstPool->s32Waiters > 0) {
+            pthread_cond_signal(&pstPool->cond);
+        }
+    }
+    pthread_mutex_unlock(&pstPool->lock);
+    if (bRelease) {
+        pthread_mutex_lock(&gMbLock);
+        sim_mb_pool_release(pstPool);
+        pthread_mutex_unlock(&gMbLock);
+    }
+}
+
+/* smallest common pool that fits u64Size. */
+static MB_POOL sim_mb_common_pool(RK_U64 u64Size) {
+    MB_POOL pool = MB_INVALID_POOLID;
+    pthread_mutex_lock(&gMbLock);
+    for (RK_U32 i = 0; i < SIM_MB_MAX_POOLS; i++) {
+        const SIM_MB_POOL_S *pstPool = &gMbPools[i];
+        if (!pstPool->bUsed || pstPool->bDestroying || !pstPool->bCommon
+                || pstPool->stConfig.u64MBSize < u64Size) {
+            continue;
+        }
+        if (pool == MB_INVALID_POOLID || pstPool->stConfig.u64MBSize < gMbPools[pool].stConfig.u64MBSize) {
+            pool = i;
+        }
+    }
+    pthread_mutex_unlock(&gMbLock);
+    return pool;
+}
+
+/* called with the pool lock held, gives up once the pool is destroyed. */
+static SIM_MB_S *sim_mb_wait(SIM_MB_POOL_S *pstPool) {
+    SIM_MB_S *pstMb = RK_NULL;
+    struct timespec stTimeout;
+
+    pstPool->s32Waiters++;
+    pstPool->u64WaitCnt++;
+    while (!pstPool->bDestroying) {
+        pstMb = sim_mb_list_pop(pstPool, &pstPool->u32FreeHead);
+        if (pstMb != RK_NULL) {
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &stTimeout);
+        stTimeout.tv_nsec += SIM_MB_WAIT_US * 1000;
+        if (stTimeout.tv_nsec >= 1000000000) {
+            stTimeout.tv_sec++;
+            stTimeout.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&pstPool->cond, &pstPool->lock, &stTimeout);
+    }
+    pstPool->s32Waiters--;
+    return pstMb;
+}
+
+MB_BLK RK_MPI_MB_GetMB(MB_POOL pool, RK_U64 u64Size, RK_BOOL block) {
+    if (pool == MB_INVALID_POOLID) {
+        pool = sim_mb_common_pool(u64Size);
+    }
+    SIM_MB_POOL_S *pstPool = sim_mb_pool(pool);
+    if (pstPool == RK_NULL) {
+        RK_LOGE("pool %d does not exist", pool);
+        return MB_INVALID_HANDLE;
+    }
+
+    RK_BOOL bContended = (RK_BOOL)(pthread_mutex_trylock(&pstPool->lock) != 0);
+    if (bContended) {
+        pthread_mutex_lock(&pstPool->lock);
+        pstPool->u64ContendCnt++;
+    }
+    pstPool->u64GetCnt++;
+    if (u64Size > pstPool->stConfig.u64MBSize) {
+        pstPool->u64FailCnt++;
+        pthread_mutex_unlock(&pstPool->lock);
+        RK_LOGE("size %llu is larger than the blocks of pool %d", (unsigned long long)u64Size, pool);
+        return MB_INVALID_HANDLE;
+    }
+    SIM_MB_S *pstMb = RK_NULL;
+    if (!pstPool->bDestroying) {
+        pstMb = sim_mb_list_pop(pstPool, &pstPool->u32FreeHead);
+        if (pstMb == RK_NULL) {
+            pstMb = sim_mb_grow(pool, pstPool);
+        }
+        if (pstMb == RK_NULL && block) {
+            pstMb = sim_mb_wait(pstPool);
+        }
+    }
+    if (pstMb == RK_NULL) {
+        pstPool->u64FailCnt++;
+        pthread_mutex_unlock(&pstPool->lock);
+        return MB_INVALID_HANDLE;
+    }
+    pstPool->u32InUse++;
+    if (pstPool->u32InUse > pstPool->u32HighWater) {
+        pstPool->u32HighWater = pstPool->u32InUse;
+    }
+    if (pstPool->u32InUse > pstPool->u32WindowHigh) {
+        pstPool->u32WindowHigh = pstPool->u32InUse;
+    }
+    if (u64Size > pstPool->u64MaxReqSize) {
+        pstPool->u64MaxReqSize = u64Size;
+    }
+    pthread_mutex_unlock(&pstPool->lock);
+
+    pstMb->u32Offset = 0;
+    pstMb->u32HorStride = 0;
+    pstMb->u32VerStride = 0;
+    __atomic_store_n(&pstMb->s32UserCnt, 1, __ATOMIC_RELEASE);
+    return pstMb;
+}
+
+RK_S32 RK_MPI_MB_ReleaseMB(MB_BLK mb) {
+    return SIM_MB_Put(SIM_MB_FromHandle(mb));
+}
+
+RK_U64 RK_MPI_MB_Handle2PhysAddr(MB_BLK mb) {
+    SIM_MB_S *pstMb = SIM_MB_FromHandle(mb);
+    return (pstMb != RK_NULL) ? pstMb->u64PhyAddr : 0;
+}
+
+RK_VOID *RK_MPI_MB_Handle2VirAddr(MB_BLK mb) {
+    SIM_MB_S *pstMb = SIM_MB_FromHandle(mb);
+    return (pstMb != RK_NULL) ? pstMb->pu8VirAddr : RK_NULL;
+}
+
+RK_S32 RK_MPI_MB_Handle2Fd(MB_BLK mb) {
+    SIM_MB_S *pstMb = SIM_MB_FromHandle(mb);
+    return (pstMb != RK_NULL) ? pstMb->s32Fd : -1;
+}
+
+MB_POOL RK_MPI_MB_Handle2PoolId(MB_BLK mb) {
+    SIM_MB_S *pstMb = SIM_MB_FromHandle(mb);
+    return (pstMb != RK_NULL) ? pstMb->pool : MB_INVALID_POOLID;
+}
+
+RK_S32 RK_MPI_MB_Handle2UniqueId(MB_BLK mb) {
+    SIM_MB_S *pstMb = SIM_MB_FromHandle(mb);
+    return (pstMb != RK_NULL) ? pstMb->s32UniqueId : -1;
+}
+
+RK_U64 RK_MPI_MB_GetSize(MB_BLK mb) {
+    SIM_MB_S *pstMb = SIM_MB_FromHandle(mb);
+    return (pstMb != RK_NULL) ? pstMb->u64Size : 0;
+}
+
+/* valid bytes behind the offset, the backend keeps no separate length. */
+RK_U64 RK_MPI_MB_GetLength(MB_BLK mb) {
+    SIM_MB_S *pstMb = SIM_MB_FromHandle(mb);
+    return (pstMb != RK_NULL) ? pstMb->u64Size - pstMb->u32Offset : 0;
+}
+
+RK_U32 RK_MPI_MB_GetOffset(MB_BLK mb) {
+    SIM_MB_S *pstMb = SIM_MB_FromHandle(mb);
+    return (pstMb != RK_NULL) ? pstMb->u32Offset : 0;
+}
+
+RK_S32 RK_MPI_MB_SetOffset(MB_BLK mb, RK_U32 u32Offset) {
+    SIM_MB_S *pstMb = SIM_MB_FromHandle(mb);
+    if (pstMb == RK_NULL) {
+        return RK_ERR_MB_NULL_PTR;
+    }
+    if (u32Offset > pstMb->u64Size) {
+        return RK_ERR_MB_ILLEGAL_PARAM;
+    }
+    pstMb->u32Offset = u32Offset;
+    return RK_SUCCESS;
+}
+
+MB_BLK RK_MPI_MB_VirAddr2Handle(RK_VOID *pstVirAddr) {
+    return SIM_MB_FindVirAddr(pstVirAddr);
+}
+
+/* the caller owns the returned fd. */
+RK_S32 RK_MPI_MB_UniqueId2Fd(RK_S32 s32UniqueId) {
+    SIM_MB_S *pstMb = SIM_MB_FindUniqueId(s32UniqueId);
+    if (pstMb == RK_NULL || pstMb->s32Fd < 0) {
+        return -1;
+    }
+    return dup(pstMb->s32Fd);
+}
+
+RK_S32 RK_MPI_MB_InquireUserCnt(MB_BLK mb) {
+    SIM_MB_S *pstMb = SIM_MB_FromHandle(mb);
+    if (pstMb == RK_NULL) {
+        return RK_ERR_MB_NULL_PTR;
+    }
+    return __atomic_load_n(&pstMb->s32UserCnt, __ATOMIC_ACQUIRE);
+}
+
+RK_S32 RK_MPI_MB_AddUserCnt(MB_BLK mb) {
+    SIM_MB_S *pstMb = SIM_MB_FromHandle(mb);
+    if (pstMb == RK_NULL) {
+        return RK_ERR_MB_NULL_PTR;
+    }
+    __atomic_add_fetch(&pstMb->s32UserCnt, 1, __ATOMIC_ACQ_REL);
+    return RK_SUCCESS;
+}
+
+RK_S32 RK_MPI_MB_SetModPoolConfig(MB_UID_E enMbUid, const MB_CONFIG_S *pstMbConfig) {
+    if (enMbUid < MB_UID_VI || enMbUid >= MB_UID_BUTT || pstMbConfig == RK_NULL) {
+        return RK_ERR_MB_ILLEGAL_PARAM;
+    }
+    pthread_mutex_lock(&gMbLock);
+    gMbModConfig[enMbUid] = *pstMbConfig;
+    pthread_mutex_unlock(&gMbLock);
+    return RK_SUCCESS;
+}
+
+RK_S32 RK_MPI_MB_GetModPoolConfig(MB_UID_E enMbUid, MB_CONFIG_S *pstMbConfig) {
+    if (enMbUid < MB_UID_VI || enMbUid >= MB_UID_BUTT || pstMbConfig == RK_NULL) {
+        return RK_ERR_MB_ILLEGAL_PARAM;
+    }
+    pthread_mutex_lock(&gMbLock);
+    *pstMbConfig = gMbModConfig[enMbUid];
+    pthread_mutex_unlock(&gMbLock);
+    return RK_SUCCESS;
+}
+
+/* creates the common pools of RK_MPI_MB_SetConfig(), once until exit. */
+RK_S32 RK_MPI_MB_Init() {
+    MB_CONFIG_S stConfig;
+
+    pthread_mutex_lock(&gMbLock);
+    if (gMbInited) {
+        pthread_mutex_unlock(&gMbLock);
+        return RK_SUCCESS;
+    }
+    gMbInited = RK_TRUE;
+    stConfig = gMbConfig;
+    pthread_mutex_unlock(&gMbLock);
+
+    for (RK_U32 i = 0; i < stConfig.u32MaxPoolCnt && i < MB_MAX_COMM_POOLS; i++) {
+        if (stConfig.astCommPool[i].u64MBSize == 0 || stConfig.astCommPool[i].u32MBCnt == 0) {
+            continue;
+        }
+        if (sim_mb_create_pool(&stConfig.astCommPool[i], RK_TRUE) == MB_INVALID_POOLID) {
+            RK_MPI_MB_Exit();
+            return RK_ERR_MB_NOMEM;
+        }
+    }
+    return RK_SUCCESS;
+}
+
+RK_S32 RK_MPI_MB_Exit() {
+    pthread_mutex_lock(&gMbLock);
+    gMbInited = RK_FALSE;
+    pthread_mutex_unlock(&gMbLock);
+
+    for (RK_U32 i = 0; i < SIM_MB_MAX_POOLS; i++) {
+        RK_BOOL bCommon;
+        pthread_mutex_lock(&gMbLock);
+        bCommon = (RK_BOOL)(sim_mb_pool(i) != RK_NULL && gMbPools[i].bCommon);
+        pthread_mutex_unlock(&gMbLock);
+        if (bCommon) {
+            RK_MPI_MB_DestroyPool(i);
+        }
+    }
+
+    const char *pProfile = getenv("rk_mb_sim_profile");
+    if (pProfile != RK_NULL) {
+        FILE *fp = fopen(pProfile, "w");
+        if (fp == RK_NULL) {
+            RK_LOGE("open profile %s failed", pProfile);
+            return RK_SUCCESS;
+        }
+        RK_CHAR *pBuf = reinterpret_cast<RK_CHAR *>(malloc(SIM_MB_PROFILE_BUF_SIZE));
+        if (pBuf != RK_NULL) {
+            pthread_mutex_lock(&gMbLock);
+            RK_S32 s32Len = sim_mb_recommend(pBuf, SIM_MB_PROFILE_BUF_SIZE);
+            pthread_mutex_unlock(&gMbLock);
+            fwrite(pBuf, 1, s32Len, fp);
+            free(pBuf);
+        }
+        fclose(fp);
+    }
+    return RK_SUCCESS;
+}
+
+RK_S32 RK_MPI_MB_SetConfig(const MB_CONFIG_S *pstMbConfig) {
+    if (pstMbConfig == RK_NULL) {
+        return RK_ERR_MB_NULL_PTR;
+    }
+    pthread_mutex_lock(&gMbLock);
+    gMbConfig = *pstMbConfig;
+    pthread_mutex_unlock(&gMbLock);
+    return RK_SUCCESS;
+}
+
+RK_S32 RK_MPI_MB_GetConfig(MB_CONFIG_S *pstMbConfig) {
+    if (pstMbConfig == RK_NULL) {
+        return RK_ERR_MB_NULL_PTR;
+    }
+    pthread_mutex_lock(&gMbLock);
+    *pstMbConfig = gMbConfig;
+    pthread_mutex_unlock(&gMbLock);
+    return RK_SUCCESS;
+}
+
+RK_S32 RK_MPI_MB_SetBufferStride(MB_BLK mb, RK_U32 u32HorStride, RK_U32 u32VerStride) {
+    SIM_MB_S *pstMb = SIM_MB_FromHandle(mb);
+    if (pstMb == RK_NULL) {
+        return RK_ERR_MB_NULL_PTR;
+    }
+    pstMb->u32HorStride = u32HorStride;
+    pstMb->u32VerStride = u32VerStride;
+    return RK_SUCCESS;
+}
+
+/*
+ * MB_CONFIG_S that holds what the pools of this run needed: u32MBCnt is
+ * the high-water mark, private pools are listed for their CreatePool()
+ * callers. called with gMbLock held.
+ */
+static RK_S32 sim_mb_recommend(RK_CHAR *pBuf, RK_U32 u32Size) {
+    SIM_MB_PROFILE_S astProfiles[SIM_MB_MAX_PROFILES];
+    RK_U32 u32Cnt = gMbProfileCnt;
+    RK_U32 u32Comm = 0;
+    RK_S32 s32Len = 0;
+
+    memcpy(astProfiles, gMbProfiles, sizeof(SIM_MB_PROFILE_S) * u32Cnt);
+    for (RK_U32 i = 0; i < SIM_MB_MAX_POOLS; i++) {
+        if (gMbPools[i].bUsed) {
+            pthread_mutex_lock(&gMbPools[i].lock);
+            sim_mb_profile_merge(astProfiles, &u32Cnt, &gMbPools[i]);
+            pthread_mutex_unlock(&gMbPools[i].lock);
+        }
+    }
+    RK_U64 u64Configured = 0;
+    RK_U64 u64Recommended = 0;
+    s32Len += snprintf(pBuf + s32Len, u32Size - s32Len,
+                       "---------------- recommended MB_CONFIG_S ----------------\n");
+    for (RK_U32 i = 0; i < u32Cnt && s32Len < (RK_S32)u32Size; i++) {
+        const SIM_MB_PROFILE_S *pstProfile = &astProfiles[i];
+        RK_U32 u32MBCnt = (pstProfile->u32HighWater > 0) ? pstProfile->u32HighWater : 1;
+        u64Configured += pstProfile->u64MBSize * pstProfile->u32MBCnt;
+        u64Recommended += pstProfile->u64MBSize * u32MBCnt;
+        if (pstProfile->bCommon && u32Comm < MB_MAX_COMM_POOLS) {
+            s32Len += snprintf(pBuf + s32Len, u32Size - s32Len,
+                               "stMbConfig.astCommPool[%u].u64MBSize = %llu;  /* max request %llu */\n"
+                               "stMbConfig.astCommPool[%u].u32MBCnt = %u;  /* configured %u */\n",
+                               u32Comm, (unsigned long long)pstProfile->u64MBSize,
+                               (unsigned long long)pstProfile->u64MaxReqSize,
+                               u32Comm, u32MBCnt, pstProfile->u32MBCnt);
+            u32Comm++;
+        } else if (!pstProfile->bCommon) {
+            s32Len += snprintf(pBuf + s32Len, u32Size - s32Len,
+                               "/* private pool: u64MBSize = %llu, u32MBCnt = %u, configured %u,"
+                               " max request %llu */\n",
+                               (unsigned long long)pstProfile->u64MBSize, u32MBCnt, pstProfile->u32MBCnt,
+                               (unsigned long long)pstProfile->u64MaxReqSize);
+        }
+    }
+    if (s32Len < (RK_S32)u32Size) {
+        s32Len += snprintf(pBuf + s32Len, u32Size - s32Len,
+                           "stMbConfig.u32MaxPoolCnt = %u;\n"
+                           "/* pool memory: configured %llu bytes, recommended %llu bytes */\n",
+                           u32Comm, (unsigned long long)u64Configured, (unsigned long long)u64Recommended);
+    }
+    return (s32Len < (RK_S32)u32Size) ? s32Len : (RK_S32)u32Size - 1;
+}
+
+RK_S32 SIM_MB_DumpPools(RK_CHAR *pBuf, RK_U32 u32Size) {
+    SIM_MB_STAT_S stStat;
+    RK_S32 s32Len = 0;
+
+    if (pBuf == RK_NULL || u32Size == 0) {
+        return 0;
+    }
+    SIM_MB_GetStat(&stStat);
+    s32Len += snprintf(pBuf + s32Len, u32Size - s32Len,
+                       "---------------- mb sim ----------------\n"
+                       "alloc %llu free %llu live %llu bytes peak %llu bytes flush %llu (%llu bytes)\n"
+                       "%-6s%-12s%-8s%-8s%-8s%-8s%-12s%-12s%-12s%-8s%-8s%-8s\n",
+                       (unsigned long long)stStat.u64AllocCnt, (unsigned long long)stStat.u64FreeCnt,
+                       (unsigned long long)stStat.u64LiveBytes, (unsigned long long)stStat.u64PeakBytes,
+                       (unsigned long long)stStat.u64FlushCnt, (unsigned long long)stStat.u64FlushBytes,
+                       "pool", "mb_size", "mb_cnt", "alloced", "in_use", "hwm", "max_req", "get",
+                       "contended", "wait", "fail", "trim");
+    pthread_mutex_lock(&gMbLock);
+    for (RK_U32 i = 0; i < SIM_MB_MAX_POOLS && s32Len < (RK_S32)u32Size; i++) {
+        SIM_MB_POOL_S *pstPool = &gMbPools[i];
+        if (!pstPool->bUsed) {
+            continue;
+        }
+        pthread_mutex_lock(&pstPool->lock);
+        s32Len += snprintf(pBuf + s32Len, u32Size - s32Len,
+                           "%-6u%-12llu%-8u%-8u%-8u%-8u%-12llu%-12llu%-12llu%-8llu%-8llu%-8llu%s%s\n",
+                           i, (unsigned long long)pstPool->stConfig.u64MBSize, pstPool->stConfig.u32MBCnt,
+                           pstPool->u32Total, pstPool->u32InUse, pstPool->u32HighWater,
+                           (unsigned long long)pstPool->u64MaxReqSize, (unsigned long long)pstPool->u64GetCnt,
+                           (unsigned long long)pstPool->u64ContendCnt, (unsigned long long)pstPool->u64WaitCnt,
+                           (unsigned long long)pstPool->u64FailCnt, (unsigned long long)pstPool->u64TrimCnt,
+                           pstPool->bDestroying ? " destroying" : (pstPool->bCommon ? " common" : ""),
+                           pstPool->bAdaptive ? " adaptive" : "");
+        pthread_mutex_unlock(&pstPool->lock);
+    }
+    if (s32Len < (RK_S32)u32Size) {
+        s32Len += sim_mb_recommend(pBuf + s32Len, u32Size - s32Len);
+    }
+    pthread_mutex_unlock(&gMbLock);
+    return (s32Len < (RK_S32)u32Size) ? s32Len : (RK_S32)u32Size - 1;
+}
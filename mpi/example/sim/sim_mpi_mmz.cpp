@@ -0,0 +1,171 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef DBG_MOD_ID
+#undef DBG_MOD_ID
+#endif
+#define DBG_MOD_ID DBG_MOD_COMB1(RK_ID_MB)
+
+#include <stdint.h>
+
+#include "rk_debug.h"
+#include "rk_mpi_mmz.h"
+#include "rk_mpi_sys.h"
+#include "sim_mb.h"
+
+static RK_S32 sim_mmz_alloc(MB_BLK *pBlk, RK_U32 u32Len, RK_BOOL bShared, RK_BOOL bCached) {
+    if (pBlk == RK_NULL) {
+        return RK_ERR_MB_NULL_PTR;
+    }
+    SIM_MB_S *pstMb = SIM_MB_Alloc(u32Len, bShared, bCached, MB_INVALID_POOLID);
+    if (pstMb == RK_NULL) {
+        *pBlk = MB_INVALID_HANDLE;
+        return RK_ERR_MB_NOMEM;
+    }
+    pstMb->s32UserCnt = 1;
+    *pBlk = pstMb;
+    return RK_SUCCESS;
+}
+
+/*
+ * heap flags are RK_MMZ_ALLOC_* flags, cached unless uncacheable. callers
+ * such as test_comm_avs pass an MB_REMAP_MODE_E instead, its bits do not
+ * overlap the alloc flags, so MB_REMAP_MODE_NOCACHE is honoured as well.
+ */
+static RK_BOOL sim_mmz_heap_cached(RK_U32 u32HeapFlags) {
+    return (RK_BOOL)((u32HeapFlags & (RK_MMZ_ALLOC_UNCACHEABLE | MB_REMAP_MODE_NOCACHE)) == 0);
+}
+
+RK_S32 RK_MPI_MMZ_Alloc(MB_BLK *pBlk, RK_U32 u32Length, RK_U32 u32Flags) {
+    return sim_mmz_alloc(pBlk, u32Length, RK_TRUE,
+                         (RK_BOOL)((u32Flags & RK_MMZ_ALLOC_UNCACHEABLE) == 0));
+}
+
+RK_S32 RK_MPI_MMZ_Free(MB_BLK blk) {
+    return SIM_MB_Put(SIM_MB_FromHandle(blk));
+}
+
+RK_U64 RK_MPI_MMZ_Handle2PhysAddr(MB_BLK blk) {
+    SIM_MB_S *pstMb = SIM_MB_FromHandle(blk);
+    return (pstMb != RK_NULL) ? pstMb->u64PhyAddr : 0;
+}
+
+RK_VOID *RK_MPI_MMZ_Handle2VirAddr(MB_BLK blk) {
+    SIM_MB_S *pstMb = SIM_MB_FromHandle(blk);
+    return (pstMb != RK_NULL) ? pstMb->pu8VirAddr : RK_NULL;
+}
+
+RK_S32 RK_MPI_MMZ_Handle2Fd(MB_BLK blk) {
+    SIM_MB_S *pstMb = SIM_MB_FromHandle(blk);
+    return (pstMb != RK_NULL) ? pstMb->s32Fd : -1;
+}
+
+RK_U64 RK_MPI_MMZ_GetSize(MB_BLK blk) {
+    SIM_MB_S *pstMb = SIM_MB_FromHandle(blk);
+    return (pstMb != RK_NULL) ? pstMb->u64Size : 0;
+}
+
+MB_BLK RK_MPI_MMZ_Fd2Handle(RK_S32 u32Fd) {
+    return SIM_MB_FindFd(u32Fd);
+}
+
+MB_BLK RK_MPI_MMZ_VirAddr2Handle(RK_VOID *pVirAddr) {
+    return SIM_MB_FindVirAddr(pVirAddr);
+}
+
+MB_BLK RK_MPI_MMZ_PhyAddr2Handle(RK_U64 u64phyAddr) {
+    return SIM_MB_FindPhyAddr(u64phyAddr);
+}
+
+RK_S32 RK_MPI_MMZ_IsCacheable(MB_BLK blk) {
+    SIM_MB_S *pstMb = SIM_MB_FromHandle(blk);
+    if (pstMb == RK_NULL) {
+        return RK_ERR_MB_NULL_PTR;
+    }
+    return pstMb->bCached ? 1 : 0;
+}
+
+RK_S32 RK_MPI_MMZ_FlushCacheStart(MB_BLK blk, RK_U32 u32Offset, RK_U32 u32Length, RK_U32 u32Flags) {
+    (void)u32Flags;
+    return SIM_MB_Flush(SIM_MB_FromHandle(blk), u32Offset, u32Length);
+}
+
+RK_S32 RK_MPI_MMZ_FlushCacheEnd(MB_BLK blk, RK_U32 u32Offset, RK_U32 u32Length, RK_U32 u32Flags) {
+    (void)u32Flags;
+    return SIM_MB_Flush(SIM_MB_FromHandle(blk), u32Offset, u32Length);
+}
+
+RK_S32 RK_MPI_MMZ_FlushCacheVaddrStart(RK_VOID *pVirAddr, RK_U32 u32Length, RK_U32 u32Flags) {
+    (void)u32Flags;
+    SIM_MB_S *pstMb = SIM_MB_FindVirAddr(pVirAddr);
+    if (pstMb == RK_NULL) {
+        return RK_ERR_MB_UNEXIST;
+    }
+    return SIM_MB_Flush(pstMb, reinterpret_cast<RK_U8 *>(pVirAddr) - pstMb->pu8VirAddr, u32Length);
+}
+
+RK_S32 RK_MPI_MMZ_FlushCacheVaddrEnd(RK_VOID *pVirAddr, RK_U32 u32Length, RK_U32 u32Flags) {
+    return RK_MPI_MMZ_FlushCacheVaddrStart(pVirAddr, u32Length, u32Flags);
+}
+
+RK_S32 RK_MPI_MMZ_FlushCachePaddrStart(RK_U64 u64phyAddr, RK_U32 u32Length, RK_U32 u32Flags) {
+    (void)u32Flags;
+    SIM_MB_S *pstMb = SIM_MB_FindPhyAddr(u64phyAddr);
+    if (pstMb == RK_NULL) {
+        return RK_ERR_MB_UNEXIST;
+    }
+    return SIM_MB_Flush(pstMb, u64phyAddr - pstMb->u64PhyAddr, u32Length);
+}
+
+RK_S32 RK_MPI_MMZ_FlushCachePaddrEnd(RK_U64 u64phyAddr, RK_U32 u32Length, RK_U32 u32Flags) {
+    return RK_MPI_MMZ_FlushCachePaddrStart(u64phyAddr, u32Length, u32Flags);
+}
+
+RK_S32 RK_MPI_SYS_MmzAlloc(MB_BLK *pBlk, const RK_CHAR *pstrMmb, const RK_CHAR *pstrZone, RK_U32 u32Len) {
+    (void)pstrMmb;
+    (void)pstrZone;
+    return sim_mmz_alloc(pBlk, u32Len, RK_TRUE, RK_FALSE);
+}
+
+RK_S32 RK_MPI_SYS_MmzAlloc_Cached(MB_BLK *pBlk, const RK_CHAR *pstrMmb, const RK_CHAR *pstrZone, RK_U32 u32Len) {
+    (void)pstrMmb;
+    (void)pstrZone;
+    return sim_mmz_alloc(pBlk, u32Len, RK_TRUE, RK_TRUE);
+}
+
+RK_S32 RK_MPI_SYS_MmzAllocEx(MB_BLK *pBlk, const RK_CHAR *pstrMmb, const RK_CHAR *pstrZone,
+                                RK_U32 u32Len, RK_U32 u32HeapFlags) {
+    (void)pstrMmb;
+    (void)pstrZone;
+    return sim_mmz_alloc(pBlk, u32Len, RK_TRUE, sim_mmz_heap_cached(u32HeapFlags));
+}
+
+RK_S32 RK_MPI_SYS_MmzFree(MB_BLK blk) {
+    return SIM_MB_Put(SIM_MB_FromHandle(blk));
+}
+
+RK_S32 RK_MPI_SYS_MmzFlushCache(MB_BLK blk, RK_BOOL bReadOnly) {
+    (void)bReadOnly;
+    return SIM_MB_Flush(SIM_MB_FromHandle(blk), 0, 0);
+}
+
+RK_S32 RK_MPI_SYS_Malloc(MB_BLK *pBlk, RK_U32 u32Len) {
+    return sim_mmz_alloc(pBlk, u32Len, RK_FALSE, RK_TRUE);
+}
+
+RK_S32 RK_MPI_SYS_Free(MB_BLK blk) {
+    return SIM_MB_Put(SIM_MB_FromHandle(blk));
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rk_debug.h"
+#include "rk_mpi_mb.h"
+#include "rk_mpi_sys.h"
+#include "sim_mb.h"
+
+static const char *sim_mod_name(RK_S32 modId) {
+    static const char *names[] = {
+        "cmpi", "mb", "sys", "rgn", "venc", "vdec", "vpss", "vgs", "vi", "vo", "ai", "ao",
+        "aenc", "adec", "tde", "isp", "wbc", "avs", "gdc", "rga", "af", "ivs", "pvs", "dis",
+        "swcac", "aiisp",
+    };
+    RK_U32 u32Id = modId & 0xff;
+    return (u32Id < sizeof(names) / sizeof(names[0])) ? names[u32Id] : "mpi";
+}
+
+/* rk_mb_sim_log_level follows RK_DBG_*, info by default. */
+void RK_LOG(RK_S32 level, RK_S32 modId, const char *fmt, const char *fname, const RK_U32 row, ...) {
+    static RK_S32 s32MaxLevel = -1;
+    if (s32MaxLevel < 0) {
+        const char *env = getenv("rk_mb_sim_log_level");
+        s32MaxLevel = (env != RK_NULL) ? atoi(env) : RK_DBG_INFO;
+    }
+    if (level > s32MaxLevel) {
+        return;
+    }
+
+    char line[1024];
+    va_list args;
+    va_start(args, row);
+    vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    fprintf(stderr, "[%s] %s(%d): %s\n", sim_mod_name(modId), fname, row, line);
+}
+
+RK_S32 RK_MPI_SYS_Init(RK_VOID) {
+    return RK_MPI_MB_Init();
+}
+
+RK_S32 RK_MPI_SYS_Exit(RK_VOID) {
+    return RK_MPI_MB_Exit();
+}
+
+/* only the mb state exists here, every other module is empty. */
+RK_S32 RK_MPI_SYS_DumpSys(const RK_CHAR *cmd, RK_CHAR *buf, RK_U32 bufSize) {
+    if (buf == RK_NULL || bufSize == 0) {
+        return RK_ERR_SYS_NULL_PTR;
+    }
+    buf[0] = '\0';
+    if (cmd == RK_NULL || strstr(cmd, "mb") != RK_NULL || strstr(cmd, "valloc") != RK_NULL
+            || strstr(cmd, "mmz") != RK_NULL) {
+        SIM_MB_DumpPools(buf, bufSize);
+    }
+    return RK_SUCCESS;
+}
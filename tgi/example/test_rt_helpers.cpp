@@ -0,0 +1,1112 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *     module: test_rt_helpers
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <new>
+#include <string>
+
+#include "rt_header.h"
+#include "RTAdaptiveDecimator.h"
+#include "RTAsyncObserver.h"
+#include "RTBatchCollector.h"
+#include "RTBroadcastStream.h"
+#include "RTCompactMetaData.h"
+#include "RTGraphReconfigurator.h"
+#include "RTGraphReplay.h"
+#include "RTGraphTracer.h"
+#include "RTNodeWatchdog.h"
+#include "RTPhaseProfiler.h"
+#include "RTStreamQueue.h"
+#include "RTTaskGraph.h"
+#include "RTThumbnailBatch.h"
+#include "RTTypedMetaData.h"
+
+#define TEST_FILE_DIR           "/tmp"
+#define TEST_QUEUE_COUNT        100000
+
+#define TEST_CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            RT_LOGE("check '%s' failed at line %d", #cond, __LINE__); \
+            return RT_ERR_BAD; \
+        } \
+    } while (0)
+
+typedef RT_RET (*RTHelperTestFunc)();
+// gets the arguments after its name.
+typedef RT_RET (*RTHelperBenchFunc)(INT32 argc, char **argv);
+
+typedef struct _RTHelperTest {
+    const char         *name;
+    RTHelperTestFunc    func;
+} RTHelperTest;
+
+typedef struct _RTHelperBench {
+    const char         *name;
+    const char         *usage;
+    RTHelperBenchFunc   func;
+} RTHelperBench;
+
+/*
+ * counts operator new of the whole binary, std::map nodes of RtMetaData
+ * included when librockit resolves it here. payloads librockit takes with
+ * its own malloc are not seen.
+ */
+static std::atomic<INT64> sTestNews(0);
+
+void* operator new(size_t size) {
+    sTestNews.fetch_add(1, std::memory_order_relaxed);
+    void *ptr = malloc(size > 0 ? size : 1);
+    if (ptr == RT_NULL) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+/*
+ * buffers are never dereferenced by the rings, so the tests pass
+ * sequence numbers disguised as pointers and check their order.
+ */
+static RTMediaBuffer* test_seq_buffer(INT64 seq) {
+    return reinterpret_cast<RTMediaBuffer *>(seq);
+}
+
+static INT64 test_buffer_seq(RTMediaBuffer *buffer) {
+    return reinterpret_cast<INT64>(buffer);
+}
+
+typedef struct _RTStreamProducer {
+    RTInputStreamSlots *slots;
+    INT32               slot;
+    INT32               id;
+    INT32               numProducers;
+} RTStreamProducer;
+
+static void* test_stream_produce(void *data) {
+    RTStreamProducer *producer = reinterpret_cast<RTStreamProducer *>(data);
+    for (INT64 i = 1; i <= TEST_QUEUE_COUNT; i++) {
+        RTMediaBuffer *buffer = test_seq_buffer(i * producer->numProducers + producer->id);
+        while (producer->slots->queueInputBuffer(producer->slot, buffer) != RT_OK) {
+            sched_yield();
+        }
+    }
+    return RT_NULL;
+}
+
+// one spsc and one fan-in stream, every producer's order must survive.
+static RT_RET test_stream_queue() {
+    RTInputStreamSlots slots;
+    INT32 single = slots.addStream("single", 1, 8);
+    INT32 fanIn = slots.addStream("fan_in", 3, 16);
+    TEST_CHECK(slots.addStream("single", 1, 8) == single);
+    TEST_CHECK(slots.slotOf("fan_in") == fanIn);
+    TEST_CHECK(slots.slotOf("none") == RTInputStreamSlots::RT_INVALID_STREAM_SLOT);
+    TEST_CHECK(slots.queueInputBuffer(slots.numStreams(), test_seq_buffer(1)) == RT_ERR_OUTOF_RANGE);
+
+    RTStreamProducer producers[4] = {
+        { &slots, single, 0, 1 },
+        { &slots, fanIn, 0, 3 },
+        { &slots, fanIn, 1, 3 },
+        { &slots, fanIn, 2, 3 },
+    };
+    pthread_t threads[4];
+    for (INT32 i = 0; i < 4; i++) {
+        pthread_create(&threads[i], RT_NULL, test_stream_produce, &producers[i]);
+    }
+
+    INT64 lastSingle = 0;
+    INT64 lastFanIn[3] = { 0, 0, 0 };
+    INT64 numSingle = 0;
+    INT64 numFanIn = 0;
+    RT_BOOL ordered = RT_TRUE;
+    while (numSingle < TEST_QUEUE_COUNT || numFanIn < TEST_QUEUE_COUNT * 3) {
+        RTMediaBuffer *buffer = slots.dequeInputBuffer(single);
+        if (buffer != RT_NULL) {
+            ordered = ordered && (test_buffer_seq(buffer) == lastSingle + 1);
+            lastSingle = test_buffer_seq(buffer);
+            numSingle++;
+        }
+        RTMediaBuffer *fanInBuffer = slots.dequeInputBuffer(fanIn);
+        if (fanInBuffer != RT_NULL) {
+            INT64 seq = test_buffer_seq(fanInBuffer);
+            ordered = ordered && (seq / 3 == lastFanIn[seq % 3] + 1);
+            lastFanIn[seq % 3] = seq / 3;
+            numFanIn++;
+        }
+        if (buffer == RT_NULL && fanInBuffer == RT_NULL) {
+            sched_yield();
+        }
+    }
+    for (INT32 i = 0; i < 4; i++) {
+        pthread_join(threads[i], RT_NULL);
+    }
+    TEST_CHECK(ordered);
+    TEST_CHECK(slots.dequeInputBuffer(single) == RT_NULL);
+    TEST_CHECK(slots.dequeInputBuffer(fanIn) == RT_NULL);
+
+    RTSpscQueue<INT32> queue(3);
+    INT32 value = 0;
+    for (INT32 i = 0; i < 4; i++) {
+        TEST_CHECK(queue.push(i));
+    }
+    TEST_CHECK(!queue.push(4));
+    TEST_CHECK(queue.front(&value) && value == 0);
+    TEST_CHECK(queue.pop(&value) && value == 0);
+    TEST_CHECK(queue.push(4));
+    return RT_OK;
+}
+
+// counts the buffers that come back after their last reference.
+class RTTestBufferPool : public RTBufferListener {
+ public:
+    RTTestBufferPool() : returned(0) {}
+    void onBufferAvailable(void *buffer) { (void)buffer; }
+    void onBufferRealloc(void *buffer, UINT32 size) { (void)buffer; (void)size; }
+    void onBufferRelease(void *buffer, RT_BOOL render) {
+        (void)buffer;
+        (void)render;
+        returned++;
+    }
+
+    INT32   returned;
+};
+
+static RT_RET test_broadcast_stream() {
+    RTTestBufferPool pool;
+    UINT8 data[2][64];
+    RTMediaBuffer first(data[0], sizeof(data[0]));
+    RTMediaBuffer second(data[1], sizeof(data[1]));
+    first.setListener(&pool);
+    second.setListener(&pool);
+
+    RTBroadcastStream stream("fan_out");
+    std::vector<RTMediaBuffer *> queues[3];
+    RT_RET sinkRet = RT_OK;
+    INT32 a = stream.addConsumer("a", [&queues](RTMediaBuffer *buffer) {
+        queues[0].push_back(buffer);
+        return RT_OK;
+    });
+    INT32 b = stream.addConsumer("b", [&queues](RTMediaBuffer *buffer) {
+        queues[1].push_back(buffer);
+        return RT_OK;
+    });
+    INT32 c = stream.addConsumer("c", [&queues, &sinkRet](RTMediaBuffer *buffer) {
+        if (sinkRet != RT_OK) {
+            return sinkRet;
+        }
+        queues[2].push_back(buffer);
+        return RT_OK;
+    });
+    RTBroadcastStat stat;
+
+    // fan-out, the buffer comes back once after the last consumer
+    TEST_CHECK(stream.broadcast(&first) == RT_OK);
+    TEST_CHECK(queues[0].size() == 1 && queues[1].size() == 1 && queues[2].size() == 1);
+    TEST_CHECK(queues[0][0] == &first && queues[2][0] == &first);
+    TEST_CHECK(stream.release(b, &first) == RT_OK);
+    TEST_CHECK(stream.release(b, &first) == RT_ERR_BAD);
+    TEST_CHECK(stream.release(a, &first) == RT_OK);
+    TEST_CHECK(pool.returned == 0);
+    TEST_CHECK(stream.release(c, &first) == RT_OK);
+    TEST_CHECK(pool.returned == 1 && stream.numInflights() == 0);
+    TEST_CHECK(stream.queryStat(c, &stat) == RT_OK);
+    TEST_CHECK(stat.delivered == 1 && stat.holding == 0 && stat.lastRelease == 1);
+
+    // a sink that fails drops its reference, the others keep theirs
+    sinkRet = RT_ERR_LIST_FULL;
+    TEST_CHECK(stream.broadcast(&first) == RT_ERR_LIST_FULL);
+    TEST_CHECK(stream.queryStat(c, &stat) == RT_OK && stat.rejected == 1 && stat.holding == 0);
+    TEST_CHECK(stream.release(a, &first) == RT_OK && stream.release(b, &first) == RT_OK);
+    TEST_CHECK(pool.returned == 2);
+    sinkRet = RT_OK;
+
+    // a consumer added while a buffer is in flight only gets the next one
+    TEST_CHECK(stream.broadcast(&first) == RT_OK);
+    INT32 d = stream.addConsumer("d", [](RTMediaBuffer *buffer) {
+        (void)buffer;
+        return RT_OK;
+    });
+    TEST_CHECK(stream.release(d, &first) == RT_ERR_BAD);
+    TEST_CHECK(stream.broadcast(&second) == RT_OK);
+    TEST_CHECK(stream.numConsumers() == 4 && stream.numInflights() == 2);
+
+    // removing a consumer drops what it holds of both buffers
+    TEST_CHECK(stream.removeConsumer(a) == RT_OK);
+    TEST_CHECK(stream.removeConsumer(a) == RT_ERR_OUTOF_RANGE);
+    TEST_CHECK(stream.release(b, &first) == RT_OK);
+    TEST_CHECK(stream.release(c, &first) == RT_OK);
+    TEST_CHECK(pool.returned == 3);
+
+    // consumers that release directly, the buffer is broadcast again
+    second.release();
+    second.release();
+    second.release();
+    TEST_CHECK(pool.returned == 4);
+    TEST_CHECK(stream.broadcast(&second) == RT_OK);
+    TEST_CHECK(stream.numConsumers() == 3 && stream.numInflights() == 1);
+    TEST_CHECK(stream.queryStat(d, &stat) == RT_OK);
+    TEST_CHECK(stat.delivered == 2 && stat.direct == 1 && stat.holding == 1);
+
+    stream.flush();
+    TEST_CHECK(pool.returned == 5 && stream.numInflights() == 0);
+
+    // no consumer, the reference of the caller is still consumed
+    RTBroadcastStream empty("empty");
+    TEST_CHECK(empty.broadcast(&first) != RT_OK);
+    TEST_CHECK(pool.returned == 6);
+    return RT_OK;
+}
+
+/*
+ * the processor runs on the pushing thread only: a timed out batch waits
+ * for the wakeup and goes out with the next deliverExpired().
+ */
+static RT_RET test_batch_collector() {
+    INT32 caller = RtThread::getThreadID();
+    INT32 wrongThread = 0;
+    INT32 wakeups = 0;
+    std::vector<INT32> sizes;
+    RTBatchCollector collector(4, 20 * 1000,
+            [&](std::list<RTMediaBuffer *> *batch, RTTaskNodeContext *context) {
+                (void)context;
+                wrongThread += (RtThread::getThreadID() != caller) ? 1 : 0;
+                sizes.push_back((INT32)batch->size());
+                return RT_OK;
+            });
+    collector.setWakeup([&wakeups]() { __atomic_add_fetch(&wakeups, 1, __ATOMIC_RELAXED); });
+    TEST_CHECK(collector.start() == RT_OK);
+
+    for (INT64 seq = 1; seq <= 6; seq++) {
+        TEST_CHECK(collector.push(test_seq_buffer(seq)) == RT_OK);
+    }
+    TEST_CHECK(sizes.size() == 1 && sizes[0] == 4);
+    for (INT32 i = 0; i < 50 && __atomic_load_n(&wakeups, __ATOMIC_RELAXED) == 0; i++) {
+        usleep(10 * 1000);
+    }
+    TEST_CHECK(__atomic_load_n(&wakeups, __ATOMIC_RELAXED) >= 1);
+    TEST_CHECK(sizes.size() == 1);
+    TEST_CHECK(collector.deliverExpired() == RT_OK);
+    TEST_CHECK(sizes.size() == 2 && sizes[1] == 2);
+
+    TEST_CHECK(collector.push(test_seq_buffer(7)) == RT_OK);
+    TEST_CHECK(collector.deliverExpired() == RT_OK);
+    TEST_CHECK(sizes.size() == 2);
+    TEST_CHECK(collector.flush() == RT_OK);
+    TEST_CHECK(collector.stop() == RT_OK);
+    TEST_CHECK(sizes.size() == 3 && sizes[2] == 1);
+    TEST_CHECK(wrongThread == 0);
+
+    RTBatchStat stat;
+    collector.queryStat(&stat);
+    TEST_CHECK(stat.fullBatches == 1 && stat.timeoutBatches == 2 && stat.pending == 0);
+    return RT_OK;
+}
+
+static RT_RET test_compact_metadata() {
+    RTMetaArena arena;
+    char payload[RT_META_ARENA_BLOCK_SIZE * 2];
+    rt_memset(payload, 0x5a, sizeof(payload));
+
+    for (INT32 round = 0; round < 100; round++) {
+        RTCompactMetaData meta(&arena);
+        // more keys than inline entries, inserted in reverse order
+        for (INT32 key = RT_META_INLINE_ENTRIES * 2; key > 0; key--) {
+            TEST_CHECK(meta.setInt64((UINT64)key, key * 10));
+        }
+        TEST_CHECK(meta.setCString(1000, "rockit"));
+        TEST_CHECK(meta.setStructData(1001, payload, sizeof(payload)));
+        TEST_CHECK(meta.setInt32("opt_width", 1920));
+        TEST_CHECK(meta.size() == RT_META_INLINE_ENTRIES * 2 + 3);
+
+        INT64 value64 = 0;
+        INT32 value32 = 0;
+        const char *text = RT_NULL;
+        const void *data = RT_NULL;
+        TEST_CHECK(meta.findInt64(7, &value64) && value64 == 70);
+        TEST_CHECK(!meta.findInt32(7, &value32));
+        TEST_CHECK(meta.findCString(1000, &text) && strcmp(text, "rockit") == 0);
+        TEST_CHECK(meta.findStructData(1001, &data, sizeof(payload)));
+        TEST_CHECK(memcmp(data, payload, sizeof(payload)) == 0);
+        TEST_CHECK(!meta.findStructData(1001, &data, 4));
+        TEST_CHECK(meta.findInt32("opt_width", &value32) && value32 == 1920);
+
+        TEST_CHECK(meta.setInt64(7, 77));
+        TEST_CHECK(meta.findInt64(7, &value64) && value64 == 77);
+        TEST_CHECK(meta.remove(7) && !meta.hasData(7));
+        TEST_CHECK(!meta.remove(7));
+        TEST_CHECK(meta.size() == RT_META_INLINE_ENTRIES * 2 + 2);
+
+        // values set again reuse their payload or get compacted
+        char name[32];
+        for (INT32 i = 0; i < 1000; i++) {
+            snprintf(name, sizeof(name), (i & 1) ? "frame-%d" : "f%d-with-a-longer-name", i);
+            TEST_CHECK(meta.setCString(1000, name));
+            TEST_CHECK(meta.setStructData(1002, payload, 100 + (i % 3) * 200));
+        }
+        TEST_CHECK(meta.findCString(1000, &text) && strcmp(text, name) == 0);
+        TEST_CHECK(meta.findStructData(1001, &data, sizeof(payload)));
+        TEST_CHECK(memcmp(data, payload, sizeof(payload)) == 0);
+        TEST_CHECK(meta.findStructData(1002, &data, 100 + (999 % 3) * 200));
+    }
+    // steady state runs from the free list, values set again included
+    RTMetaArenaStat stat;
+    arena.queryStat(&stat);
+    TEST_CHECK(stat.acquires > stat.mallocs * 10);
+    return RT_OK;
+}
+
+static RT_RET test_adaptive_decimator() {
+    RTAdaptiveDecimator decimator(8, 4);
+    RTAdaptiveStat stat;
+    RTDropCounter drops("in", RT_INVALID_NODE_ID);
+    decimator.setDropCounter(&drops);
+
+    // a consumer that keeps up gets every frame
+    for (INT32 i = 0; i < 20; i++) {
+        TEST_CHECK(decimator.admit(0));
+        decimator.onServiced(100);
+        usleep(2000);
+    }
+    TEST_CHECK(decimator.ratio() == 1);
+
+    // 3x slower than the source, the ratio follows without a full queue
+    for (INT32 i = 0; i < 50; i++) {
+        decimator.onServiced(6000);
+        decimator.admit(1);
+        usleep(2000);
+    }
+    decimator.queryStat(&stat);
+    TEST_CHECK(stat.ratio >= 3 && stat.ratio <= stat.maxRatio);
+    TEST_CHECK(stat.kept + stat.decimated == stat.offered);
+    TEST_CHECK(stat.decimated > 0);
+    TEST_CHECK(drops.count(RT_DROP_DECIMATED) == stat.decimated);
+
+    // never above maxRatio, even with the queue at its limit
+    for (INT32 i = 0; i < 20; i++) {
+        decimator.admit(8);
+    }
+    TEST_CHECK(decimator.ratio() == 4);
+
+    decimator.reset();
+    decimator.queryStat(&stat);
+    TEST_CHECK(stat.ratio == 1 && stat.offered == 0);
+
+    // a burst fills the queue of a consumer that keeps up on average, the
+    // ratio steps once per 5 ms service interval rather than per frame
+    RTAdaptiveDecimator burst(8, 8);
+    for (INT32 i = 0; i < 10; i++) {
+        burst.onServiced(5000);
+        burst.admit(0);
+        usleep(8000);
+    }
+    TEST_CHECK(burst.ratio() == 1);
+    for (INT32 i = 0; i < 6; i++) {
+        burst.admit(8);
+        usleep(100);
+    }
+    TEST_CHECK(burst.ratio() == 2);
+    return RT_OK;
+}
+
+// two input frames and one output frame, written and read back.
+static RT_RET test_graph_replay() {
+    const char *path = TEST_FILE_DIR "/rt_tgi_test_replay.rtrp";
+    UINT8 frames[3][100];
+    INT32 dummy = 0;
+    for (INT32 i = 0; i < 3; i++) {
+        rt_memset(frames[i], 0x10 + i, sizeof(frames[i]));
+    }
+    {
+        RTReplayWriter writer;
+        TEST_CHECK(writer.open(path) == RT_OK);
+        // reopen closes the first fd and starts over
+        TEST_CHECK(writer.open(path) == RT_OK);
+        for (INT32 i = 0; i < 3; i++) {
+            RTMediaBuffer buffer(frames[i], sizeof(frames[i]));
+            buffer.setRange(i, sizeof(frames[i]) - 2 * i);
+            buffer.getMetaData()->setInt64(kKeyFramePts, i * 1000);
+            buffer.getMetaData()->setInt32(kKeyFrameW, 640);
+            buffer.getMetaData()->setPointer(kKeyFrameSequence, &dummy);
+            TEST_CHECK(writer.record((i < 2) ? "cam" : "out",
+                                     (i < 2) ? RT_REPLAY_INPUT : RT_REPLAY_OUTPUT, &buffer) == RT_OK);
+        }
+        // two stream records and three buffers
+        TEST_CHECK(writer.records() == 5);
+    }
+
+    RTReplayReader reader;
+    RTReplayEntry entry;
+    TEST_CHECK(reader.open(path) == RT_OK);
+    for (INT32 i = 0; i < 3; i++) {
+        TEST_CHECK(reader.next(&entry) == RT_OK);
+        TEST_CHECK(reader.streamName(entry.streamId) == ((i < 2) ? "cam" : "out"));
+        TEST_CHECK(entry.direction == ((i < 2) ? RT_REPLAY_INPUT : RT_REPLAY_OUTPUT));
+        TEST_CHECK(entry.dataSize == sizeof(frames[i]) - 2 * i);
+        TEST_CHECK(memcmp(entry.data, frames[i] + i, entry.dataSize) == 0);
+
+        RTMediaBuffer *buffer = reader.makeBuffer(entry);
+        INT64 pts = 0;
+        INT32 width = 0;
+        RT_PTR pointer = RT_NULL;
+        TEST_CHECK(buffer->getData() == entry.data && buffer->getLength() == entry.dataSize);
+        TEST_CHECK(buffer->getMetaData()->findInt64(kKeyFramePts, &pts) && pts == i * 1000);
+        TEST_CHECK(buffer->getMetaData()->findInt32(kKeyFrameW, &width) && width == 640);
+        TEST_CHECK(!buffer->getMetaData()->findPointer(kKeyFrameSequence, &pointer));
+        // the mapping stays while a buffer is lent out
+        TEST_CHECK(reader.lent() == 1 && reader.close() == RT_ERR_BAD);
+        buffer->release();
+        TEST_CHECK(reader.lent() == 0);
+    }
+    TEST_CHECK(reader.next(&entry) != RT_OK);
+
+    RTMediaBuffer *eos = reader.makeEosBuffer();
+    INT32 isEos = 0;
+    TEST_CHECK(eos->getMetaData()->findInt32(kKeyPacketEOS, &isEos) && isEos == 1);
+    eos->release();
+    TEST_CHECK(reader.waitReleased(0) == RT_OK && reader.close() == RT_OK);
+
+    // a torn last record ends the replay after the whole ones
+    struct stat st;
+    TEST_CHECK(stat(path, &st) == 0 && truncate(path, st.st_size - 4) == 0);
+    TEST_CHECK(reader.open(path) == RT_OK);
+    TEST_CHECK(reader.next(&entry) == RT_OK && reader.next(&entry) == RT_OK);
+    TEST_CHECK(reader.next(&entry) == RT_ERR_BAD);
+    TEST_CHECK(reader.close() == RT_OK);
+    unlink(path);
+    return RT_OK;
+}
+
+RT_META_DYNAMIC_KEY_STR(RTKeyTestGop, INT32, OPT_VIDEO_GOP);
+
+static RT_RET test_typed_metadata() {
+    RTTypedMetaData meta;
+    INT32 width = 0;
+    INT64 pts = 0;
+    INT32 gop = 0;
+
+    TEST_CHECK(!meta.has<RTKeyWidth>());
+    TEST_CHECK(meta.set<RTKeyWidth>(1920));
+    TEST_CHECK(meta.set<RTKeyFramePts>(123456789012LL));
+    TEST_CHECK(meta.find<RTKeyWidth>(&width) && width == 1920);
+    TEST_CHECK(meta.find<RTKeyFramePts>(&pts) && pts == 123456789012LL);
+    TEST_CHECK(!meta.has<RTKeyFrameDts>());
+    // no RtMetaData behind it, keys without a slot are never found
+    TEST_CHECK(!meta.find<RTKeyTestGop>(&gop));
+
+    meta.remove<RTKeyWidth>();
+    TEST_CHECK(!meta.has<RTKeyWidth>());
+    TEST_CHECK(meta.has<RTKeyFramePts>());
+    meta.clear();
+    TEST_CHECK(!meta.has<RTKeyFramePts>());
+
+    // slot keys reach the RtMetaData behind it on store(), remove<> drops both
+    RtMetaData options;
+    RTTypedMetaData typed(&options);
+    TEST_CHECK(typed.set<RTKeyFramePts>(42));
+    TEST_CHECK(!options.hasData(RTKeyFramePts::kId));
+    typed.store();
+    TEST_CHECK(options.findInt64(RTKeyFramePts::kId, &pts) && pts == 42);
+    typed.remove<RTKeyFramePts>();
+    TEST_CHECK(!typed.has<RTKeyFramePts>());
+    TEST_CHECK(!options.hasData(RTKeyFramePts::kId));
+    typed.load();
+    TEST_CHECK(!typed.has<RTKeyFramePts>());
+    return RT_OK;
+}
+
+typedef struct _RTObserverConsumer {
+    RTObserverRing     *ring;
+    char               *seen;
+    INT64               popped;
+    RT_BOOL             valid;
+    RT_BOOL             done;
+} RTObserverConsumer;
+
+static void* test_observer_consume(void *data) {
+    RTObserverConsumer *consumer = reinterpret_cast<RTObserverConsumer *>(data);
+    RTMediaBuffer *buffer = RT_NULL;
+    UINT64 timeUs = 0;
+    while (!__atomic_load_n(&consumer->done, __ATOMIC_ACQUIRE) || consumer->ring->size() > 0) {
+        if (!consumer->ring->pop(&buffer, &timeUs)) {
+            continue;
+        }
+        INT64 seq = test_buffer_seq(buffer);
+        RT_BOOL twice = __atomic_exchange_n(&consumer->seen[seq], 1, __ATOMIC_RELAXED);
+        consumer->valid = consumer->valid && (timeUs == (UINT64)seq) && !twice;
+        consumer->popped++;
+    }
+    return RT_NULL;
+}
+
+// the producer retires the oldest slot while the consumer pops, no buffer
+// may be lost or handed out twice.
+static RT_RET test_observer_ring() {
+    RTObserverRing ring(4);
+    RTObserverConsumer consumer;
+    INT64 retired = 0;
+    RT_BOOL valid = RT_TRUE;
+
+    TEST_CHECK(ring.capacity() == 4);
+    consumer.ring = &ring;
+    consumer.seen = reinterpret_cast<char *>(calloc(TEST_QUEUE_COUNT + 1, 1));
+    consumer.popped = 0;
+    consumer.valid = RT_TRUE;
+    consumer.done = RT_FALSE;
+    TEST_CHECK(consumer.seen != RT_NULL);
+
+    pthread_t thread;
+    pthread_create(&thread, RT_NULL, test_observer_consume, &consumer);
+    for (INT64 i = 1; i <= TEST_QUEUE_COUNT; i++) {
+        while (!ring.push(test_seq_buffer(i), (UINT64)i)) {
+            RTMediaBuffer *oldest = ring.retireOldest();
+            if (oldest != RT_NULL) {
+                INT64 seq = test_buffer_seq(oldest);
+                valid = valid && seq < i && !__atomic_exchange_n(&consumer.seen[seq], 1, __ATOMIC_RELAXED);
+                retired++;
+            }
+        }
+    }
+    __atomic_store_n(&consumer.done, RT_TRUE, __ATOMIC_RELEASE);
+    pthread_join(thread, RT_NULL);
+    free(consumer.seen);
+
+    TEST_CHECK(valid && consumer.valid);
+    TEST_CHECK(consumer.popped + retired == TEST_QUEUE_COUNT);
+    TEST_CHECK(ring.size() == 0);
+    return RT_OK;
+}
+
+typedef struct _RTWatchdogEvents {
+    INT32   event;
+    INT32   nodeId;
+    INT32   count;
+} RTWatchdogEvents;
+
+// node 2 keeps its pace, node 1 hangs in one process() call.
+static RT_RET test_node_watchdog() {
+    RTNodeWatchdog watchdog;
+    RTWatchdogEvents events = { 0, 0, 0 };
+    RTWatchdogNodeStat stat;
+
+    watchdog.setThreshold(4, 50 * 1000);
+    watchdog.setListener([&events](INT32 event, INT32 nodeId, INT64 stallUs) {
+        RT_LOGE("node %d stalled for %lld us", nodeId, stallUs);
+        events.event = event;
+        events.nodeId = nodeId;
+        __atomic_add_fetch(&events.count, 1, __ATOMIC_RELAXED);
+    });
+    watchdog.watch(1);
+    watchdog.watch(2);
+    for (INT32 i = 0; i < 5; i++) {
+        RT_WATCHDOG_PROCESS(&watchdog, 1);
+        usleep(5 * 1000);
+    }
+    {
+        RT_WATCHDOG_PROCESS(&watchdog, 1);
+        for (INT32 i = 0; i < 40; i++) {
+            RT_WATCHDOG_PROCESS(&watchdog, 2);
+            usleep(10 * 1000);
+        }
+        TEST_CHECK(watchdog.queryNodeStat(1, &stat) == RT_OK);
+        TEST_CHECK(stat.inProcess && stat.stalled);
+    }
+    watchdog.stop();
+
+    TEST_CHECK(__atomic_load_n(&events.count, __ATOMIC_RELAXED) == 1);
+    TEST_CHECK(events.event == RT_NODE_INFO_STALL && events.nodeId == 1);
+    TEST_CHECK(watchdog.queryNodeStat(1, &stat) == RT_OK);
+    TEST_CHECK(!stat.inProcess && !stat.stalled);
+    TEST_CHECK(stat.stalls == 1 && stat.processed == 6);
+    // the stall is not averaged into the normal cost
+    TEST_CHECK(stat.avgCostUs < 50 * 1000 && stat.maxCostUs >= 400 * 1000);
+    TEST_CHECK(watchdog.queryNodeStat(2, &stat) == RT_OK);
+    TEST_CHECK(stat.stalls == 0 && stat.processed == 40);
+    TEST_CHECK(watchdog.queryNodeStat(3, &stat) != RT_OK);
+    return RT_OK;
+}
+
+/*
+ * a 10 ms stream that stops for the break of a break-before-make rewire,
+ * here 45 ms. the meter learns the interval before the window opens.
+ */
+static RT_RET test_glitch_meter() {
+    RTGlitchMeter meter;
+    RTGlitchStat stat;
+    for (INT32 i = 0; i < 10; i++) {
+        meter.onFrame();
+        usleep(10 * 1000);
+    }
+    meter.beginWindow();
+    meter.onFrame();
+    usleep(45 * 1000);
+    for (INT32 i = 0; i < 5; i++) {
+        meter.onFrame();
+        usleep(10 * 1000);
+    }
+    meter.endWindow(&stat);
+    RT_LOGE("glitch lost(%lld) max-gap(%lld us) interval(%lld us)",
+             stat.lostFrames, stat.maxGapUs, stat.intervalUs);
+    TEST_CHECK(stat.frames == 6);
+    TEST_CHECK(stat.maxGapUs >= 45 * 1000);
+    TEST_CHECK(stat.lostFrames >= 3 && stat.lostFrames <= 5);
+
+    std::set<RTLinkEdge> current;
+    std::set<RTLinkEdge> target;
+    std::vector<RTLinkEdge> added;
+    std::vector<RTLinkEdge> removed;
+    RTLinkShipDiff::parse("0,7-0,8", &current);
+    RTLinkShipDiff::parse("0,8-6,7", &target);
+    RTLinkShipDiff::diff(current, target, &added, &removed);
+    TEST_CHECK(added.size() == 1 && added[0] == RTLinkEdge(6, 7));
+    TEST_CHECK(removed.size() == 1 && removed[0] == RTLinkEdge(0, 7));
+    return RT_OK;
+}
+
+// position of the first step of op on edge, -1 when it is missing.
+static INT32 test_step_of(const std::vector<RTReconfigStep> &steps, RTReconfigOp op, RTLinkEdge edge) {
+    for (size_t i = 0; i < steps.size(); i++) {
+        if (steps[i].op == op && steps[i].edge == edge) {
+            return (INT32)i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * 0->7 swaps to 6->7 break before make, 0->9 is added make before break
+ * next to 0->8 that goes. a removed edge must be unlinked before its drain,
+ * else the source keeps the input busy until the drain times out.
+ */
+static RT_RET test_graph_reconfigure() {
+    std::set<RTLinkEdge> current;
+    std::set<RTLinkEdge> target;
+    std::vector<RTLinkEdge> added;
+    std::vector<RTLinkEdge> removed;
+    std::vector<RTReconfigStep> steps;
+    RTLinkShipDiff::parse("0,7-0,8-0,10", &current);
+    RTLinkShipDiff::parse("0,9-6,7-0,10", &target);
+    RTLinkShipDiff::diff(current, target, &added, &removed);
+    TEST_CHECK(added.size() == 2 && removed.size() == 2);
+
+    TEST_CHECK(RTReconfigurableGraph::plan(added, removed, &steps) == 1);
+    TEST_CHECK(steps.size() == 6);
+    TEST_CHECK(test_step_of(steps, RT_RECONFIG_LINK, RTLinkEdge(0, 10)) < 0);
+    // make before break
+    TEST_CHECK(test_step_of(steps, RT_RECONFIG_LINK, RTLinkEdge(0, 9)) == 0);
+    for (size_t i = 0; i < removed.size(); i++) {
+        INT32 unlink = test_step_of(steps, RT_RECONFIG_UNLINK, removed[i]);
+        INT32 drain = test_step_of(steps, RT_RECONFIG_DRAIN, removed[i]);
+        TEST_CHECK(unlink > 0 && drain > unlink);
+    }
+    // break before make, the new producer waits for the old one to drain
+    TEST_CHECK(test_step_of(steps, RT_RECONFIG_LINK, RTLinkEdge(6, 7))
+                   > test_step_of(steps, RT_RECONFIG_DRAIN, RTLinkEdge(0, 7)));
+
+    RTLinkShipDiff::diff(current, current, &added, &removed);
+    TEST_CHECK(RTReconfigurableGraph::plan(added, removed, &steps) == 0);
+    TEST_CHECK(steps.empty());
+    return RT_OK;
+}
+
+static RT_RET test_read_file(const char *path, std::string *data);
+
+static INT32 test_count(const std::string &data, const char *pattern) {
+    INT32 count = 0;
+    size_t pos = data.find(pattern);
+    while (pos != std::string::npos) {
+        count++;
+        pos = data.find(pattern, pos + 1);
+    }
+    return count;
+}
+
+/*
+ * one thread wraps its ring, the dump keeps the newest SIZE - 1 events,
+ * the slot the writer fills next is never read.
+ */
+static RT_RET test_graph_tracer() {
+    const char *path = TEST_FILE_DIR "/rt_tgi_test_trace.json";
+    const INT32 total = RT_GRAPH_TRACE_RING_SIZE + 100;
+    RTGraphTracer *tracer = RTGraphTracer::instance();
+    char pattern[64];
+    std::string data;
+
+    tracer->setNodeName(7, "dec \"main\"\\0\n");
+    tracer->setEnable(RT_TRUE);
+    tracer->reset();
+    for (INT32 i = 0; i < total; i++) {
+        tracer->record(RT_TRACE_PROCESS_BEGIN, 7, i);
+    }
+    tracer->setEnable(RT_FALSE);
+    TEST_CHECK(tracer->dumpChromeTrace(path) == RT_OK);
+    TEST_CHECK(test_read_file(path, &data) == RT_OK);
+    unlink(path);
+
+    TEST_CHECK(test_count(data, "\"cat\":\"node\"") == RT_GRAPH_TRACE_RING_SIZE - 1);
+    TEST_CHECK(data.find("\"seq\":100}") == std::string::npos);
+    TEST_CHECK(data.find("\"seq\":101}") != std::string::npos);
+    snprintf(pattern, sizeof(pattern), "\"seq\":%d}", total - 1);
+    TEST_CHECK(data.find(pattern) != std::string::npos);
+    TEST_CHECK(data.find("node_7 dec \\\"main\\\"\\\\0\\u000a\"") != std::string::npos);
+    snprintf(pattern, sizeof(pattern), "\"pid\":7,\"tid\":%d,\"args\":{\"name\"",
+             RtThread::getThreadID());
+    TEST_CHECK(test_count(data, pattern) == 1);
+    return RT_OK;
+}
+
+static RT_RET test_read_file(const char *path, std::string *data) {
+    char buffer[4096];
+    FILE *fp = fopen(path, "rb");
+    if (fp == RT_NULL) {
+        RT_LOGE("open %s failed", path);
+        return RT_ERR_OPEN_FILE;
+    }
+    data->clear();
+    size_t size = 0;
+    while ((size = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+        data->append(buffer, size);
+    }
+    fclose(fp);
+    return RT_OK;
+}
+
+/*
+ * cold start of a graph, per phase. autoBuild() parses the json and builds
+ * executors, nodes and link modes inside librockit, so parse and build are
+ * one phase here; read_config is the file access an application pays.
+ */
+static RT_RET bench_graph_startup(INT32 argc, char **argv) {
+    static const char *phases[] = { "read_config", "auto_build", "prepare", "start" };
+    const INT32 numPhases = sizeof(phases) / sizeof(phases[0]);
+    UINT64 costUs[numPhases] = { 0 };
+    INT32 rounds = (argc > 1) ? atoi(argv[1]) : 10;
+    RTPhaseProfiler profiler("graph_startup");
+    std::string config;
+
+    if (argc < 1 || rounds <= 0) {
+        return RT_ERR_BAD;
+    }
+    for (INT32 round = 0; round < rounds; round++) {
+        profiler.reset();
+        profiler.begin("read_config");
+        RT_RET ret = test_read_file(argv[0], &config);
+        if (ret != RT_OK) {
+            return ret;
+        }
+        profiler.begin("auto_build");
+        RTTaskGraph *graph = new RTTaskGraph("startup_bench");
+        ret = graph->autoBuild(config.c_str(), RT_FALSE);
+        if (ret == RT_OK) {
+            profiler.begin("prepare");
+            ret = graph->prepare();
+        }
+        if (ret == RT_OK) {
+            profiler.begin("start");
+            ret = graph->start();
+        }
+        profiler.end();
+        if (ret == RT_OK) {
+            graph->stop();
+        }
+        rt_safe_delete(graph);
+        if (ret != RT_OK) {
+            RT_LOGE("graph %s failed to start in round %d", argv[0], round);
+            return ret;
+        }
+        for (INT32 i = 0; i < numPhases; i++) {
+            costUs[i] += profiler.costOf(phases[i]);
+        }
+    }
+    profiler.dump();
+    for (INT32 i = 0; i < numPhases; i++) {
+        printf("%-12s avg %8lld us over %d rounds\n", phases[i], (long long)(costUs[i] / rounds), rounds);
+    }
+    return RT_OK;
+}
+
+/*
+ * per-frame metadata of a decoder output: set, read back and clear the
+ * usual keys of one frame, RtMetaData against RTCompactMetaData on an
+ * arena shared like the one of a buffer pool.
+ */
+#define TEST_META_FRAME(meta, frame) \
+    do { \
+        (meta)->setInt64((UINT64)1, (frame) * 33333); \
+        (meta)->setInt64((UINT64)2, (frame) * 33333 - 66666); \
+        (meta)->setInt32((UINT64)3, (frame)); \
+        (meta)->setInt32((UINT64)4, 0); \
+        (meta)->setInt32((UINT64)5, 1920); \
+        (meta)->setInt32((UINT64)6, 1080); \
+        (meta)->setPointer((UINT64)7, (RT_PTR)(meta)); \
+        (meta)->setCString((UINT64)8, "h264"); \
+        (meta)->setStructData((UINT64)9, hdr, sizeof(hdr)); \
+    } while (0)
+
+#define TEST_META_READ(meta, sum) \
+    do { \
+        INT64 pts = 0; \
+        INT32 seq = 0; \
+        const char *codec = RT_NULL; \
+        const void *blob = RT_NULL; \
+        (meta)->findInt64((UINT64)1, &pts); \
+        (meta)->findInt32((UINT64)3, &seq); \
+        (meta)->findCString((UINT64)8, &codec); \
+        (meta)->findStructData((UINT64)9, &blob, sizeof(hdr)); \
+        (sum) += pts + seq + codec[0] + reinterpret_cast<const UINT8 *>(blob)[0]; \
+    } while (0)
+
+static RT_RET bench_compact_metadata(INT32 argc, char **argv) {
+    INT32 frames = (argc > 0) ? atoi(argv[0]) : 1000000;
+    UINT8 hdr[64];
+    INT64 sum = 0;
+    if (frames <= 0) {
+        return RT_ERR_BAD;
+    }
+    rt_memset(hdr, 1, sizeof(hdr));
+
+    RtMetaData *meta = new RtMetaData();
+    INT64 news = sTestNews.load();
+    UINT64 begin = RtTime::getNowTimeUs();
+    for (INT32 frame = 0; frame < frames; frame++) {
+        TEST_META_FRAME(meta, frame);
+        TEST_META_READ(meta, sum);
+        meta->clear();
+    }
+    UINT64 metaUs = RtTime::getNowTimeUs() - begin;
+    INT64 metaNews = sTestNews.load() - news;
+    delete meta;
+
+    RTMetaArena arena;
+    RTCompactMetaData *compact = new RTCompactMetaData(&arena);
+    news = sTestNews.load();
+    begin = RtTime::getNowTimeUs();
+    for (INT32 frame = 0; frame < frames; frame++) {
+        TEST_META_FRAME(compact, frame);
+        TEST_META_READ(compact, sum);
+        compact->clear();
+    }
+    UINT64 compactUs = RtTime::getNowTimeUs() - begin;
+    INT64 compactNews = sTestNews.load() - news;
+    delete compact;
+    RTMetaArenaStat stat;
+    arena.queryStat(&stat);
+
+    printf("%-20s %8.1f ns/frame %8.2f allocs/frame\n", "RtMetaData",
+           metaUs * 1000.0 / frames, (double)metaNews / frames);
+    printf("%-20s %8.1f ns/frame %8.2f allocs/frame (%lld arena mallocs in %d frames)\n",
+           "RTCompactMetaData", compactUs * 1000.0 / frames,
+           (double)(compactNews + stat.mallocs) / frames, (long long)stat.mallocs, frames);
+    RT_LOGD("checksum %lld", (long long)sum);
+    return RT_OK;
+}
+
+/*
+ * the per-frame reads and writes of a video node, through the key strings
+ * and tags of RtMetaData against the slots of RTTypedMetaData.
+ */
+static RT_RET bench_typed_metadata(INT32 argc, char **argv) {
+    INT32 frames = (argc > 0) ? atoi(argv[0]) : 1000000;
+    INT64 sum = 0;
+    if (frames <= 0) {
+        return RT_ERR_BAD;
+    }
+    RtMetaData options;
+    options.setInt32(OPT_VIDEO_WIDTH, 1920);
+    options.setInt32(OPT_VIDEO_HEIGHT, 1080);
+    options.setInt32(OPT_VIDEO_PIX_FORMAT, 0);
+    options.setInt32(kKeyFrameEOS, 0);
+    options.setInt64(kKeyFramePts, 0);
+
+    UINT64 begin = RtTime::getNowTimeUs();
+    for (INT32 frame = 0; frame < frames; frame++) {
+        INT32 width = 0, height = 0, format = 0, eos = 0;
+        INT64 pts = 0;
+        options.findInt32(OPT_VIDEO_WIDTH, &width);
+        options.findInt32(OPT_VIDEO_HEIGHT, &height);
+        options.findInt32(OPT_VIDEO_PIX_FORMAT, &format);
+        options.findInt32(kKeyFrameEOS, &eos);
+        options.findInt64(kKeyFramePts, &pts);
+        options.setInt64(kKeyFramePts, pts + 33333);
+        options.setInt32(kKeyFrameSequence, frame);
+        sum += width + height + format + eos;
+    }
+    UINT64 metaUs = RtTime::getNowTimeUs() - begin;
+
+    RTTypedMetaData typed(&options);
+    typed.load();
+    begin = RtTime::getNowTimeUs();
+    for (INT32 frame = 0; frame < frames; frame++) {
+        INT32 width = 0, height = 0, format = 0, eos = 0;
+        INT64 pts = 0;
+        typed.find<RTKeyWidth>(&width);
+        typed.find<RTKeyHeight>(&height);
+        typed.find<RTKeyPixFormat>(&format);
+        typed.find<RTKeyFrameEOS>(&eos);
+        typed.find<RTKeyFramePts>(&pts);
+        typed.set<RTKeyFramePts>(pts + 33333);
+        typed.set<RTKeyFrameSequence>(frame);
+        sum += width + height + format + eos;
+    }
+    typed.store();
+    UINT64 typedUs = RtTime::getNowTimeUs() - begin;
+
+    printf("%-20s %8.1f ns/frame\n", "RtMetaData", metaUs * 1000.0 / frames);
+    printf("%-20s %8.1f ns/frame (store() included)\n", "RTTypedMetaData",
+           typedUs * 1000.0 / frames);
+    RT_LOGD("checksum %lld", (long long)sum);
+    return RT_OK;
+}
+
+/*
+ * a thumbnail strip over a long-GOP file: one RTMetadataRetriever asked
+ * frame by frame, as an application does today, against RTThumbnailBatch
+ * with 1, 2 and 4 workers. every frame costs a decode from the previous
+ * keyframe, so the longer the GOP the more the reuse and overlap matter.
+ */
+static RT_RET bench_thumbnail(INT32 argc, char **argv) {
+    static const INT32 workers[] = { 1, 2, 4 };
+    INT32 count = (argc > 2) ? atoi(argv[2]) : 20;
+    INT64 durationMs = (argc > 1) ? atoll(argv[1]) : 0;
+    if (argc < 2 || durationMs <= 0 || count <= 0) {
+        return RT_ERR_BAD;
+    }
+    std::vector<INT64> timesUs;
+    for (INT32 i = 0; i < count; i++) {
+        timesUs.push_back(durationMs * 1000 * i / count);
+    }
+
+    RTMetadataRetriever *retriever = new RTMetadataRetriever();
+    RT_RET ret = retriever->setDataSource(argv[0], RT_NULL);
+    if (ret != RT_OK) {
+        RT_LOGE("retriever open %s failed", argv[0]);
+        delete retriever;
+        return ret;
+    }
+    INT32 frames = 0;
+    UINT64 begin = RtTime::getNowTimeUs();
+    for (INT32 i = 0; i < count; i++) {
+        RtMetaData request;
+        request.setInt64(kRetrieverFrameAtTime, timesUs[i]);
+        RTMediaBuffer *frame = retriever->getSingleFrameAtTime(&request);
+        if (frame != RT_NULL) {
+            frames++;
+            frame->release();
+        }
+    }
+    UINT64 elapsedUs = RtTime::getNowTimeUs() - begin;
+    delete retriever;
+    printf("%-20s %3d/%d frames %10.2f thumbs/s\n", "retriever", frames, count,
+           (elapsedUs > 0) ? frames * 1000000.0 / elapsedUs : 0.0);
+
+    for (size_t i = 0; i < sizeof(workers) / sizeof(workers[0]); i++) {
+        RTThumbnailBatch batch(workers[i]);
+        RTThumbnailStat stat;
+        ret = batch.setDataSource(argv[0]);
+        if (ret == RT_OK) {
+            ret = batch.getFramesAtTimes(timesUs, RT_NULL,
+                    [](INT32 index, INT64 timeUs, RTMediaBuffer *frame) {
+                        (void)index;
+                        (void)timeUs;
+                        if (frame != RT_NULL) {
+                            frame->release();
+                        }
+                    }, &stat);
+        }
+        if (ret != RT_OK) {
+            RT_LOGE("thumbnail batch with %d workers failed", workers[i]);
+            return ret;
+        }
+        printf("batch workers(%d)     %3d/%d frames %10.2f thumbs/s first(%lld us)\n",
+               stat.workers, stat.requested - stat.failed, count, stat.thumbsPerSec,
+               (long long)stat.firstFrameUs);
+    }
+    return RT_OK;
+}
+
+static const RTHelperTest sHelperTests[] = {
+    { "stream_queue",       test_stream_queue },
+    { "broadcast_stream",   test_broadcast_stream },
+    { "batch_collector",    test_batch_collector },
+    { "compact_metadata",   test_compact_metadata },
+    { "adaptive_decimator", test_adaptive_decimator },
+    { "graph_replay",       test_graph_replay },
+    { "graph_tracer",       test_graph_tracer },
+    { "typed_metadata",     test_typed_metadata },
+    { "observer_ring",      test_observer_ring },
+    { "node_watchdog",      test_node_watchdog },
+    { "glitch_meter",       test_glitch_meter },
+    { "graph_reconfigure",  test_graph_reconfigure },
+};
+
+// benches only run by name, they need a device or take long.
+static const RTHelperBench sHelperBenches[] = {
+    { "bench_startup",          "<graph.json> [rounds]",    bench_graph_startup },
+    { "bench_compact_metadata", "[frames]",                 bench_compact_metadata },
+    { "bench_typed_metadata",   "[frames]",                 bench_typed_metadata },
+    { "bench_thumbnail",        "<long_gop_file> <duration_ms> [count]", bench_thumbnail },
+};
+
+/*
+ * rt_tgi_helper_test [case ...], runs every case without arguments.
+ * rt_tgi_helper_test <bench> [args ...], runs one bench.
+ */
+int main(int argc, char **argv) {
+    INT32 numTests = sizeof(sHelperTests) / sizeof(sHelperTests[0]);
+    INT32 numBenches = sizeof(sHelperBenches) / sizeof(sHelperBenches[0]);
+    INT32 failed = 0;
+    INT32 run = 0;
+
+    for (INT32 i = 0; argc > 1 && i < numBenches; i++) {
+        if (strcmp(argv[1], sHelperBenches[i].name) != 0) {
+            continue;
+        }
+        RT_RET ret = sHelperBenches[i].func(argc - 2, argv + 2);
+        if (ret != RT_OK) {
+            printf("%s failed, usage: %s %s\n", sHelperBenches[i].name,
+                   sHelperBenches[i].name, sHelperBenches[i].usage);
+        }
+        return (ret == RT_OK) ? 0 : -1;
+    }
+
+    for (INT32 i = 0; i < numTests; i++) {
+        RT_BOOL selected = (argc <= 1);
+        for (INT32 j = 1; j < argc; j++) {
+            selected = selected || (strcmp(argv[j], sHelperTests[i].name) == 0);
+        }
+        if (!selected) {
+            continue;
+        }
+        RT_RET ret = sHelperTests[i].func();
+        printf("%-20s %s\n", sHelperTests[i].name, (ret == RT_OK) ? "ok" : "failed");
+        failed += (ret == RT_OK) ? 0 : 1;
+        run++;
+    }
+    printf("%d of %d cases failed\n", failed, run);
+    return (failed == 0 && run > 0) ? 0 : -1;
+}
@@ -0,0 +1,201 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *     module: RTAdaptiveDecimator
+ */
+
+#ifndef SRC_RT_TASK_TASK_GRAPH_RTADAPTIVEDECIMATOR_H_
+#define SRC_RT_TASK_TASK_GRAPH_RTADAPTIVEDECIMATOR_H_
+
+#include "rt_header.h"
+#include "RTDropAccounting.h"
+
+// weight of the newest sample in the rate averages, 1/8.
+#define RT_DECIMATE_EWMA_SHIFT      3
+// head room kept between arrival and service rate.
+#define RT_DECIMATE_MARGIN_PERCENT  10
+
+typedef struct _RTAdaptiveStat {
+    INT64   offered;        // frames presented to admit()
+    INT64   kept;
+    INT64   decimated;
+    INT64   serviced;       // frames reported by onServiced()
+    INT32   ratio;          // current decimation, keep 1 of ratio frames
+    INT32   maxRatio;
+    INT32   queueDepth;     // last depth seen by admit()
+    INT32   maxQueueDepth;
+    float   arrivalFps;
+    float   serviceFps;     // what the consumer could sustain, 1s / cost
+} RTAdaptiveStat;
+
+/*
+ * adaptive backpressure for one graph input stream. the producer calls
+ * admit() with the current depth of the downstream input queue before it
+ * queues a frame, the consumer calls onServiced() with the processing cost
+ * of every frame it finished. both feed an EWMA:
+ *
+ *     ratio = ceil(service cost / arrival interval * (1 + margin))
+ *
+ * so a consumer that manages 10 fps behind a 30 fps source gets every 4th
+ * frame before its queue ever fills. a queue above half of its capacity
+ * raises the ratio by one step per service interval, the time the consumer
+ * needs before a step shows in the queue depth. the ratio only steps down
+ * again once the queue has drained to a quarter, which keeps it from
+ * oscillating.
+ *
+ * usage with ADD_IF_NOT_FULL:
+ *
+ *     if (decimator->admit(depth)) {
+ *         graph->addPacketToInputStream(stream, 0, buffer);
+ *     } else {
+ *         buffer->release();
+ *     }
+ *
+ * every frame admit() turns away is also added as RT_DROP_DECIMATED to the
+ * counter given to setDropCounter().
+ */
+class RTAdaptiveDecimator {
+ public:
+    explicit RTAdaptiveDecimator(INT32 queueCapacity, INT32 maxRatio = 8)
+            : mCapacity((queueCapacity > 0) ? queueCapacity : 1),
+              mMaxRatio((maxRatio > 0) ? maxRatio : 1),
+              mDrops(RT_NULL) {
+        reset();
+    }
+
+    void reset() {
+        RtAutoMutex autoLock(mLock);
+        rt_memset(&mStat, 0, sizeof(RTAdaptiveStat));
+        mStat.ratio = 1;
+        mStat.maxRatio = mMaxRatio;
+        mLastArriveUs = 0;
+        mLastRaiseUs = 0;
+        mArriveIntervalUs = 0;
+        mServiceCostUs = 0;
+        mPhase = 0;
+    }
+
+    // e.g. the stream counter of RTDropAccounting, must outlive the decimator.
+    void setDropCounter(RTDropCounter *drops) {
+        RtAutoMutex autoLock(mLock);
+        mDrops = drops;
+    }
+
+    // returns RT_TRUE when the frame should be queued.
+    RT_BOOL admit(INT32 queueDepth) {
+        RtAutoMutex autoLock(mLock);
+        UINT64 now = RtTime::getNowTimeUs();
+        if (mLastArriveUs > 0) {
+            mArriveIntervalUs = ewma(mArriveIntervalUs, (INT64)(now - mLastArriveUs));
+        }
+        mLastArriveUs = now;
+        mStat.offered++;
+        mStat.queueDepth = queueDepth;
+        if (queueDepth > mStat.maxQueueDepth) {
+            mStat.maxQueueDepth = queueDepth;
+        }
+        updateRatio(queueDepth, now);
+
+        if (++mPhase >= mStat.ratio) {
+            mPhase = 0;
+            mStat.kept++;
+            return RT_TRUE;
+        }
+        mStat.decimated++;
+        if (mDrops != RT_NULL) {
+            mDrops->add(RT_DROP_DECIMATED);
+        }
+        return RT_FALSE;
+    }
+
+    // costUs is the busy time of the consumer for one frame.
+    void onServiced(INT64 costUs) {
+        RtAutoMutex autoLock(mLock);
+        mServiceCostUs = ewma(mServiceCostUs, (costUs > 0) ? costUs : 1);
+        mStat.serviced++;
+    }
+
+    INT32 ratio() {
+        RtAutoMutex autoLock(mLock);
+        return mStat.ratio;
+    }
+
+    void queryStat(RTAdaptiveStat *stat) {
+        RtAutoMutex autoLock(mLock);
+        *stat = mStat;
+        stat->arrivalFps = (mArriveIntervalUs > 0) ? 1000000.0f / mArriveIntervalUs : 0.0f;
+        stat->serviceFps = (mServiceCostUs > 0) ? 1000000.0f / mServiceCostUs : 0.0f;
+    }
+
+    RT_RET dump() {
+        RTAdaptiveStat stat;
+        queryStat(&stat);
+        RT_LOGE("adaptive ratio(1/%d) offered(%lld) kept(%lld) decimated(%lld) "
+                "arrival(%.2f fps) service(%.2f fps) depth(%d/%d max %d)",
+                 stat.ratio, stat.offered, stat.kept, stat.decimated,
+                 stat.arrivalFps, stat.serviceFps, stat.queueDepth, mCapacity,
+                 stat.maxQueueDepth);
+        return RT_OK;
+    }
+
+ private:
+    static INT64 ewma(INT64 average, INT64 sample) {
+        if (average == 0) {
+            return sample;
+        }
+        return average + ((sample - average) >> RT_DECIMATE_EWMA_SHIFT);
+    }
+
+    void updateRatio(INT32 queueDepth, UINT64 now) {
+        INT32 target = 1;
+        if (mServiceCostUs > 0 && mArriveIntervalUs > 0) {
+            INT64 need = mServiceCostUs * (100 + RT_DECIMATE_MARGIN_PERCENT);
+            target = (INT32)((need + mArriveIntervalUs * 100 - 1) / (mArriveIntervalUs * 100));
+        }
+        if (target < 1) {
+            target = 1;
+        }
+        if (queueDepth * 2 >= mCapacity) {
+            if (target <= mStat.ratio) {
+                RT_BOOL settled = (now - mLastRaiseUs >= (UINT64)mServiceCostUs) ? RT_TRUE : RT_FALSE;
+                target = settled ? mStat.ratio + 1 : mStat.ratio;
+            }
+        } else if (target < mStat.ratio) {
+            // step down one at a time, and only with a drained queue.
+            target = (queueDepth * 4 <= mCapacity) ? mStat.ratio - 1 : mStat.ratio;
+        }
+        if (target > mMaxRatio) {
+            target = mMaxRatio;
+        }
+        if (target > mStat.ratio) {
+            mLastRaiseUs = now;
+        }
+        mStat.ratio = target;
+    }
+
+ private:
+    const INT32     mCapacity;
+    const INT32     mMaxRatio;
+    RTDropCounter  *mDrops;
+    RtMutex         mLock;
+    RTAdaptiveStat  mStat;
+    UINT64          mLastArriveUs;
+    UINT64          mLastRaiseUs;
+    INT64           mArriveIntervalUs;
+    INT64           mServiceCostUs;
+    INT32           mPhase;
+};
+
+#endif  // SRC_RT_TASK_TASK_GRAPH_RTADAPTIVEDECIMATOR_H_
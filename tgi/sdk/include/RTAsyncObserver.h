@@ -0,0 +1,358 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *     module: RTAsyncObserver
+ */
+
+#ifndef SRC_RT_TASK_TASK_GRAPH_RTASYNCOBSERVER_H_
+#define SRC_RT_TASK_TASK_GRAPH_RTASYNCOBSERVER_H_
+
+#include <atomic>
+#include <functional>
+#include <string>
+
+#include "rt_header.h"
+#include "rt_thread.h"
+#include "RTDropAccounting.h"
+#include "RTMediaBuffer.h"
+#include "RTStreamQueue.h"
+
+// upper bound of one sleep of the dispatch thread, covers a missed wakeup.
+#define RT_OBSERVER_IDLE_WAIT_US    (10 * 1000)
+
+typedef enum _RTObserverOverflow {
+    RT_OBSERVER_DROP_OLDEST = 0,    // the stream never waits, stale frames go
+    RT_OBSERVER_BLOCK,              // the stream waits for the observer
+} RTObserverOverflow;
+
+typedef struct _RTObserverStat {
+    INT64   queued;
+    INT64   delivered;
+    INT64   dropped;        // oldest frames released unseen on overflow or stop
+    INT64   blocked;        // pushes that had to wait, RT_OBSERVER_BLOCK only
+    INT64   blockTotalUs;
+    INT32   depth;
+    INT32   maxDepth;
+    INT64   lagAvgUs;       // queued to callback entry, EWMA
+    INT64   lagMaxUs;
+    INT64   costAvgUs;      // time spent in the callback, EWMA
+    INT64   costMaxUs;
+} RTObserverStat;
+
+/*
+ * bounded ring between the stream thread and one dispatch thread. it is
+ * single producer/single consumer like RTSpscQueue, except that the
+ * producer may also retire the oldest slot: both sides claim a slot by
+ * CAS on the read index, whoever wins owns the buffer in it.
+ */
+class RTObserverRing {
+ public:
+    explicit RTObserverRing(UINT32 capacity)
+            : mMask(rt_queue_round_pow2(capacity) - 1),
+              mHead(0),
+              mTail(0) {
+        mSlots = new RTObserverSlot[mMask + 1];
+    }
+    ~RTObserverRing() { delete[] mSlots; }
+
+    RTObserverRing(const RTObserverRing&) = delete;
+    RTObserverRing& operator=(const RTObserverRing&) = delete;
+
+    // producer side, RT_FALSE when full.
+    RT_BOOL push(RTMediaBuffer *buffer, UINT64 timeUs) {
+        UINT32 head = mHead.load(std::memory_order_relaxed);
+        if (head - mTail.load(std::memory_order_acquire) > mMask) {
+            return RT_FALSE;
+        }
+        mSlots[head & mMask].buffer.store(buffer, std::memory_order_relaxed);
+        mSlots[head & mMask].timeUs.store(timeUs, std::memory_order_relaxed);
+        mHead.store(head + 1, std::memory_order_seq_cst);
+        return RT_TRUE;
+    }
+
+    // producer side, takes the oldest buffer back when the ring is full.
+    RTMediaBuffer* retireOldest() {
+        UINT32 tail = mTail.load(std::memory_order_acquire);
+        while (mHead.load(std::memory_order_relaxed) - tail > mMask) {
+            RTMediaBuffer *buffer = mSlots[tail & mMask].buffer.load(std::memory_order_relaxed);
+            if (mTail.compare_exchange_weak(tail, tail + 1, std::memory_order_acq_rel)) {
+                return buffer;
+            }
+        }
+        return RT_NULL;
+    }
+
+    // consumer side.
+    RT_BOOL pop(RTMediaBuffer **buffer, UINT64 *timeUs) {
+        UINT32 tail = mTail.load(std::memory_order_acquire);
+        while (tail != mHead.load(std::memory_order_acquire)) {
+            *buffer = mSlots[tail & mMask].buffer.load(std::memory_order_relaxed);
+            *timeUs = mSlots[tail & mMask].timeUs.load(std::memory_order_relaxed);
+            // a failed CAS means the producer retired the slot meanwhile.
+            if (mTail.compare_exchange_weak(tail, tail + 1, std::memory_order_acq_rel)) {
+                return RT_TRUE;
+            }
+        }
+        return RT_FALSE;
+    }
+
+    INT32 size() const {
+        return (INT32)(mHead.load(std::memory_order_acquire) - mTail.load(std::memory_order_acquire));
+    }
+    INT32 capacity() const { return (INT32)(mMask + 1); }
+
+ private:
+    typedef struct RTObserverSlot {
+        std::atomic<RTMediaBuffer *>    buffer;
+        std::atomic<UINT64>             timeUs;
+    } RTObserverSlot;
+
+    const UINT32            mMask;
+    RTObserverSlot         *mSlots;
+    alignas(64) std::atomic<UINT32> mHead;
+    alignas(64) std::atomic<UINT32> mTail;
+};
+
+/*
+ * async mode for RTTaskGraph::observeOutputStream(). the stream thread only
+ * takes a reference on the buffer and queues it, the application callback
+ * runs on a dispatch thread of its own, so a slow consumer of NN results
+ * can not add latency to the uvc stream:
+ *
+ *     RTAsyncObserver *observer = new RTAsyncObserver("rockx", onResult, 2);
+ *     observer->start();
+ *     handle = graph->observeOutputStream("rockx_out", observer->callback());
+ *
+ * the buffer is released after the callback returned, the callback must
+ * not release it. callback() must only be fed by one stream.
+ */
+class RTAsyncObserver {
+ public:
+    RTAsyncObserver(const std::string &name,
+                    std::function<RT_RET(RTMediaBuffer *)> callback,
+                    UINT32 capacity = 4,
+                    RTObserverOverflow overflow = RT_OBSERVER_DROP_OLDEST,
+                    INT64 blockTimeoutUs = -1)
+            : mName(name),
+              mCallback(callback),
+              mRing(capacity),
+              mOverflow(overflow),
+              mBlockTimeoutUs(blockTimeoutUs),
+              mThread(RT_NULL),
+              mRunning(false),
+              mConsumerWaiting(false),
+              mProducerWaiting(false),
+              mQueued(0),
+              mDropped(0),
+              mBlocked(0),
+              mBlockTotalUs(0),
+              mMaxDepth(0),
+              mDropCounter(RT_NULL) {
+        rt_memset(&mStat, 0, sizeof(RTObserverStat));
+    }
+    ~RTAsyncObserver() { stop(); }
+
+    RTAsyncObserver(const RTAsyncObserver&) = delete;
+    RTAsyncObserver& operator=(const RTAsyncObserver&) = delete;
+
+    RT_RET start() {
+        if (mRunning.exchange(true)) {
+            return RT_OK;
+        }
+        mThread = new RtThread(dispatchLoop, this);
+        mThread->setName(mName.c_str());
+        mThread->start();
+        return RT_OK;
+    }
+
+    // buffers still queued are released without being delivered.
+    RT_RET stop() {
+        if (!mRunning.exchange(false)) {
+            return RT_OK;
+        }
+        wake(RT_TRUE);
+        wake(RT_FALSE);
+        mThread->join();
+        rt_safe_delete(mThread);
+
+        RTMediaBuffer *buffer = RT_NULL;
+        UINT64 timeUs = 0;
+        while (mRing.pop(&buffer, &timeUs)) {
+            buffer->release();
+            mDropped++;
+        }
+        return RT_OK;
+    }
+
+    // overflow drops are also reported as RT_DROP_OBSERVER_OVERFLOW.
+    void setDropCounter(RTDropCounter *counter) { mDropCounter = counter; }
+
+    std::function<RT_RET(RTMediaBuffer *)> callback() {
+        return [this](RTMediaBuffer *buffer) { return onBuffer(buffer); };
+    }
+
+    // stream side, never runs the application callback.
+    RT_RET onBuffer(RTMediaBuffer *buffer) {
+        if (buffer == RT_NULL || !mRunning.load(std::memory_order_relaxed)) {
+            return RT_OK;
+        }
+        buffer->addRefs();
+        UINT64 now = RtTime::getNowTimeUs();
+        while (!mRing.push(buffer, now)) {
+            if (mOverflow == RT_OBSERVER_BLOCK && waitForSpace()) {
+                continue;
+            }
+            RTMediaBuffer *oldest = mRing.retireOldest();
+            if (oldest != RT_NULL) {
+                oldest->release();
+                mDropped++;
+                if (mDropCounter != RT_NULL) {
+                    mDropCounter->add(RT_DROP_OBSERVER_OVERFLOW);
+                }
+            }
+        }
+        mQueued++;
+        INT32 depth = mRing.size();
+        if (depth > mMaxDepth.load(std::memory_order_relaxed)) {
+            mMaxDepth.store(depth, std::memory_order_relaxed);
+        }
+        if (mConsumerWaiting.load(std::memory_order_seq_cst)) {
+            wake(RT_TRUE);
+        }
+        return RT_OK;
+    }
+
+    void queryStat(RTObserverStat *stat) {
+        {
+            RtAutoMutex autoLock(mStatLock);
+            *stat = mStat;
+        }
+        stat->queued       = mQueued.load();
+        stat->dropped      = mDropped.load();
+        stat->blocked      = mBlocked.load();
+        stat->blockTotalUs = mBlockTotalUs.load();
+        stat->depth        = mRing.size();
+        stat->maxDepth     = mMaxDepth.load();
+    }
+
+    RT_RET dump() {
+        RTObserverStat stat;
+        queryStat(&stat);
+        RT_LOGE("observer(%s) %s queued(%lld) delivered(%lld) dropped(%lld) depth(%d/%d max %d)",
+                 mName.c_str(), (mOverflow == RT_OBSERVER_BLOCK) ? "block" : "drop-oldest",
+                 stat.queued, stat.delivered, stat.dropped, stat.depth, mRing.capacity(),
+                 stat.maxDepth);
+        RT_LOGE("observer(%s) lag avg(%lld us) max(%lld us) callback avg(%lld us) max(%lld us) "
+                "blocked(%lld, %lld us)",
+                 mName.c_str(), stat.lagAvgUs, stat.lagMaxUs, stat.costAvgUs, stat.costMaxUs,
+                 stat.blocked, stat.blockTotalUs);
+        return RT_OK;
+    }
+
+ private:
+    static INT64 ewma(INT64 average, INT64 sample) {
+        return (average == 0) ? sample : average + ((sample - average) >> 3);
+    }
+
+    // RT_FALSE when the observer is stopping or the block timeout expired.
+    RT_BOOL waitForSpace() {
+        UINT64 begin = RtTime::getNowTimeUs();
+        RT_BOOL ok = RT_TRUE;
+        RtAutoMutex autoLock(mWaitLock);
+        mProducerWaiting.store(true, std::memory_order_seq_cst);
+        while (mRing.size() >= mRing.capacity()) {
+            UINT64 now = RtTime::getNowTimeUs();
+            if (!mRunning.load() || (mBlockTimeoutUs >= 0 && now - begin >= (UINT64)mBlockTimeoutUs)) {
+                ok = RT_FALSE;
+                break;
+            }
+            mSpaceCondition.timedwait(mWaitLock, RT_OBSERVER_IDLE_WAIT_US);
+        }
+        mProducerWaiting.store(false, std::memory_order_relaxed);
+        mBlocked++;
+        mBlockTotalUs += (INT64)(RtTime::getNowTimeUs() - begin);
+        return ok;
+    }
+
+    void wake(RT_BOOL consumer) {
+        RtAutoMutex autoLock(mWaitLock);
+        if (consumer) {
+            mDataCondition.signal();
+        } else {
+            mSpaceCondition.signal();
+        }
+    }
+
+    static void* dispatchLoop(void *data) {
+        RTAsyncObserver *self = reinterpret_cast<RTAsyncObserver *>(data);
+        RTMediaBuffer *buffer = RT_NULL;
+        UINT64 queuedUs = 0;
+        while (self->mRunning.load()) {
+            if (!self->mRing.pop(&buffer, &queuedUs)) {
+                RtAutoMutex autoLock(self->mWaitLock);
+                self->mConsumerWaiting.store(true, std::memory_order_seq_cst);
+                if (self->mRing.size() == 0 && self->mRunning.load()) {
+                    self->mDataCondition.timedwait(self->mWaitLock, RT_OBSERVER_IDLE_WAIT_US);
+                }
+                self->mConsumerWaiting.store(false, std::memory_order_relaxed);
+                continue;
+            }
+            if (self->mProducerWaiting.load(std::memory_order_seq_cst)) {
+                self->wake(RT_FALSE);
+            }
+
+            UINT64 begin = RtTime::getNowTimeUs();
+            self->mCallback(buffer);
+            UINT64 end = RtTime::getNowTimeUs();
+            buffer->release();
+
+            INT64 lagUs = (INT64)(begin - queuedUs);
+            INT64 costUs = (INT64)(end - begin);
+            RtAutoMutex autoLock(self->mStatLock);
+            RTObserverStat &stat = self->mStat;
+            stat.delivered++;
+            stat.lagAvgUs = ewma(stat.lagAvgUs, lagUs);
+            stat.costAvgUs = ewma(stat.costAvgUs, costUs);
+            stat.lagMaxUs = (lagUs > stat.lagMaxUs) ? lagUs : stat.lagMaxUs;
+            stat.costMaxUs = (costUs > stat.costMaxUs) ? costUs : stat.costMaxUs;
+        }
+        return RT_NULL;
+    }
+
+ private:
+    const std::string                       mName;
+    std::function<RT_RET(RTMediaBuffer *)>  mCallback;
+    RTObserverRing                          mRing;
+    const RTObserverOverflow                mOverflow;
+    const INT64                             mBlockTimeoutUs;
+    RtThread                               *mThread;
+    std::atomic<bool>                       mRunning;
+    // slow path only, the ring itself is lock-free.
+    RtMutex                                 mWaitLock;
+    RtCondition                             mDataCondition;
+    RtCondition                             mSpaceCondition;
+    std::atomic<bool>                       mConsumerWaiting;
+    std::atomic<bool>                       mProducerWaiting;
+    std::atomic<INT64>                      mQueued;
+    std::atomic<INT64>                      mDropped;
+    std::atomic<INT64>                      mBlocked;
+    std::atomic<INT64>                      mBlockTotalUs;
+    std::atomic<INT32>                      mMaxDepth;
+    RTDropCounter                          *mDropCounter;
+    RtMutex                                 mStatLock;
+    RTObserverStat                          mStat;
+};
+
+#endif  // SRC_RT_TASK_TASK_GRAPH_RTASYNCOBSERVER_H_
@@ -0,0 +1,366 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *     module: RTBatchCollector
+ */
+
+#ifndef SRC_RT_TASK_TASK_GRAPH_RTBATCHCOLLECTOR_H_
+#define SRC_RT_TASK_TASK_GRAPH_RTBATCHCOLLECTOR_H_
+
+#include <deque>
+#include <functional>
+#include <list>
+#include <string>
+
+#include "rt_header.h"
+#include "rt_metadata.h"
+#include "rt_thread.h"
+#include "RTMediaBuffer.h"
+#include "RTNodeCommon.h"
+#include "RTTaskNodeContext.h"
+
+/*
+ * processes one batch, the buffers in the list belong to the callee.
+ * context is the one passed to the call that delivers the batch, RT_NULL
+ * for push(), flush() or deliverExpired() without a context.
+ */
+typedef std::function<RT_RET(std::list<RTMediaBuffer *> *batch,
+                             RTTaskNodeContext *context)> RTBatchProcessor;
+
+// asks the owner to call process() or deliverExpired() soon, e.g. by
+// scheduling the node. runs on the collector thread, must not block.
+typedef std::function<void()> RTBatchWakeup;
+
+typedef struct _RTBatchStat {
+    INT64   batches;
+    INT64   frames;
+    INT64   fullBatches;    // delivered because batchSize inputs were queued
+    INT64   timeoutBatches; // delivered partial, on timeout or flush
+    INT64   waitTotalUs;    // input arrival to batch delivery, all frames
+    INT64   waitMaxUs;
+    INT64   procTotalUs;    // time spent in the processor
+    INT64   procMaxUs;
+    INT32   pending;
+    float   avgBatchSize;
+    float   framesPerSec;   // since start()
+} RTBatchStat;
+
+/*
+ * batched process() path for task nodes. inputs are pulled with
+ * RTTaskNodeContext::getPackets() and held until batchSize of them are
+ * queued or the oldest one waited timeoutUs, then handed to the processor
+ * together so NN nodes can run one model invocation for several frames or
+ * streams:
+ *
+ *     RT_RET process(RTTaskNodeContext *context) {
+ *         return mCollector->process(context);
+ *     }
+ *
+ * batchSize comes from OPT_NODE_BATCH_SIZE (or the context max batch size),
+ * timeoutUs from OPT_NODE_BATCH_TIMEOUT. batches are always delivered one
+ * at a time and in arrival order.
+ *
+ * the processor only ever runs on the caller's thread. when the oldest
+ * input waited timeoutUs the collector thread calls the wakeup, the
+ * partial batch goes out on the next process() or deliverExpired() of the
+ * node thread, with that call's context. a node without regular input
+ * passes a wakeup that gets it scheduled. in close() the node calls
+ * flush(context) for what is still pending, then stop(); inputs left at
+ * destruction are released without being processed.
+ */
+class RTBatchCollector {
+ public:
+    RTBatchCollector(INT32 batchSize, INT64 timeoutUs, RTBatchProcessor processor)
+            : mBatchSize((batchSize > 0) ? batchSize : 1),
+              mTimeoutUs(timeoutUs),
+              mProcessor(processor),
+              mThread(RT_NULL),
+              mRunning(RT_FALSE),
+              mStartUs(0),
+              mWokenUs(0),
+              mWakeupUs(0) {
+        rt_memset(&mStat, 0, sizeof(RTBatchStat));
+    }
+    ~RTBatchCollector() {
+        stop();
+        RtAutoMutex autoLock(mLock);
+        if (!mPending.empty()) {
+            RT_LOGE("batch collector drops %d inputs, not flushed", (INT32)mPending.size());
+        }
+        while (!mPending.empty()) {
+            mPending.front().buffer->release();
+            mPending.pop_front();
+        }
+    }
+
+    RTBatchCollector(const RTBatchCollector&) = delete;
+    RTBatchCollector& operator=(const RTBatchCollector&) = delete;
+
+    void setWakeup(RTBatchWakeup wakeup) {
+        RtAutoMutex autoLock(mLock);
+        mWakeup = wakeup;
+    }
+
+    static void readOptions(RTTaskNodeContext *context, INT32 *batchSize, INT64 *timeoutUs) {
+        INT32 value = 0;
+        RtMetaData *options = context->options();
+        *batchSize = context->getMaxBatchPrcoessSize();
+        if (options != RT_NULL && options->findInt32(OPT_NODE_BATCH_SIZE, &value) && value > 0) {
+            *batchSize = value;
+        }
+        if (options != RT_NULL && options->findInt32(OPT_NODE_BATCH_TIMEOUT, &value)) {
+            *timeoutUs = value;
+        }
+    }
+
+    RT_RET start() {
+        RtAutoMutex autoLock(mLock);
+        if (mRunning) {
+            return RT_OK;
+        }
+        mRunning = RT_TRUE;
+        mStartUs = RtTime::getNowTimeUs();
+        if (mTimeoutUs > 0) {
+            mThread = new RtThread(timeoutLoop, this);
+            mThread->setName("batch_collector");
+            mThread->start();
+        }
+        return RT_OK;
+    }
+
+    // stops the timeout thread, pending inputs stay until flush().
+    RT_RET stop() {
+        {
+            RtAutoMutex autoLock(mLock);
+            if (!mRunning) {
+                return RT_OK;
+            }
+            mRunning = RT_FALSE;
+            mCondition.broadcast();
+        }
+        if (mThread != RT_NULL) {
+            mThread->join();
+            rt_safe_delete(mThread);
+        }
+        return RT_OK;
+    }
+
+    // delivers timed out batches, then pulls the queued inputs of the
+    // stream and delivers every full batch.
+    RT_RET process(RTTaskNodeContext *context, std::string streamType = "none") {
+        RT_RET ret = deliverExpired(context);
+        if (ret != RT_OK) {
+            return ret;
+        }
+        std::list<RTMediaBuffer *> packets;
+        ret = context->getPackets(&packets, streamType);
+        if (ret != RT_OK && packets.empty()) {
+            return ret;
+        }
+        UINT64 now = RtTime::getNowTimeUs();
+        {
+            RtAutoMutex autoLock(mLock);
+            std::list<RTMediaBuffer *>::iterator it;
+            for (it = packets.begin(); it != packets.end(); ++it) {
+                RTBatchInput input = { *it, now };
+                mPending.push_back(input);
+            }
+            mCondition.signal();
+        }
+        return deliverFull(context);
+    }
+
+    // for inputs collected outside of a node context, e.g. across streams.
+    RT_RET push(RTMediaBuffer *buffer, RTTaskNodeContext *context = RT_NULL) {
+        {
+            RtAutoMutex autoLock(mLock);
+            RTBatchInput input = { buffer, RtTime::getNowTimeUs() };
+            mPending.push_back(input);
+            mCondition.signal();
+        }
+        return deliverFull(context);
+    }
+
+    // delivers the partial batches whose oldest input waited timeoutUs.
+    RT_RET deliverExpired(RTTaskNodeContext *context = RT_NULL) {
+        RT_RET ret = RT_OK;
+        while (ret == RT_OK && frontExpired()) {
+            ret = deliver(RT_TRUE, context);
+        }
+        return ret;
+    }
+
+    // delivers pending inputs even if the batch is not full.
+    RT_RET flush(RTTaskNodeContext *context = RT_NULL) {
+        RT_RET ret = RT_OK;
+        while (ret == RT_OK && pendingCount() > 0) {
+            ret = deliver(RT_TRUE, context);
+        }
+        return ret;
+    }
+
+    void queryStat(RTBatchStat *stat) {
+        RtAutoMutex autoLock(mLock);
+        *stat = mStat;
+        stat->pending = (INT32)mPending.size();
+        stat->avgBatchSize = (mStat.batches > 0) ? (float)mStat.frames / mStat.batches : 0.0f;
+        UINT64 elapsed = (mStartUs > 0) ? RtTime::getNowTimeUs() - mStartUs : 0;
+        stat->framesPerSec = (elapsed > 0) ? mStat.frames * 1000000.0f / elapsed : 0.0f;
+    }
+
+    RT_RET dump() {
+        RTBatchStat stat;
+        queryStat(&stat);
+        RT_LOGE("batch size(%d) timeout(%lld us) batches(%lld) full(%lld) timeout(%lld) "
+                "avg-size(%.2f) fps(%.2f)",
+                 mBatchSize, mTimeoutUs, stat.batches, stat.fullBatches,
+                 stat.timeoutBatches, stat.avgBatchSize, stat.framesPerSec);
+        RT_LOGE("batch wait avg(%lld us) max(%lld us) process avg(%lld us) max(%lld us) "
+                "per-frame(%lld us) pending(%d)",
+                 (stat.frames > 0) ? stat.waitTotalUs / stat.frames : 0, stat.waitMaxUs,
+                 (stat.batches > 0) ? stat.procTotalUs / stat.batches : 0, stat.procMaxUs,
+                 (stat.frames > 0) ? stat.procTotalUs / stat.frames : 0, stat.pending);
+        return RT_OK;
+    }
+
+ private:
+    typedef struct RTBatchInput {
+        RTMediaBuffer  *buffer;
+        UINT64          arriveUs;
+    } RTBatchInput;
+
+    INT32 pendingCount() {
+        RtAutoMutex autoLock(mLock);
+        return (INT32)mPending.size();
+    }
+
+    RT_BOOL frontExpired() {
+        RtAutoMutex autoLock(mLock);
+        return mTimeoutUs > 0 && !mPending.empty()
+                && RtTime::getNowTimeUs() >= mPending.front().arriveUs + mTimeoutUs;
+    }
+
+    // one call may have queued several batches worth of inputs.
+    RT_RET deliverFull(RTTaskNodeContext *context) {
+        RT_RET ret = RT_OK;
+        while (ret == RT_OK && pendingCount() >= mBatchSize) {
+            ret = deliver(RT_FALSE, context);
+        }
+        return ret;
+    }
+
+    // mDeliverLock keeps batches in order when push() callers of several
+    // threads race for the same inputs.
+    RT_RET deliver(RT_BOOL force, RTTaskNodeContext *context) {
+        RtAutoMutex deliverLock(mDeliverLock);
+        std::list<RTMediaBuffer *> batch;
+        {
+            RtAutoMutex autoLock(mLock);
+            INT32 count = (INT32)mPending.size();
+            if (count == 0 || (!force && count < mBatchSize)) {
+                return RT_OK;
+            }
+            if (count > mBatchSize) {
+                count = mBatchSize;
+            }
+            UINT64 now = RtTime::getNowTimeUs();
+            for (INT32 i = 0; i < count; i++) {
+                RTBatchInput &input = mPending.front();
+                INT64 waitUs = (INT64)(now - input.arriveUs);
+                mStat.waitTotalUs += waitUs;
+                if (waitUs > mStat.waitMaxUs) {
+                    mStat.waitMaxUs = waitUs;
+                }
+                batch.push_back(input.buffer);
+                mPending.pop_front();
+            }
+            mStat.batches++;
+            mStat.frames += count;
+            mCondition.signal();
+            if (count == mBatchSize) {
+                mStat.fullBatches++;
+            } else {
+                mStat.timeoutBatches++;
+            }
+        }
+
+        UINT64 begin = RtTime::getNowTimeUs();
+        RT_RET ret = mProcessor(&batch, context);
+        INT64 costUs = (INT64)(RtTime::getNowTimeUs() - begin);
+
+        RtAutoMutex autoLock(mLock);
+        mStat.procTotalUs += costUs;
+        if (costUs > mStat.procMaxUs) {
+            mStat.procMaxUs = costUs;
+        }
+        return ret;
+    }
+
+    // only watches the clock, the wakeup is repeated every timeoutUs until
+    // the node thread took the expired inputs.
+    static void* timeoutLoop(void *data) {
+        RTBatchCollector *self = reinterpret_cast<RTBatchCollector *>(data);
+        while (1) {
+            RTBatchWakeup wakeup;
+            {
+                RtAutoMutex autoLock(self->mLock);
+                if (!self->mRunning) {
+                    break;
+                }
+                if (self->mPending.empty()) {
+                    self->mCondition.timedwait(self->mLock, self->mTimeoutUs);
+                    continue;
+                }
+                UINT64 arriveUs = self->mPending.front().arriveUs;
+                UINT64 due = arriveUs + self->mTimeoutUs;
+                UINT64 now = RtTime::getNowTimeUs();
+                if (now < due) {
+                    self->mCondition.timedwait(self->mLock, due - now);
+                    continue;
+                }
+                if (self->mWokenUs == arriveUs && now < self->mWakeupUs + self->mTimeoutUs) {
+                    self->mCondition.timedwait(self->mLock,
+                                               self->mWakeupUs + self->mTimeoutUs - now);
+                    continue;
+                }
+                self->mWokenUs  = arriveUs;
+                self->mWakeupUs = now;
+                wakeup = self->mWakeup;
+            }
+            if (wakeup) {
+                wakeup();
+            }
+        }
+        return RT_NULL;
+    }
+
+ private:
+    const INT32                 mBatchSize;
+    const INT64                 mTimeoutUs;
+    RTBatchProcessor            mProcessor;
+    RtThread                   *mThread;
+    RtMutex                     mLock;
+    RtMutex                     mDeliverLock;
+    RtCondition                 mCondition;
+    RT_BOOL                     mRunning;
+    UINT64                      mStartUs;
+    UINT64                      mWokenUs;   // arrival of the input last woken for
+    UINT64                      mWakeupUs;  // when that wakeup went out
+    RTBatchWakeup               mWakeup;
+    std::deque<RTBatchInput>    mPending;
+    RTBatchStat                 mStat;
+};
+
+#endif  // SRC_RT_TASK_TASK_GRAPH_RTBATCHCOLLECTOR_H_
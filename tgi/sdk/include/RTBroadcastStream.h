@@ -0,0 +1,320 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *     module: RTBroadcastStream
+ */
+
+#ifndef SRC_RT_TASK_TASK_GRAPH_RTBROADCASTSTREAM_H_
+#define SRC_RT_TASK_TASK_GRAPH_RTBROADCASTSTREAM_H_
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_mutex.h"
+#include "RTMediaBuffer.h"
+
+// hands one reference of the buffer to a consumer, e.g. queues it on the
+// input stream of the next node. on error the stream drops the reference.
+typedef std::function<RT_RET(RTMediaBuffer *buffer)> RTBroadcastSink;
+
+typedef struct _RTBroadcastStat {
+    INT64   delivered;      // buffers handed to the consumer
+    INT64   released;       // buffers given back through release()
+    INT64   rejected;       // buffers the sink refused
+    INT64   direct;         // buffers released by the consumer on its own
+    INT64   holding;        // buffers the consumer still holds
+    INT64   lastRelease;    // times this consumer dropped the final reference
+    INT64   holdTotalUs;
+    INT64   holdMaxUs;
+} RTBroadcastStat;
+
+/*
+ * broadcast output stream: one refcounted buffer is shared by N consumers
+ * without copying. broadcast() takes N-1 extra references and calls the
+ * sink of every consumer with the same buffer pointer, so the buffer
+ * returns to its pool only after every consumer dropped its reference.
+ *
+ * a consumer gives its reference back with release(id, buffer). one that
+ * calls buffer->release() itself is not seen until the producer gets the
+ * buffer back from its pool and broadcasts it again, its entry is then
+ * closed and counted as direct, without hold time.
+ *
+ * a consumer that is often the last one to release (lastRelease) and has a
+ * large hold time is the branch that keeps the pool of the producer empty.
+ */
+class RTBroadcastStream {
+ public:
+    explicit RTBroadcastStream(const char *name)
+            : mName((name != RT_NULL) ? name : "broadcast") {}
+    ~RTBroadcastStream() { flush(); }
+
+    RTBroadcastStream(const RTBroadcastStream&) = delete;
+    RTBroadcastStream& operator=(const RTBroadcastStream&) = delete;
+
+    /*
+     * returns the consumer id, ids are not reused. a consumer added while
+     * streaming gets the buffers of the next broadcast() on.
+     */
+    INT32 addConsumer(const char *name, RTBroadcastSink sink) {
+        RtAutoMutex autoLock(mLock);
+        RTBroadcastConsumer consumer;
+        consumer.name = (name != RT_NULL) ? name : "";
+        consumer.sink = sink;
+        consumer.active = RT_TRUE;
+        rt_memset(&consumer.stat, 0, sizeof(RTBroadcastStat));
+        mConsumers.push_back(consumer);
+        return (INT32)mConsumers.size() - 1;
+    }
+
+    // gets no more buffers, the references it still holds are dropped.
+    RT_RET removeConsumer(INT32 consumerId) {
+        std::vector<RTMediaBuffer *> buffers;
+        {
+            RtAutoMutex autoLock(mLock);
+            if (consumerId < 0 || consumerId >= (INT32)mConsumers.size()
+                    || !mConsumers[consumerId].active) {
+                return RT_ERR_OUTOF_RANGE;
+            }
+            mConsumers[consumerId].active = RT_FALSE;
+            std::map<RTMediaBuffer *, RTBroadcastInflight>::iterator it = mInflights.begin();
+            while (it != mInflights.end()) {
+                std::map<RTMediaBuffer *, RTBroadcastInflight>::iterator next = it;
+                ++next;
+                if (releaseLocked(consumerId, it, RT_FALSE) == RT_OK) {
+                    buffers.push_back(it->first);
+                    if (it->second.pending == 0) {
+                        mInflights.erase(it);
+                    }
+                }
+                it = next;
+            }
+        }
+        for (size_t i = 0; i < buffers.size(); i++) {
+            buffers[i]->release();
+        }
+        return RT_OK;
+    }
+
+    INT32 numConsumers() {
+        RtAutoMutex autoLock(mLock);
+        INT32 num = 0;
+        for (size_t i = 0; i < mConsumers.size(); i++) {
+            num += mConsumers[i].active ? 1 : 0;
+        }
+        return num;
+    }
+
+    /*
+     * the reference owned by the caller is handed to the first consumer,
+     * one more reference is taken for each other consumer, then every sink
+     * gets the buffer. the caller's reference is consumed on every path.
+     */
+    RT_RET broadcast(RTMediaBuffer *buffer) {
+        if (buffer == RT_NULL) {
+            return RT_ERR_NULL_PTR;
+        }
+        std::vector<INT32> targets;
+        std::vector<RTBroadcastSink> sinks;
+        {
+            RtAutoMutex autoLock(mLock);
+            std::map<RTMediaBuffer *, RTBroadcastInflight>::iterator it = mInflights.find(buffer);
+            if (it != mInflights.end()) {
+                // back from the pool, the open consumers released it directly
+                for (size_t i = 0; i < it->second.released.size(); i++) {
+                    if (!it->second.released[i]) {
+                        mConsumers[i].stat.direct++;
+                        mConsumers[i].stat.holding--;
+                    }
+                }
+                mInflights.erase(it);
+            }
+            for (size_t i = 0; i < mConsumers.size(); i++) {
+                if (mConsumers[i].active) {
+                    targets.push_back((INT32)i);
+                    sinks.push_back(mConsumers[i].sink);
+                }
+            }
+            if (targets.empty()) {
+                buffer->release();
+                return RT_ERR_UNKNOWN;
+            }
+            for (size_t i = 1; i < targets.size(); i++) {
+                buffer->addRefs();
+            }
+            // consumers added later are not part of this broadcast
+            RTBroadcastInflight inflight;
+            inflight.sendTimeUs = RtTime::getNowTimeUs();
+            inflight.pending = (INT32)targets.size();
+            inflight.released.assign(mConsumers.size(), RT_TRUE);
+            for (size_t i = 0; i < targets.size(); i++) {
+                inflight.released[targets[i]] = RT_FALSE;
+                mConsumers[targets[i]].stat.delivered++;
+                mConsumers[targets[i]].stat.holding++;
+            }
+            mInflights[buffer] = inflight;
+        }
+
+        // a sink may release at once, the entry is complete before the first call
+        RT_RET ret = RT_OK;
+        for (size_t i = 0; i < targets.size(); i++) {
+            RT_RET err = sinks[i] ? sinks[i](buffer) : RT_ERR_NULL_PTR;
+            if (err != RT_OK) {
+                RT_LOGD("%s consumer(%d) rejects buffer(%p) err(%d)",
+                         mName.c_str(), targets[i], buffer, err);
+                reject(targets[i], buffer);
+                ret = err;
+            }
+        }
+        return ret;
+    }
+
+    // drops one reference on behalf of the consumer.
+    RT_RET release(INT32 consumerId, RTMediaBuffer *buffer) {
+        {
+            RtAutoMutex autoLock(mLock);
+            if (consumerId < 0 || consumerId >= (INT32)mConsumers.size()) {
+                return RT_ERR_OUTOF_RANGE;
+            }
+            std::map<RTMediaBuffer *, RTBroadcastInflight>::iterator it = mInflights.find(buffer);
+            if (it == mInflights.end() || releaseLocked(consumerId, it, RT_TRUE) != RT_OK) {
+                RT_LOGE("%s consumer(%s) releases unknown buffer(%p)",
+                         mName.c_str(), mConsumers[consumerId].name.c_str(), buffer);
+                return RT_ERR_BAD;
+            }
+            if (it->second.pending == 0) {
+                mInflights.erase(it);
+            }
+        }
+        buffer->release();
+        return RT_OK;
+    }
+
+    // releases the references still held, e.g. on stop/reset.
+    void flush() {
+        std::vector<RTMediaBuffer *> buffers;
+        {
+            RtAutoMutex autoLock(mLock);
+            std::map<RTMediaBuffer *, RTBroadcastInflight>::iterator it;
+            for (it = mInflights.begin(); it != mInflights.end(); ++it) {
+                for (size_t i = 0; i < it->second.released.size(); i++) {
+                    if (!it->second.released[i]) {
+                        mConsumers[i].stat.holding--;
+                        buffers.push_back(it->first);
+                    }
+                }
+            }
+            mInflights.clear();
+        }
+        for (size_t i = 0; i < buffers.size(); i++) {
+            buffers[i]->release();
+        }
+    }
+
+    INT32 numInflights() {
+        RtAutoMutex autoLock(mLock);
+        return (INT32)mInflights.size();
+    }
+
+    RT_RET queryStat(INT32 consumerId, RTBroadcastStat *stat) {
+        RtAutoMutex autoLock(mLock);
+        if (consumerId < 0 || consumerId >= (INT32)mConsumers.size() || stat == RT_NULL) {
+            return RT_ERR_OUTOF_RANGE;
+        }
+        *stat = mConsumers[consumerId].stat;
+        return RT_OK;
+    }
+
+    RT_RET dump() {
+        RtAutoMutex autoLock(mLock);
+        RT_LOGE("%s consumers(%d) inflight(%d)",
+                 mName.c_str(), (INT32)mConsumers.size(), (INT32)mInflights.size());
+        for (size_t i = 0; i < mConsumers.size(); i++) {
+            RTBroadcastStat &stat = mConsumers[i].stat;
+            RT_LOGE("%s consumer(%s%s) delivered(%lld) holding(%lld) rejected(%lld) direct(%lld) "
+                    "last-release(%lld) hold avg(%lld us) max(%lld us)",
+                     mName.c_str(), mConsumers[i].name.c_str(), mConsumers[i].active ? "" : ", removed",
+                     stat.delivered, stat.holding, stat.rejected, stat.direct, stat.lastRelease,
+                     (stat.released > 0) ? stat.holdTotalUs / stat.released : 0,
+                     stat.holdMaxUs);
+        }
+        return RT_OK;
+    }
+
+ private:
+    typedef struct RTBroadcastConsumer {
+        std::string         name;
+        RTBroadcastSink     sink;
+        RT_BOOL             active;
+        RTBroadcastStat     stat;
+    } RTBroadcastConsumer;
+
+    // released has one entry per consumer known at broadcast time.
+    typedef struct RTBroadcastInflight {
+        UINT64                  sendTimeUs;
+        INT32                   pending;
+        std::vector<RT_BOOL>    released;
+    } RTBroadcastInflight;
+
+    // closes the entry of the consumer, the caller drops the reference.
+    RT_RET releaseLocked(INT32 consumerId,
+                         std::map<RTMediaBuffer *, RTBroadcastInflight>::iterator it,
+                         RT_BOOL held) {
+        RTBroadcastInflight &inflight = it->second;
+        if (consumerId >= (INT32)inflight.released.size() || inflight.released[consumerId]) {
+            return RT_ERR_BAD;
+        }
+        RTBroadcastStat &stat = mConsumers[consumerId].stat;
+        stat.holding--;
+        if (held) {
+            INT64 holdUs = (INT64)(RtTime::getNowTimeUs() - inflight.sendTimeUs);
+            stat.released++;
+            stat.holdTotalUs += holdUs;
+            if (holdUs > stat.holdMaxUs) {
+                stat.holdMaxUs = holdUs;
+            }
+        }
+        inflight.released[consumerId] = RT_TRUE;
+        if (--inflight.pending == 0) {
+            stat.lastRelease++;
+        }
+        return RT_OK;
+    }
+
+    void reject(INT32 consumerId, RTMediaBuffer *buffer) {
+        {
+            RtAutoMutex autoLock(mLock);
+            std::map<RTMediaBuffer *, RTBroadcastInflight>::iterator it = mInflights.find(buffer);
+            if (it == mInflights.end() || releaseLocked(consumerId, it, RT_FALSE) != RT_OK) {
+                // the sink released it before it failed
+                return;
+            }
+            mConsumers[consumerId].stat.rejected++;
+            if (it->second.pending == 0) {
+                mInflights.erase(it);
+            }
+        }
+        buffer->release();
+    }
+
+    std::string                                     mName;
+    RtMutex                                         mLock;
+    std::vector<RTBroadcastConsumer>                mConsumers;
+    std::map<RTMediaBuffer *, RTBroadcastInflight>  mInflights;
+};
+
+#endif  // SRC_RT_TASK_TASK_GRAPH_RTBROADCASTSTREAM_H_
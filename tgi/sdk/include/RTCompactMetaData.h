@@ -0,0 +1,530 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *     module: RTCompactMetaData
+ */
+
+#ifndef SRC_RT_TASK_TASK_GRAPH_RTCOMPACTMETADATA_H_
+#define SRC_RT_TASK_TASK_GRAPH_RTCOMPACTMETADATA_H_
+
+#include <string.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_metadata.h"
+#include "rt_string_utils.h"
+
+#define RT_META_INLINE_ENTRIES      16
+#define RT_META_ARENA_BLOCK_SIZE    1024
+
+typedef struct _RTMetaArenaStat {
+    INT64   mallocs;        // blocks taken from the heap
+    INT64   frees;          // blocks given back to the heap
+    INT64   acquires;       // blocks handed out by the arena
+    INT32   cached;         // blocks parked in the arena free list
+} RTMetaArenaStat;
+
+/*
+ * free list of fixed size blocks shared by all metadata of one buffer pool.
+ * once the pool reached steady state every block comes from the free list,
+ * so attaching metadata to a frame does not touch the heap.
+ */
+class RTMetaArena {
+ public:
+    explicit RTMetaArena(INT32 maxCached = 256)
+            : mMaxCached(maxCached) {
+        rt_memset(&mStat, 0, sizeof(RTMetaArenaStat));
+    }
+    ~RTMetaArena() {
+        for (size_t i = 0; i < mFrees.size(); i++) {
+            free(mFrees[i]);
+        }
+        mFrees.clear();
+    }
+
+    RTMetaArena(const RTMetaArena&) = delete;
+    RTMetaArena& operator=(const RTMetaArena&) = delete;
+
+    void* acquire() {
+        RtAutoMutex autoLock(mLock);
+        mStat.acquires++;
+        if (!mFrees.empty()) {
+            void *block = mFrees.back();
+            mFrees.pop_back();
+            return block;
+        }
+        void *block = malloc(RT_META_ARENA_BLOCK_SIZE);
+        if (block != RT_NULL) {
+            mStat.mallocs++;
+        }
+        return block;
+    }
+
+    void recycle(void *block) {
+        RtAutoMutex autoLock(mLock);
+        if ((INT32)mFrees.size() < mMaxCached) {
+            mFrees.push_back(block);
+            return;
+        }
+        mStat.frees++;
+        free(block);
+    }
+
+    void queryStat(RTMetaArenaStat *stat) {
+        RtAutoMutex autoLock(mLock);
+        *stat = mStat;
+        stat->cached = (INT32)mFrees.size();
+    }
+
+ private:
+    RtMutex                 mLock;
+    INT32                   mMaxCached;
+    std::vector<void *>     mFrees;
+    RTMetaArenaStat         mStat;
+};
+
+/*
+ * compact replacement for RtMetaData on the per-frame path. entries live in
+ * a sorted array, the first RT_META_INLINE_ENTRIES inside the object, so
+ * the usual handful of INT32/INT64/pointer keys (pts, eos, seq, ...) need
+ * no allocation at all. larger payloads (strings, structs) and overflow
+ * entries are carved from RTMetaArena blocks and returned by clear().
+ *
+ * lookups are a binary search on the key, keys use the same UINT64 space
+ * as RtMetaData, string keys are hashed with func_hash_bkdr().
+ */
+class RTCompactMetaData {
+ public:
+    explicit RTCompactMetaData(RTMetaArena *arena = RT_NULL)
+            : mArena(arena),
+              mEntries(mInlines),
+              mCount(0),
+              mCapacity(RT_META_INLINE_ENTRIES),
+              mHeapEntries(RT_FALSE),
+              mBlocks(RT_NULL),
+              mCurrent(RT_NULL),
+              mBlockUsed(0),
+              mDeadBytes(0) {}
+    ~RTCompactMetaData() { clear(); }
+
+    RTCompactMetaData(const RTCompactMetaData&) = delete;
+    RTCompactMetaData& operator=(const RTCompactMetaData&) = delete;
+
+    void clear() {
+        for (INT32 i = 0; i < mCount; i++) {
+            freeValue(&mEntries[i]);
+        }
+        if (mEntries != mInlines) {
+            if (mHeapEntries) {
+                free(mEntries);
+            } else {
+                mArena->recycle(mEntries);
+            }
+        }
+        releaseBlocks();
+        mEntries     = mInlines;
+        mCount       = 0;
+        mCapacity    = RT_META_INLINE_ENTRIES;
+        mHeapEntries = RT_FALSE;
+        mDeadBytes   = 0;
+    }
+
+    RT_BOOL remove(UINT64 key) {
+        INT32 pos = lowerBound(key);
+        if (pos >= mCount || mEntries[pos].key != key) {
+            return RT_FALSE;
+        }
+        freeValue(&mEntries[pos]);
+        memmove(&mEntries[pos], &mEntries[pos + 1], (mCount - pos - 1) * sizeof(RTMetaEntry));
+        mCount--;
+        return RT_TRUE;
+    }
+
+    RT_BOOL hasData(UINT64 key) const { return find(key) != RT_NULL; }
+    RT_BOOL isEmpty() const { return mCount == 0; }
+    INT32   size() const { return mCount; }
+
+    RT_BOOL setInt32(UINT64 key, INT32 value) {
+        RTMetaEntry *entry = insert(key, RtMetaData::TYPE_INT32);
+        if (entry == RT_NULL) {
+            return RT_FALSE;
+        }
+        entry->value.i32 = value;
+        return RT_TRUE;
+    }
+    RT_BOOL setInt64(UINT64 key, INT64 value) {
+        RTMetaEntry *entry = insert(key, RtMetaData::TYPE_INT64);
+        if (entry == RT_NULL) {
+            return RT_FALSE;
+        }
+        entry->value.i64 = value;
+        return RT_TRUE;
+    }
+    RT_BOOL setFloat(UINT64 key, float value) {
+        RTMetaEntry *entry = insert(key, RtMetaData::TYPE_FLOAT);
+        if (entry == RT_NULL) {
+            return RT_FALSE;
+        }
+        entry->value.f = value;
+        return RT_TRUE;
+    }
+    RT_BOOL setPointer(UINT64 key, RT_PTR value, RTMetaValueFree freeFunc = RT_NULL) {
+        RTMetaEntry *entry = insert(key, RtMetaData::TYPE_POINTER);
+        if (entry == RT_NULL) {
+            return RT_FALSE;
+        }
+        entry->value.ptr = value;
+        entry->freeFunc  = freeFunc;
+        return RT_TRUE;
+    }
+    RT_BOOL setCString(UINT64 key, const char *value) {
+        return setData(key, RtMetaData::TYPE_C_STRING, value, (UINT32)strlen(value) + 1);
+    }
+    RT_BOOL setStructData(UINT64 key, const void *value, UINT32 size) {
+        return setData(key, RtMetaData::TYPE_STRUCT, value, size);
+    }
+
+    RT_BOOL findInt32(UINT64 key, INT32 *value) const {
+        const RTMetaEntry *entry = find(key, RtMetaData::TYPE_INT32);
+        if (entry == RT_NULL) {
+            return RT_FALSE;
+        }
+        *value = entry->value.i32;
+        return RT_TRUE;
+    }
+    RT_BOOL findInt64(UINT64 key, INT64 *value) const {
+        const RTMetaEntry *entry = find(key, RtMetaData::TYPE_INT64);
+        if (entry == RT_NULL) {
+            return RT_FALSE;
+        }
+        *value = entry->value.i64;
+        return RT_TRUE;
+    }
+    RT_BOOL findFloat(UINT64 key, float *value) const {
+        const RTMetaEntry *entry = find(key, RtMetaData::TYPE_FLOAT);
+        if (entry == RT_NULL) {
+            return RT_FALSE;
+        }
+        *value = entry->value.f;
+        return RT_TRUE;
+    }
+    RT_BOOL findPointer(UINT64 key, RT_PTR *value) const {
+        const RTMetaEntry *entry = find(key, RtMetaData::TYPE_POINTER);
+        if (entry == RT_NULL) {
+            return RT_FALSE;
+        }
+        *value = entry->value.ptr;
+        return RT_TRUE;
+    }
+    RT_BOOL findCString(UINT64 key, const char **value) const {
+        const RTMetaEntry *entry = find(key, RtMetaData::TYPE_C_STRING);
+        if (entry == RT_NULL) {
+            return RT_FALSE;
+        }
+        *value = reinterpret_cast<const char *>(entry->value.ptr);
+        return RT_TRUE;
+    }
+    RT_BOOL findStructData(UINT64 key, const void **value, UINT32 size) const {
+        const RTMetaEntry *entry = find(key, RtMetaData::TYPE_STRUCT);
+        if (entry == RT_NULL || entry->size != size) {
+            return RT_FALSE;
+        }
+        *value = entry->value.ptr;
+        return RT_TRUE;
+    }
+
+    RT_BOOL setInt32(const char *key, INT32 value) { return setInt32(func_hash_bkdr(key), value); }
+    RT_BOOL setInt64(const char *key, INT64 value) { return setInt64(func_hash_bkdr(key), value); }
+    RT_BOOL findInt32(const char *key, INT32 *value) const {
+        return findInt32(func_hash_bkdr(key), value);
+    }
+    RT_BOOL findInt64(const char *key, INT64 *value) const {
+        return findInt64(func_hash_bkdr(key), value);
+    }
+
+    // copies every entry into a regular RtMetaData, for APIs that need one.
+    void exportTo(RtMetaData *meta) const {
+        for (INT32 i = 0; i < mCount; i++) {
+            const RTMetaEntry &entry = mEntries[i];
+            switch (entry.type) {
+              case RtMetaData::TYPE_INT32:
+                meta->setInt32(entry.key, entry.value.i32);
+                break;
+              case RtMetaData::TYPE_INT64:
+                meta->setInt64(entry.key, entry.value.i64);
+                break;
+              case RtMetaData::TYPE_FLOAT:
+                meta->setFloat(entry.key, entry.value.f);
+                break;
+              case RtMetaData::TYPE_POINTER:
+                meta->setPointer(entry.key, entry.value.ptr);
+                break;
+              case RtMetaData::TYPE_C_STRING:
+                meta->setCString(entry.key, reinterpret_cast<const char *>(entry.value.ptr));
+                break;
+              default:
+                meta->setData(entry.key, entry.type, entry.value.ptr, entry.size);
+                break;
+            }
+        }
+    }
+
+ private:
+    typedef struct RTMetaEntry {
+        UINT64          key;
+        UINT32          type;
+        UINT32          size;
+        union {
+            INT32       i32;
+            INT64       i64;
+            float       f;
+            RT_PTR      ptr;
+        } value;
+        RTMetaValueFree freeFunc;
+    } RTMetaEntry;
+
+    INT32 lowerBound(UINT64 key) const {
+        INT32 lo = 0;
+        INT32 hi = mCount;
+        while (lo < hi) {
+            INT32 mid = (lo + hi) >> 1;
+            if (mEntries[mid].key < key) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    const RTMetaEntry* find(UINT64 key, UINT32 type = RtMetaData::TYPE_NONE) const {
+        INT32 pos = lowerBound(key);
+        if (pos >= mCount || mEntries[pos].key != key) {
+            return RT_NULL;
+        }
+        if (type != RtMetaData::TYPE_NONE && mEntries[pos].type != type) {
+            return RT_NULL;
+        }
+        return &mEntries[pos];
+    }
+
+    // RT_NULL when the entry array cannot grow, the metadata is unchanged.
+    RTMetaEntry* insert(UINT64 key, UINT32 type) {
+        INT32 pos = lowerBound(key);
+        if (pos < mCount && mEntries[pos].key == key) {
+            freeValue(&mEntries[pos]);
+        } else {
+            if (mCount == mCapacity && !grow()) {
+                return RT_NULL;
+            }
+            memmove(&mEntries[pos + 1], &mEntries[pos], (mCount - pos) * sizeof(RTMetaEntry));
+            mCount++;
+        }
+        RTMetaEntry *entry = &mEntries[pos];
+        entry->key      = key;
+        entry->type     = type;
+        entry->size     = 0;
+        entry->freeFunc = RT_NULL;
+        return entry;
+    }
+
+    RT_BOOL setData(UINT64 key, UINT32 type, const void *data, UINT32 size) {
+        // a new value that fits the payload of the old one is written in place.
+        INT32 pos = lowerBound(key);
+        if (pos < mCount && mEntries[pos].key == key && hasPayload(mEntries[pos])
+                && size <= payloadSize(mEntries[pos].size)) {
+            RTMetaEntry *entry = &mEntries[pos];
+            mDeadBytes += payloadSize(entry->size) - payloadSize(size);
+            memmove(entry->value.ptr, data, size);
+            entry->type = type;
+            entry->size = size;
+            return RT_TRUE;
+        }
+        void *payload = allocPayload(size);
+        if (payload == RT_NULL) {
+            return RT_FALSE;
+        }
+        memcpy(payload, data, size);
+        // on failure the payload stays in mBlocks until clear()
+        RTMetaEntry *entry = insert(key, type);
+        if (entry == RT_NULL) {
+            return RT_FALSE;
+        }
+        entry->value.ptr = payload;
+        entry->size      = size;
+        if (mDeadBytes >= RT_META_ARENA_BLOCK_SIZE) {
+            compact();
+        }
+        return RT_TRUE;
+    }
+
+    static RT_BOOL hasPayload(const RTMetaEntry &entry) {
+        switch (entry.type) {
+          case RtMetaData::TYPE_INT32:
+          case RtMetaData::TYPE_INT64:
+          case RtMetaData::TYPE_FLOAT:
+          case RtMetaData::TYPE_POINTER:
+            return RT_FALSE;
+          default:
+            return RT_TRUE;
+        }
+    }
+
+    // bytes a payload of 'size' takes in a block.
+    static UINT32 payloadSize(UINT32 size) { return (size + 7) & ~7; }
+
+    void freeValue(RTMetaEntry *entry) {
+        if (entry->type == RtMetaData::TYPE_POINTER && entry->freeFunc != RT_NULL) {
+            entry->freeFunc(entry->value.ptr);
+        }
+        // payloads live in mBlocks until clear() or compact().
+        if (hasPayload(*entry)) {
+            mDeadBytes += payloadSize(entry->size);
+        }
+        entry->freeFunc = RT_NULL;
+    }
+
+    /*
+     * a frame whose string or struct keys are set again and again would
+     * otherwise keep every old payload until clear(). once a block worth of
+     * payload is dead the live ones are copied into fresh blocks and the
+     * old blocks go back to the arena. if a block cannot be had the old
+     * blocks are kept behind the new ones, every payload stays valid.
+     */
+    void compact() {
+        RTMetaBlock *blocks = mBlocks;
+        mBlocks    = RT_NULL;
+        mCurrent   = RT_NULL;
+        mBlockUsed = 0;
+        for (INT32 i = 0; i < mCount; i++) {
+            if (!hasPayload(mEntries[i])) {
+                continue;
+            }
+            void *payload = allocPayload(mEntries[i].size);
+            if (payload == RT_NULL) {
+                RTMetaBlock **tail = &mBlocks;
+                while (*tail != RT_NULL) {
+                    tail = &(*tail)->next;
+                }
+                *tail = blocks;
+                return;
+            }
+            memcpy(payload, mEntries[i].value.ptr, mEntries[i].size);
+            mEntries[i].value.ptr = payload;
+        }
+        releaseChain(blocks);
+        mDeadBytes = 0;
+    }
+
+    RT_BOOL grow() {
+        INT32 capacity = mCapacity * 2;
+        size_t bytes = capacity * sizeof(RTMetaEntry);
+        RTMetaEntry *entries = RT_NULL;
+        RT_BOOL heap = RT_TRUE;
+        if (mArena != RT_NULL && bytes <= RT_META_ARENA_BLOCK_SIZE) {
+            entries = reinterpret_cast<RTMetaEntry *>(mArena->acquire());
+            heap = RT_FALSE;
+        } else {
+            entries = reinterpret_cast<RTMetaEntry *>(malloc(bytes));
+        }
+        if (entries == RT_NULL) {
+            RT_LOGE("compact metadata grow to %d entries failed", capacity);
+            return RT_FALSE;
+        }
+        memcpy(entries, mEntries, mCount * sizeof(RTMetaEntry));
+        if (mEntries != mInlines) {
+            if (mHeapEntries) {
+                free(mEntries);
+            } else {
+                mArena->recycle(mEntries);
+            }
+        }
+        mEntries     = entries;
+        mCapacity    = capacity;
+        mHeapEntries = heap;
+        return RT_TRUE;
+    }
+
+    // payload blocks are chained through a small header, no side table.
+    typedef struct RTMetaBlock {
+        struct RTMetaBlock *next;
+        RT_BOOL             heap;
+    } RTMetaBlock;
+
+    void* allocPayload(UINT32 size) {
+        const UINT32 head = payloadSize(sizeof(RTMetaBlock));
+        size = payloadSize(size);
+        if (size + head > RT_META_ARENA_BLOCK_SIZE) {
+            // oversized payloads get a block of their own.
+            RTMetaBlock *block = reinterpret_cast<RTMetaBlock *>(malloc(size + head));
+            if (block == RT_NULL) {
+                return RT_NULL;
+            }
+            block->heap = RT_TRUE;
+            block->next = mBlocks;
+            mBlocks = block;
+            return reinterpret_cast<UINT8 *>(block) + head;
+        }
+        if (mCurrent == RT_NULL || mBlockUsed + size > RT_META_ARENA_BLOCK_SIZE) {
+            RT_BOOL heap = (mArena == RT_NULL);
+            void *data = heap ? malloc(RT_META_ARENA_BLOCK_SIZE) : mArena->acquire();
+            if (data == RT_NULL) {
+                return RT_NULL;
+            }
+            mCurrent = reinterpret_cast<RTMetaBlock *>(data);
+            mCurrent->heap = heap;
+            mCurrent->next = mBlocks;
+            mBlocks = mCurrent;
+            mBlockUsed = head;
+        }
+        void *payload = reinterpret_cast<UINT8 *>(mCurrent) + mBlockUsed;
+        mBlockUsed += size;
+        return payload;
+    }
+
+    void releaseChain(RTMetaBlock *blocks) {
+        while (blocks != RT_NULL) {
+            RTMetaBlock *block = blocks;
+            blocks = block->next;
+            if (block->heap) {
+                free(block);
+            } else {
+                mArena->recycle(block);
+            }
+        }
+    }
+
+    void releaseBlocks() {
+        releaseChain(mBlocks);
+        mBlocks    = RT_NULL;
+        mCurrent   = RT_NULL;
+        mBlockUsed = 0;
+    }
+
+ private:
+    RTMetaArena                *mArena;
+    RTMetaEntry                *mEntries;
+    INT32                       mCount;
+    INT32                       mCapacity;
+    RT_BOOL                     mHeapEntries;
+    RTMetaBlock                *mBlocks;
+    RTMetaBlock                *mCurrent;
+    UINT32                      mBlockUsed;
+    UINT32                      mDeadBytes;     // payload bytes no entry uses
+    RTMetaEntry                 mInlines[RT_META_INLINE_ENTRIES];
+};
+
+#endif  // SRC_RT_TASK_TASK_GRAPH_RTCOMPACTMETADATA_H_
@@ -0,0 +1,364 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *     module: RTDropAccounting
+ */
+
+#ifndef SRC_RT_TASK_TASK_GRAPH_RTDROPACCOUNTING_H_
+#define SRC_RT_TASK_TASK_GRAPH_RTDROPACCOUNTING_H_
+
+#include <stdio.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_thread.h"
+#include "RTGraphCommon.h"
+#include "RTMediaBuffer.h"
+#include "RTMediaBufferDef.h"
+#include "RTTaskGraph.h"
+
+// period of the drop log line in ms, 0 disables it.
+#define RT_DROP_LOG_ENV         "rt_drop_log_ms"
+
+typedef enum _RTDropReason {
+    RT_DROP_STREAM_FULL = 0,    // DROP_IF_FULL/ADD_IF_NOT_FULL stream was full
+    RT_DROP_BUFFER_FLAG,        // full queue, buffer flagged RT_MB_FLAG_DROP_IF_FULL
+    RT_DROP_ERR_FRAME,          // decoder error frame, opt_drop_err_frame
+    RT_DROP_LATE,               // deadline passed, RTPriorityTaskQueue drop-late
+    RT_DROP_DECIMATED,          // skipped by RTAdaptiveDecimator
+    RT_DROP_OBSERVER_OVERFLOW,  // async observer queue full
+    RT_DROP_NODE_OTHER,         // any other node internal drop
+    RT_DROP_REASON_MAX,
+} RTDropReason;
+
+static inline const char* rt_drop_reason_name(INT32 reason) {
+    static const char *kNames[RT_DROP_REASON_MAX] = {
+        "stream_full", "buffer_flag", "err_frame", "late", "decimated", "observer", "other",
+    };
+    return (reason >= 0 && reason < RT_DROP_REASON_MAX) ? kNames[reason] : "unknown";
+}
+
+/*
+ * drop counters of one stream or one node. the hot path is one relaxed
+ * atomic add, counters are never removed so the pointer stays valid for
+ * the life of the accounting.
+ */
+class RTDropCounter {
+ public:
+    RTDropCounter(const std::string &name, INT32 nodeId)
+            : mName(name),
+              mNodeId(nodeId) {
+        for (INT32 i = 0; i < RT_DROP_REASON_MAX; i++) {
+            mCounts[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void add(RTDropReason reason, INT64 count = 1) {
+        if (reason >= 0 && reason < RT_DROP_REASON_MAX) {
+            mCounts[reason].fetch_add(count, std::memory_order_relaxed);
+        }
+    }
+
+    INT64 count(RTDropReason reason) const {
+        return mCounts[reason].load(std::memory_order_relaxed);
+    }
+
+    const std::string& name() const { return mName; }
+    INT32 nodeId() const { return mNodeId; }
+
+ private:
+    const std::string   mName;
+    const INT32         mNodeId;    // RT_INVALID_NODE_ID for streams
+    std::atomic<INT64>  mCounts[RT_DROP_REASON_MAX];
+};
+
+typedef struct _RTDropEntry {
+    std::string name;
+    INT32       nodeId;
+    INT64       counts[RT_DROP_REASON_MAX];
+    INT64       total;
+} RTDropEntry;
+
+typedef struct _RTDropSnapshot {
+    INT64                       totals[RT_DROP_REASON_MAX];
+    INT64                       total;
+    std::vector<RTDropEntry>    entries;
+} RTDropSnapshot;
+
+/*
+ * drop attribution of one graph. streams and nodes ask once for their
+ * counter and add to it wherever they drop a buffer:
+ *
+ *     RTDropCounter *drops = accounting->nodeCounter(getID(), "rkmpp_dec");
+ *     ...
+ *     if (frameHasError && dropErrFrame) {
+ *         drops->add(RT_DROP_ERR_FRAME);
+ *         buffer->release();
+ *     }
+ *
+ * snapshot() sums everything up, and with RT_DROP_LOG_ENV set (or after
+ * startPeriodicLog()) a line with the drops of the last period and the
+ * stream or node that dropped most in it is logged.
+ */
+class RTDropAccounting {
+ public:
+    explicit RTDropAccounting(const char *name)
+            : mName((name != RT_NULL) ? name : "graph"),
+              mThread(RT_NULL),
+              mPeriodMs(0),
+              mRunning(RT_FALSE) {
+        rt_memset(mLastTotals, 0, sizeof(mLastTotals));
+        UINT32 periodMs = 0;
+        RT_ENV_GET_U32(RT_DROP_LOG_ENV, &periodMs, 0);
+        if (periodMs > 0) {
+            startPeriodicLog(periodMs);
+        }
+    }
+    ~RTDropAccounting() {
+        stopPeriodicLog();
+        for (size_t i = 0; i < mCounters.size(); i++) {
+            delete mCounters[i];
+        }
+    }
+
+    RTDropAccounting(const RTDropAccounting&) = delete;
+    RTDropAccounting& operator=(const RTDropAccounting&) = delete;
+
+    RTDropCounter* streamCounter(const std::string &streamName) {
+        return counterOf(streamName, RT_INVALID_NODE_ID);
+    }
+
+    RTDropCounter* nodeCounter(INT32 nodeId, const std::string &nodeName) {
+        return counterOf(nodeName, nodeId);
+    }
+
+    void snapshot(RTDropSnapshot *snapshot) {
+        RtAutoMutex autoLock(mLock);
+        rt_memset(snapshot->totals, 0, sizeof(snapshot->totals));
+        snapshot->total = 0;
+        snapshot->entries.clear();
+        for (size_t i = 0; i < mCounters.size(); i++) {
+            RTDropEntry entry;
+            entry.name   = mCounters[i]->name();
+            entry.nodeId = mCounters[i]->nodeId();
+            entry.total  = 0;
+            for (INT32 r = 0; r < RT_DROP_REASON_MAX; r++) {
+                entry.counts[r] = mCounters[i]->count((RTDropReason)r);
+                entry.total += entry.counts[r];
+                snapshot->totals[r] += entry.counts[r];
+            }
+            snapshot->total += entry.total;
+            snapshot->entries.push_back(entry);
+        }
+    }
+
+    void dump(INT32 fd = -1) {
+        RTDropSnapshot snap;
+        snapshot(&snap);
+        char line[256];
+        snprintf(line, sizeof(line), "%s drops total %lld\n", mName.c_str(), (long long)snap.total);
+        output(fd, line);
+        for (size_t i = 0; i < snap.entries.size(); i++) {
+            const RTDropEntry &entry = snap.entries[i];
+            if (entry.total == 0) {
+                continue;
+            }
+            INT32 length = snprintf(line, sizeof(line), "  %s %s(%d):",
+                                    (entry.nodeId == RT_INVALID_NODE_ID) ? "stream" : "node",
+                                    entry.name.c_str(), entry.nodeId);
+            for (INT32 r = 0; r < RT_DROP_REASON_MAX && length < (INT32)sizeof(line); r++) {
+                if (entry.counts[r] > 0) {
+                    length += snprintf(line + length, sizeof(line) - length, " %s=%lld",
+                                       rt_drop_reason_name(r), (long long)entry.counts[r]);
+                }
+            }
+            if (length < (INT32)sizeof(line) - 1) {
+                line[length++] = '\n';
+                line[length] = '\0';
+            }
+            output(fd, line);
+        }
+    }
+
+    RT_RET startPeriodicLog(UINT32 periodMs) {
+        RtAutoMutex autoLock(mLock);
+        if (mThread != RT_NULL || periodMs == 0) {
+            return RT_OK;
+        }
+        mPeriodMs = periodMs;
+        mRunning = RT_TRUE;
+        mThread = new RtThread(logLoop, this);
+        mThread->setName("drop_log");
+        mThread->start();
+        return RT_OK;
+    }
+
+    void stopPeriodicLog() {
+        {
+            RtAutoMutex autoLock(mLock);
+            if (mThread == RT_NULL) {
+                return;
+            }
+            mRunning = RT_FALSE;
+            mCondition.signal();
+        }
+        mThread->join();
+        rt_safe_delete(mThread);
+    }
+
+ private:
+    RTDropCounter* counterOf(const std::string &name, INT32 nodeId) {
+        RtAutoMutex autoLock(mLock);
+        for (size_t i = 0; i < mCounters.size(); i++) {
+            if (mCounters[i]->nodeId() == nodeId && mCounters[i]->name() == name) {
+                return mCounters[i];
+            }
+        }
+        mCounters.push_back(new RTDropCounter(name, nodeId));
+        return mCounters.back();
+    }
+
+    // one line per period, only when something was dropped.
+    void logPeriod() {
+        RTDropSnapshot snap;
+        snapshot(&snap);
+        INT64 delta[RT_DROP_REASON_MAX];
+        INT64 deltaTotal = 0;
+        for (INT32 r = 0; r < RT_DROP_REASON_MAX; r++) {
+            delta[r] = snap.totals[r] - mLastTotals[r];
+            deltaTotal += delta[r];
+            mLastTotals[r] = snap.totals[r];
+        }
+        if (deltaTotal == 0) {
+            return;
+        }
+        // entries follow mCounters, which only grows
+        const RTDropEntry *worst = RT_NULL;
+        INT64 worstDelta = 0;
+        mLastEntryTotals.resize(snap.entries.size(), 0);
+        for (size_t i = 0; i < snap.entries.size(); i++) {
+            INT64 entryDelta = snap.entries[i].total - mLastEntryTotals[i];
+            mLastEntryTotals[i] = snap.entries[i].total;
+            if (entryDelta > worstDelta) {
+                worst = &snap.entries[i];
+                worstDelta = entryDelta;
+            }
+        }
+        if (worst == RT_NULL) {
+            return;
+        }
+        RT_LOGE("%s dropped %lld in %d ms: stream_full(%lld) buffer_flag(%lld) err_frame(%lld) "
+                "late(%lld) decimated(%lld) observer(%lld) other(%lld), worst %s(%d) dropped %lld",
+                 mName.c_str(), deltaTotal, mPeriodMs,
+                 delta[RT_DROP_STREAM_FULL], delta[RT_DROP_BUFFER_FLAG], delta[RT_DROP_ERR_FRAME],
+                 delta[RT_DROP_LATE], delta[RT_DROP_DECIMATED], delta[RT_DROP_OBSERVER_OVERFLOW],
+                 delta[RT_DROP_NODE_OTHER], worst->name.c_str(), worst->nodeId, worstDelta);
+    }
+
+    static void* logLoop(void *data) {
+        RTDropAccounting *self = reinterpret_cast<RTDropAccounting *>(data);
+        while (1) {
+            {
+                RtAutoMutex autoLock(self->mLock);
+                if (self->mRunning) {
+                    self->mCondition.timedwait(self->mLock, (UINT64)self->mPeriodMs * 1000);
+                }
+                if (!self->mRunning) {
+                    break;
+                }
+            }
+            self->logPeriod();
+        }
+        return RT_NULL;
+    }
+
+    static void output(INT32 fd, const char *line) {
+        if (fd >= 0) {
+            dprintf(fd, "%s", line);
+        } else {
+            RT_LOGE("%s", line);
+        }
+    }
+
+ private:
+    std::string                     mName;
+    RtMutex                         mLock;
+    RtCondition                     mCondition;
+    std::vector<RTDropCounter *>    mCounters;
+    RtThread                       *mThread;
+    UINT32                          mPeriodMs;
+    RT_BOOL                         mRunning;
+    INT64                           mLastTotals[RT_DROP_REASON_MAX];
+    std::vector<INT64>              mLastEntryTotals;   // per counter, at the last period
+};
+
+/*
+ * task graph that attributes the drops of its input streams. a packet the
+ * graph refuses because the stream is full is counted as RT_DROP_BUFFER_FLAG
+ * when the buffer carries RT_MB_FLAG_DROP_IF_FULL and as RT_DROP_STREAM_FULL
+ * otherwise; other errors (unknown stream, graph not started) are no drops.
+ * nodes report through dropAccounting(), RTPriorityTaskQueue and
+ * RTAdaptiveDecimator through setDropCounter().
+ *
+ * RTTaskGraphStat is opaque, the drops come with the queryStat() overload
+ * that also fills an RTDropSnapshot. RTTaskGraph::dump() is not virtual,
+ * dumpDrops() logs them next to it.
+ */
+class RTDropAccountingGraph : public RTTaskGraph {
+ public:
+    explicit RTDropAccountingGraph(const char *tagName)
+            : RTTaskGraph(tagName),
+              mDrops(tagName) {}
+    RTDropAccountingGraph(UINT64 uid, const char *tagName)
+            : RTTaskGraph(uid, tagName),
+              mDrops(tagName) {}
+    virtual ~RTDropAccountingGraph() {}
+
+    RTDropAccounting* dropAccounting() { return &mDrops; }
+
+    using RTTaskGraph::queryStat;
+    RT_RET queryStat(RTTaskGraphStat *stat, RTDropSnapshot *drops) {
+        mDrops.snapshot(drops);
+        return (stat != RT_NULL) ? RTTaskGraph::queryStat(stat) : RT_OK;
+    }
+
+    RT_RET dumpDrops(INT32 fd = -1) {
+        mDrops.dump(fd);
+        return RT_OK;
+    }
+
+ protected:
+    RT_RET addPacketToInputStream(std::string streamName, INT64 timeoutUs, RTMediaBuffer *packet) {
+        RT_BOOL flagged = (packet != RT_NULL && packet->hasFlag(RT_MB_FLAG_DROP_IF_FULL));
+        RT_RET ret = RTTaskGraph::addPacketToInputStream(streamName, timeoutUs, packet);
+        if (isStreamFull(ret)) {
+            mDrops.streamCounter(streamName)->add(flagged ? RT_DROP_BUFFER_FLAG : RT_DROP_STREAM_FULL);
+        }
+        return ret;
+    }
+
+ private:
+    // full queue, or no room within timeoutUs in WAIT_TILL_NOT_FULL mode.
+    static RT_BOOL isStreamFull(RT_RET ret) {
+        return (ret == RT_ERR_LIST_FULL || ret == RT_ERR_NO_BUFFER
+                || ret == RT_ERR_RETRY || ret == RT_ERR_TIMEOUT) ? RT_TRUE : RT_FALSE;
+    }
+
+    RTDropAccounting    mDrops;
+};
+
+#endif  // SRC_RT_TASK_TASK_GRAPH_RTDROPACCOUNTING_H_
@@ -0,0 +1,400 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: RTFastStartPlayer
+ */
+
+#ifndef SRC_RT_PLAYER_RTFASTSTARTPLAYER_H_
+#define SRC_RT_PLAYER_RTFASTSTARTPLAYER_H_
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <functional>
+#include <string>
+
+#include "rt_header.h"                  // NOLINT
+#include "rt_message.h"                 // NOLINT
+#include "rt_metadata.h"                // NOLINT
+#include "rt_thread.h"                  // NOLINT
+#include "RTMediaMetaKeys.h"            // NOLINT
+#include "RTMediaPlayer.h"              // NOLINT
+#include "RTPhaseProfiler.h"            // NOLINT
+#include "RTPlayerDef.h"                // NOLINT
+
+// head of a local file read ahead while the player builds its pipeline.
+#define RT_FAST_START_READAHEAD_SIZE    (4 * 1024 * 1024)
+
+/*
+ * runs on its own thread during prepare and creates the sinks, e.g. opens
+ * the display and audio device. it must not touch the player, a sink left
+ * RT_NULL is not set.
+ */
+typedef std::function<rt_status(const void **videoSink, const void **audioSink)> RTSinkSetup;
+
+/*
+ * RTMediaPlayer with a startup latency mode for channel switching:
+ *
+ *  - setFastStart(RT_TRUE), called before setDataSource(), reads the head
+ *    of a local source into the page cache on a helper thread while the
+ *    player probes the container, so probing does not wait on cold
+ *    storage. it also turns A/V sync off until the first frame was
+ *    rendered, so the first decoded keyframe goes to the screen as it is.
+ *    the first frame notify only marks sync for restore, the next call
+ *    into the player from the application thread (start, pause, seekTo,
+ *    wait, getState, getCurrentPosition, ...) turns it back on.
+ *  - the sinks of setSinkSetup() are created concurrently with prepare().
+ *    RTMediaPlayer is not safe to call from two threads, so start() joins
+ *    the setup and sets the sinks on the calling thread before playback.
+ *
+ * every call is timed. dump(fd, args) prints the startup breakdown after
+ * the regular player dump; "startup" as args prints only the breakdown.
+ */
+class RTFastStartPlayer : public RTMediaPlayer {
+ public:
+    RTFastStartPlayer()
+            : mProfiler("player"),
+              mListener(RT_NULL),
+              mProxy(this),
+              mFastStart(RT_FALSE),
+              mSinkThread(RT_NULL),
+              mSinkRet(RT_OK),
+              mSinkUs(0),
+              mVideoSink(RT_NULL),
+              mAudioSink(RT_NULL),
+              mReadaheadThread(RT_NULL),
+              mReadaheadFd(-1),
+              mReadaheadOffset(0),
+              mReadaheadUs(0),
+              mPrepareUs(0),
+              mStartUs(0),
+              mPreparedUs(0),
+              mFirstFrameUs(0),
+              mSyncOff(RT_FALSE),
+              mSyncRestore(RT_FALSE) {
+        RTMediaPlayer::setListener(&mProxy);
+    }
+    ~RTFastStartPlayer() {
+        joinSinkSetup();
+        joinReadahead();
+    }
+
+    void setFastStart(RT_BOOL enable) { mFastStart = enable; }
+    void setSinkSetup(RTSinkSetup setup) { mSinkSetup = setup; }
+
+    virtual rt_status setListener(RTPlayerListener *listener) {
+        mListener = listener;
+        return RT_OK;
+    }
+
+    using RTMediaPlayer::setDataSource;
+    virtual rt_status setDataSource(const char *url, const char *headers) {
+        resetStartup();
+        mProfiler.begin("set_data_source");
+        if (mFastStart && url != RT_NULL && (url[0] == '/' || strncmp(url, "file://", 7) == 0)) {
+            startReadahead(::open((url[0] == '/') ? url : url + 7, O_RDONLY | O_CLOEXEC), 0);
+        }
+        rt_status ret = RTMediaPlayer::setDataSource(url, headers);
+        mProfiler.end();
+        return ret;
+    }
+
+    virtual rt_status setDataSource(INT32 fd, INT64 offset, INT64 length) {
+        resetStartup();
+        mProfiler.begin("set_data_source");
+        if (mFastStart) {
+            startReadahead(dup(fd), offset);
+        }
+        rt_status ret = RTMediaPlayer::setDataSource(fd, offset, length);
+        mProfiler.end();
+        return ret;
+    }
+
+    virtual rt_status prepare() {
+        beginPrepare();
+        rt_status ret = RTMediaPlayer::prepare();
+        mProfiler.end();
+        return ret;
+    }
+
+    // the "prepare" phase runs until RT_MEDIA_PREPARED arrives.
+    virtual rt_status prepareAsync() {
+        beginPrepare();
+        return RTMediaPlayer::prepareAsync();
+    }
+
+    virtual rt_status start() {
+        applySync();
+        mProfiler.begin("sink_join");
+        rt_status ret = joinSinkSetup();
+        if (ret != RT_OK) {
+            RT_LOGE("fast start sink setup failed, ret = %d", ret);
+        }
+        attachSinks();
+        mProfiler.begin("start_to_first_frame");
+        mStartUs = RtTime::getNowTimeUs();
+        return RTMediaPlayer::start();
+    }
+
+    virtual rt_status reset() {
+        joinSinkSetup();
+        joinReadahead();
+        mSyncRestore = RT_FALSE;
+        restoreSync();
+        return RTMediaPlayer::reset();
+    }
+
+    virtual rt_status seekTo(INT64 usec) {
+        applySync();
+        return RTMediaPlayer::seekTo(usec);
+    }
+
+    virtual rt_status stop() {
+        applySync();
+        return RTMediaPlayer::stop();
+    }
+
+    virtual rt_status pause() {
+        applySync();
+        return RTMediaPlayer::pause();
+    }
+
+    // a first frame rendered while blocked here is handled on the next call.
+    virtual rt_status wait(INT64 timeUs = 0) {
+        applySync();
+        return RTMediaPlayer::wait(timeUs);
+    }
+
+    virtual rt_status getState() {
+        applySync();
+        return RTMediaPlayer::getState();
+    }
+
+    virtual rt_status getCurrentPosition(INT64 *usec) {
+        applySync();
+        return RTMediaPlayer::getCurrentPosition(usec);
+    }
+
+    virtual rt_status getDuration(INT64 *usec) {
+        applySync();
+        return RTMediaPlayer::getDuration(usec);
+    }
+
+    virtual rt_status invoke(RtMetaData *request, RtMetaData *reply) {
+        applySync();
+        return RTMediaPlayer::invoke(request, reply);
+    }
+
+    virtual rt_status setParameter(INT32 key, RtMetaData *request) {
+        applySync();
+        return RTMediaPlayer::setParameter(key, request);
+    }
+
+    virtual rt_status getParameter(INT32 key, RtMetaData *reply) {
+        applySync();
+        return RTMediaPlayer::getParameter(key, reply);
+    }
+
+    virtual rt_status dump(INT32 fd, const char *args) {
+        rt_status ret = RT_OK;
+        applySync();
+        if (args == RT_NULL || strcmp(args, "startup") != 0) {
+            ret = RTMediaPlayer::dump(fd, args);
+        }
+        mProfiler.dump(fd);
+        char line[256];
+        snprintf(line, sizeof(line),
+                 "  concurrent: readahead %lld us, sink setup %lld us; prepared at %lld us, "
+                 "first frame at %lld us after start%s\n",
+                 (long long)mReadaheadUs, (long long)mSinkUs,
+                 (long long)((mPreparedUs > 0) ? mPreparedUs - mPrepareUs : 0),
+                 (long long)((mFirstFrameUs > 0) ? mFirstFrameUs - mStartUs : 0),
+                 mFastStart ? ", fast start" : "");
+        if (fd >= 0) {
+            dprintf(fd, "%s", line);
+        } else {
+            RT_LOGE("%s", line);
+        }
+        return ret;
+    }
+
+ private:
+    class RTStartupListener : public RTPlayerListener {
+     public:
+        explicit RTStartupListener(RTFastStartPlayer *player) : mPlayer(player) {}
+        void notify(INT32 msg, INT32 ext1, INT32 ext2, void *ptr) {
+            mPlayer->onNotify(msg, ext1, ext2, ptr);
+        }
+     private:
+        RTFastStartPlayer *mPlayer;
+    };
+
+    void onNotify(INT32 msg, INT32 ext1, INT32 ext2, void *ptr) {
+        if (msg == RT_MEDIA_PREPARED && mPreparedUs == 0) {
+            mPreparedUs = RtTime::getNowTimeUs();
+            mProfiler.end();
+        } else if (msg == RT_MEDIA_INFO && ext1 == RT_INFO_RENDERING_START && mFirstFrameUs == 0) {
+            mFirstFrameUs = RtTime::getNowTimeUs();
+            mProfiler.end();
+            // the notify thread never calls into the player
+            mSyncRestore = RT_TRUE;
+        }
+        if (mListener != RT_NULL) {
+            mListener->notify(msg, ext1, ext2, ptr);
+        }
+    }
+
+    void resetStartup() {
+        mProfiler.reset();
+        mPrepareUs = mStartUs = mPreparedUs = mFirstFrameUs = 0;
+        mSinkUs = mReadaheadUs = 0;
+        mSinkRet = RT_OK;
+    }
+
+    void beginPrepare() {
+        mProfiler.begin("prepare");
+        mPrepareUs = RtTime::getNowTimeUs();
+        if (mFastStart) {
+            setSync(RT_FALSE);
+        }
+        if (mSinkSetup && mSinkThread == RT_NULL) {
+            mVideoSink = mAudioSink = RT_NULL;
+            mSinkRet = RT_OK;
+            mSinkThread = new RtThread(sinkSetupLoop, this);
+            mSinkThread->setName("fast_start_sink");
+            mSinkThread->start();
+        }
+    }
+
+    // user-level sync switch of the player, failures leave sync as it is.
+    void setSync(RT_BOOL enable) {
+        RtMetaData request;
+        request.setInt32(kKeyUserMediaSyncNone, enable ? 0 : 1);
+        if (RTMediaPlayer::setParameter(kKeyUserMediaSync, &request) == RT_OK) {
+            mSyncOff = !enable;
+        }
+    }
+
+    void restoreSync() {
+        if (mSyncOff) {
+            setSync(RT_TRUE);
+        }
+    }
+
+    // caller thread side of the first frame notify.
+    void applySync() {
+        if (mSyncRestore.exchange(RT_FALSE)) {
+            restoreSync();
+        }
+    }
+
+    // the result of the last setup, reported once.
+    rt_status joinSinkSetup() {
+        if (mSinkThread != RT_NULL) {
+            mSinkThread->join();
+            rt_safe_delete(mSinkThread);
+        }
+        rt_status ret = mSinkRet;
+        mSinkRet = RT_OK;
+        return ret;
+    }
+
+    // the sinks of a finished setup, once.
+    void attachSinks() {
+        if (mVideoSink != RT_NULL) {
+            RTMediaPlayer::setVideoSink(mVideoSink);
+        }
+        if (mAudioSink != RT_NULL) {
+            RTMediaPlayer::setAudioSink(mAudioSink);
+        }
+        mVideoSink = mAudioSink = RT_NULL;
+    }
+
+    static void* sinkSetupLoop(void *data) {
+        RTFastStartPlayer *self = reinterpret_cast<RTFastStartPlayer *>(data);
+        UINT64 begin = RtTime::getNowTimeUs();
+        self->mSinkRet = self->mSinkSetup(&self->mVideoSink, &self->mAudioSink);
+        self->mSinkUs = (INT64)(RtTime::getNowTimeUs() - begin);
+        return RT_NULL;
+    }
+
+    // takes ownership of fd.
+    void startReadahead(INT32 fd, INT64 offset) {
+        joinReadahead();
+        if (fd < 0) {
+            return;
+        }
+        mReadaheadFd = fd;
+        mReadaheadOffset = offset;
+        mReadaheadThread = new RtThread(readaheadLoop, this);
+        mReadaheadThread->setName("fast_start_ra");
+        mReadaheadThread->start();
+    }
+
+    void joinReadahead() {
+        if (mReadaheadThread != RT_NULL) {
+            mReadaheadThread->join();
+            rt_safe_delete(mReadaheadThread);
+        }
+    }
+
+    static void* readaheadLoop(void *data) {
+        RTFastStartPlayer *self = reinterpret_cast<RTFastStartPlayer *>(data);
+        UINT64 begin = RtTime::getNowTimeUs();
+        posix_fadvise(self->mReadaheadFd, self->mReadaheadOffset,
+                      RT_FAST_START_READAHEAD_SIZE, POSIX_FADV_WILLNEED);
+        // fadvise is only a hint, reading makes sure the pages are there.
+        char buffer[64 * 1024];
+        INT64 offset = self->mReadaheadOffset;
+        INT64 end = offset + RT_FAST_START_READAHEAD_SIZE;
+        while (offset < end) {
+            ssize_t size = pread(self->mReadaheadFd, buffer, sizeof(buffer), offset);
+            if (size <= 0) {
+                break;
+            }
+            offset += size;
+        }
+        ::close(self->mReadaheadFd);
+        self->mReadaheadFd = -1;
+        self->mReadaheadUs = (INT64)(RtTime::getNowTimeUs() - begin);
+        return RT_NULL;
+    }
+
+ private:
+    RTPhaseProfiler     mProfiler;
+    RTPlayerListener   *mListener;
+    RTStartupListener   mProxy;
+    RT_BOOL             mFastStart;
+    RTSinkSetup         mSinkSetup;
+    RtThread           *mSinkThread;
+    rt_status           mSinkRet;
+    INT64               mSinkUs;
+    const void         *mVideoSink;
+    const void         *mAudioSink;
+    RtThread           *mReadaheadThread;
+    INT32               mReadaheadFd;
+    INT64               mReadaheadOffset;
+    INT64               mReadaheadUs;
+    UINT64              mPrepareUs;
+    UINT64              mStartUs;
+    UINT64              mPreparedUs;
+    UINT64              mFirstFrameUs;
+    RT_BOOL             mSyncOff;
+    std::atomic<RT_BOOL> mSyncRestore;
+};
+
+#endif  // SRC_RT_PLAYER_RTFASTSTARTPLAYER_H_
@@ -0,0 +1,426 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *     module: RTGraphReconfigurator
+ */
+
+#ifndef SRC_RT_TASK_TASK_GRAPH_RTGRAPHRECONFIGURATOR_H_
+#define SRC_RT_TASK_TASK_GRAPH_RTGRAPHRECONFIGURATOR_H_
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rt_header.h"
+#include "RTNodeCommon.h"
+#include "RTTaskGraph.h"
+#include "RTTaskNode.h"
+
+#define RT_RECONFIG_DRAIN_TIMEOUT_US    (100 * 1000)
+#define RT_RECONFIG_DRAIN_POLL_US       1000
+
+// src node id -> dst node id
+typedef std::pair<INT32, INT32> RTLinkEdge;
+
+/*
+ * edges of a link ship such as "1,3,6,7-6,10": chains are split by '-',
+ * every pair of neighbours in a chain is one edge, so the example gives
+ * 1->3, 3->6, 6->7 and 6->10.
+ */
+class RTLinkShipDiff {
+ public:
+    static void parse(const std::string &linkShip, std::set<RTLinkEdge> *edges) {
+        size_t begin = 0;
+        while (begin <= linkShip.size()) {
+            size_t end = linkShip.find('-', begin);
+            if (end == std::string::npos) {
+                end = linkShip.size();
+            }
+            parseChain(linkShip.substr(begin, end - begin), edges);
+            begin = end + 1;
+        }
+    }
+
+    // every node a link ship references, also the ones of single node chains.
+    static void nodesOf(const std::string &linkShip, std::set<INT32> *nodes) {
+        const char *str = linkShip.c_str();
+        while (*str != '\0') {
+            char *end = RT_NULL;
+            INT32 nodeId = (INT32)strtol(str, &end, 10);
+            if (end == str) {
+                str++;
+                continue;
+            }
+            nodes->insert(nodeId);
+            str = end;
+        }
+    }
+
+    static void diff(const std::set<RTLinkEdge> &current, const std::set<RTLinkEdge> &target,
+                     std::vector<RTLinkEdge> *added, std::vector<RTLinkEdge> *removed) {
+        added->clear();
+        removed->clear();
+        std::set_difference(target.begin(), target.end(), current.begin(), current.end(),
+                            std::back_inserter(*added));
+        std::set_difference(current.begin(), current.end(), target.begin(), target.end(),
+                            std::back_inserter(*removed));
+    }
+
+ private:
+    static void parseChain(const std::string &chain, std::set<RTLinkEdge> *edges) {
+        INT32 last = RT_INVALID_NODE_ID;
+        const char *str = chain.c_str();
+        while (*str != '\0') {
+            char *end = RT_NULL;
+            INT32 nodeId = (INT32)strtol(str, &end, 10);
+            if (end == str) {
+                str++;
+                continue;
+            }
+            if (last != RT_INVALID_NODE_ID) {
+                edges->insert(RTLinkEdge(last, nodeId));
+            }
+            last = nodeId;
+            str = end;
+        }
+    }
+};
+
+typedef enum _RTReconfigOp {
+    RT_RECONFIG_LINK = 0,
+    RT_RECONFIG_UNLINK,
+    RT_RECONFIG_DRAIN,     // waits until dst consumed what src queued before the unlink
+} RTReconfigOp;
+
+typedef struct _RTReconfigStep {
+    RTReconfigOp    op;
+    RTLinkEdge      edge;
+} RTReconfigStep;
+
+typedef struct _RTReconfigStat {
+    INT32   added;          // edges linked
+    INT32   removed;        // edges drained and unlinked
+    INT32   kept;           // edges untouched, their branches kept streaming
+    INT32   drainTimeouts;  // removed edges unlinked with data still queued
+    INT32   replaced;       // destinations that changed their producer
+    RT_BOOL fallback;       // full clearLinkShips()/selectLinkMode() was used
+    INT64   drainUs;
+    INT64   maxBreakUs;     // longest time a replaced destination had no producer
+    INT64   totalUs;
+} RTReconfigStat;
+
+/*
+ * task graph that switches link modes without the pause/flush cycle.
+ * the link ship of the selected modes is diffed against the target ones,
+ * edges present in both sets are never touched. every removed edge is
+ * unlinked first, so src stops feeding it, and then waits until dst
+ * consumed what was already queued; frames in flight finish and the
+ * rewire happens between two buffers.
+ *
+ * a new edge into a node no edge is removed from is linked first, the new
+ * branch is ready before the old one goes. a node that swaps producers,
+ * 0->7 replaced by 6->7, is rewired break before make instead, so it never
+ * has two producers at once; the gap shows up as maxBreakUs, and as lost
+ * frames in an RTGlitchMeter on the output stream.
+ *
+ * edges that reference nodes this graph does not own (graph input streams,
+ * nodes of sub graphs) fall back to the regular clearLinkShips() and
+ * selectLinkMode() path.
+ */
+class RTReconfigurableGraph : public RTTaskGraph {
+ public:
+    explicit RTReconfigurableGraph(const char *tagName)
+            : RTTaskGraph(tagName),
+              mDrainTimeoutUs(RT_RECONFIG_DRAIN_TIMEOUT_US) {}
+    RTReconfigurableGraph(UINT64 uid, const char *tagName)
+            : RTTaskGraph(uid, tagName),
+              mDrainTimeoutUs(RT_RECONFIG_DRAIN_TIMEOUT_US) {}
+    virtual ~RTReconfigurableGraph() {}
+
+    void setDrainTimeout(INT64 timeoutUs) { mDrainTimeoutUs = timeoutUs; }
+
+    // replaces one selected mode by another, e.g. "uvc" -> "uvc_zoom".
+    RT_RET switchLinkMode(const std::string &from, const std::string &to,
+                          RTReconfigStat *stat = RT_NULL) {
+        std::vector<std::string> modes;
+        for (size_t i = 0; i < mLinkModes.size(); i++) {
+            if (mLinkModes[i] != from) {
+                modes.push_back(mLinkModes[i]);
+            }
+        }
+        if (std::find(modes.begin(), modes.end(), to) == modes.end()) {
+            modes.push_back(to);
+        }
+        return reconfigure(modes, stat);
+    }
+
+    RT_RET reconfigure(const std::vector<std::string> &modes, RTReconfigStat *stat = RT_NULL) {
+        RtAutoMutex autoLock(mReconfigLock);
+        RTReconfigStat result;
+        rt_memset(&result, 0, sizeof(RTReconfigStat));
+        UINT64 begin = RtTime::getNowTimeUs();
+
+        std::set<RTLinkEdge> current;
+        std::set<RTLinkEdge> target;
+        for (size_t i = 0; i < modes.size(); i++) {
+            if (mLinkShips.find(modes[i]) == mLinkShips.end()) {
+                RT_LOGE("%s link mode %s not found", mTagName.c_str(), modes[i].c_str());
+                return RT_ERR_VALUE;
+            }
+            RTLinkShipDiff::parse(mLinkShips[modes[i]], &target);
+        }
+        for (size_t i = 0; i < mLinkModes.size(); i++) {
+            RTLinkShipDiff::parse(mLinkShips[mLinkModes[i]], &current);
+        }
+
+        std::vector<RTLinkEdge> added;
+        std::vector<RTLinkEdge> removed;
+        RTLinkShipDiff::diff(current, target, &added, &removed);
+        result.added   = (INT32)added.size();
+        result.removed = (INT32)removed.size();
+        result.kept    = (INT32)(target.size() - added.size());
+
+        RT_RET ret = RT_OK;
+        if (!ownsEdges(added) || !ownsEdges(removed)) {
+            result.fallback = RT_TRUE;
+            ret = clearLinkShips();
+            for (size_t i = 0; i < modes.size() && ret == RT_OK; i++) {
+                ret = selectLinkMode(modes[i]);
+            }
+        } else {
+            std::vector<RTReconfigStep> steps;
+            result.replaced = plan(added, removed, &steps);
+            std::map<RTLinkEdge, std::string> streamTypes;
+            std::map<INT32, UINT64> breakBegin;
+            for (size_t i = 0; i < steps.size() && ret == RT_OK; i++) {
+                RTTaskNode *src = mNodes[steps[i].edge.first];
+                RTTaskNode *dst = mNodes[steps[i].edge.second];
+                if (steps[i].op == RT_RECONFIG_UNLINK) {
+                    // the input of a fan-in node is only known while src is linked.
+                    RTTaskNodeContext *context = dst->getDefaultNodeContext();
+                    if (context != RT_NULL) {
+                        streamTypes[steps[i].edge] = edgeStreamType(src, dst, context);
+                    }
+                    ret = unlinkNode(src, dst);
+                    if (breakBegin.find(dst->getID()) == breakBegin.end()) {
+                        breakBegin[dst->getID()] = RtTime::getNowTimeUs();
+                    }
+                } else if (steps[i].op == RT_RECONFIG_DRAIN) {
+                    UINT64 drainBegin = RtTime::getNowTimeUs();
+                    if (!drain(dst, streamTypes[steps[i].edge])) {
+                        result.drainTimeouts++;
+                    }
+                    result.drainUs += (INT64)(RtTime::getNowTimeUs() - drainBegin);
+                } else {
+                    ret = linkNode(src, dst);
+                    if (breakBegin.find(dst->getID()) != breakBegin.end()) {
+                        INT64 breakUs = (INT64)(RtTime::getNowTimeUs() - breakBegin[dst->getID()]);
+                        if (breakUs > result.maxBreakUs) {
+                            result.maxBreakUs = breakUs;
+                        }
+                    }
+                }
+            }
+            if (ret == RT_OK) {
+                mLinkModes = modes;
+            }
+        }
+
+        result.totalUs = (INT64)(RtTime::getNowTimeUs() - begin);
+        RT_LOGD("%s reconfigure added(%d) removed(%d) kept(%d) replaced(%d) drain(%lld us) "
+                "break(%lld us) total(%lld us)%s",
+                 mTagName.c_str(), result.added, result.removed, result.kept, result.replaced,
+                 result.drainUs, result.maxBreakUs, result.totalUs,
+                 result.fallback ? " fallback" : "");
+        if (stat != RT_NULL) {
+            *stat = result;
+        }
+        return ret;
+    }
+
+    /*
+     * order of the rewire, returns the destinations that swap producers.
+     * new edges into other nodes are linked first, then every removed edge
+     * is unlinked and drained, the new producers of swapped nodes last.
+     */
+    static INT32 plan(const std::vector<RTLinkEdge> &added, const std::vector<RTLinkEdge> &removed,
+                      std::vector<RTReconfigStep> *steps) {
+        std::set<INT32> replaced;
+        for (size_t i = 0; i < removed.size(); i++) {
+            for (size_t j = 0; j < added.size(); j++) {
+                if (added[j].second == removed[i].second) {
+                    replaced.insert(removed[i].second);
+                }
+            }
+        }
+        steps->clear();
+        for (size_t i = 0; i < added.size(); i++) {
+            if (replaced.find(added[i].second) == replaced.end()) {
+                steps->push_back({ RT_RECONFIG_LINK, added[i] });
+            }
+        }
+        for (size_t i = 0; i < removed.size(); i++) {
+            steps->push_back({ RT_RECONFIG_UNLINK, removed[i] });
+        }
+        for (size_t i = 0; i < removed.size(); i++) {
+            steps->push_back({ RT_RECONFIG_DRAIN, removed[i] });
+        }
+        for (size_t i = 0; i < added.size(); i++) {
+            if (replaced.find(added[i].second) != replaced.end()) {
+                steps->push_back({ RT_RECONFIG_LINK, added[i] });
+            }
+        }
+        return (INT32)replaced.size();
+    }
+
+ private:
+    RT_BOOL ownsEdges(const std::vector<RTLinkEdge> &edges) {
+        for (size_t i = 0; i < edges.size(); i++) {
+            if (mNodes.find(edges[i].first) == mNodes.end()
+                    || mNodes.find(edges[i].second) == mNodes.end()) {
+                return RT_FALSE;
+            }
+        }
+        return RT_TRUE;
+    }
+
+    /*
+     * the input stream of dst fed by src. a fan-in node names its inputs
+     * stream_input_<n> in the order of its sources; when that does not
+     * resolve, e.g. a single input node, the whole input is used.
+     */
+    std::string edgeStreamType(RTTaskNode *src, RTTaskNode *dst, RTTaskNodeContext *context) {
+        const std::vector<INT32> &sources = dst->getStreamSource();
+        RtMetaData *options = dst->getOptions();
+        if (sources.size() <= 1 || options == RT_NULL) {
+            return "none";
+        }
+        for (size_t i = 0; i < sources.size(); i++) {
+            if (sources[i] != src->getID()) {
+                continue;
+            }
+            const char *streamType = RT_NULL;
+            std::string key = KEY_ROOT_INPUT_STREAM_ID + std::to_string(i);
+            if (options->findCString(key.c_str(), &streamType) && context->hasInputStream(streamType)) {
+                return streamType;
+            }
+        }
+        return "none";
+    }
+
+    // waits until dst consumed its input, src must be unlinked. RT_FALSE on timeout.
+    RT_BOOL drain(RTTaskNode *dst, const std::string &streamType) {
+        RTTaskNodeContext *context = dst->getDefaultNodeContext();
+        if (context == RT_NULL) {
+            return RT_TRUE;
+        }
+        UINT64 deadline = RtTime::getNowTimeUs() + mDrainTimeoutUs;
+        while (!context->inputIsEmpty(streamType)) {
+            if (RtTime::getNowTimeUs() >= deadline) {
+                return RT_FALSE;
+            }
+            usleep(RT_RECONFIG_DRAIN_POLL_US);
+        }
+        return RT_TRUE;
+    }
+
+ private:
+    RtMutex     mReconfigLock;
+    INT64       mDrainTimeoutUs;
+};
+
+typedef struct _RTGlitchStat {
+    INT64   frames;         // frames seen inside the window
+    INT64   lostFrames;     // estimated from the gaps and the nominal interval
+    INT64   maxGapUs;       // largest inter-frame gap inside the window
+    INT64   intervalUs;     // nominal interval used for the estimate
+    INT64   windowUs;
+} RTGlitchStat;
+
+/*
+ * measures the glitch a reconfiguration causes on one output stream. call
+ * onFrame() from the observeOutputStream() callback, open a window right
+ * before reconfigure() and close it once the stream settled again.
+ */
+class RTGlitchMeter {
+ public:
+    // intervalUs 0 learns the frame interval from the stream itself.
+    explicit RTGlitchMeter(INT64 intervalUs = 0)
+            : mFixedInterval(intervalUs > 0),
+              mIntervalUs(intervalUs),
+              mLastUs(0),
+              mInWindow(RT_FALSE),
+              mWindowBeginUs(0) {
+        rt_memset(&mStat, 0, sizeof(RTGlitchStat));
+    }
+
+    void onFrame() {
+        RtAutoMutex autoLock(mLock);
+        UINT64 now = RtTime::getNowTimeUs();
+        if (mLastUs > 0) {
+            INT64 gap = (INT64)(now - mLastUs);
+            if (mInWindow) {
+                mStat.frames++;
+                if (gap > mStat.maxGapUs) {
+                    mStat.maxGapUs = gap;
+                }
+                if (mIntervalUs > 0) {
+                    INT64 missed = (gap + mIntervalUs / 2) / mIntervalUs - 1;
+                    mStat.lostFrames += (missed > 0) ? missed : 0;
+                }
+            } else if (!mFixedInterval) {
+                // 1/8 weight, frames before the window are the reference.
+                mIntervalUs = (mIntervalUs == 0) ? gap : mIntervalUs + (gap - mIntervalUs) / 8;
+            }
+        }
+        mLastUs = now;
+    }
+
+    void beginWindow() {
+        RtAutoMutex autoLock(mLock);
+        rt_memset(&mStat, 0, sizeof(RTGlitchStat));
+        mInWindow = RT_TRUE;
+        mWindowBeginUs = RtTime::getNowTimeUs();
+    }
+
+    void endWindow(RTGlitchStat *stat) {
+        RtAutoMutex autoLock(mLock);
+        mInWindow = RT_FALSE;
+        mStat.intervalUs = mIntervalUs;
+        mStat.windowUs = (INT64)(RtTime::getNowTimeUs() - mWindowBeginUs);
+        if (stat != RT_NULL) {
+            *stat = mStat;
+        }
+        RT_LOGD("glitch frames(%lld) lost(%lld) max-gap(%lld us) interval(%lld us) window(%lld us)",
+                 mStat.frames, mStat.lostFrames, mStat.maxGapUs, mStat.intervalUs, mStat.windowUs);
+    }
+
+ private:
+    RtMutex         mLock;
+    const RT_BOOL   mFixedInterval;
+    INT64           mIntervalUs;
+    UINT64          mLastUs;
+    RT_BOOL         mInWindow;
+    UINT64          mWindowBeginUs;
+    RTGlitchStat    mStat;
+};
+
+#endif  // SRC_RT_TASK_TASK_GRAPH_RTGRAPHRECONFIGURATOR_H_
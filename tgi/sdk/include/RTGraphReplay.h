@@ -0,0 +1,681 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *     module: RTGraphReplay
+ */
+
+#ifndef SRC_RT_TASK_TASK_GRAPH_RTGRAPHREPLAY_H_
+#define SRC_RT_TASK_TASK_GRAPH_RTGRAPHREPLAY_H_
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_metadata.h"
+#include "RTMediaBuffer.h"
+#include "RTMediaMetaKeys.h"
+#include "RTTaskGraph.h"
+
+#define RT_REPLAY_MAGIC         MKTAG('r', 't', 'r', 'p')
+#define RT_REPLAY_RECORD_MAGIC  MKTAG('r', 'r', 'e', 'c')
+#define RT_REPLAY_VERSION       1
+#define RT_REPLAY_ALIGN(x)      (((x) + 7) & ~7)
+#define RT_REPLAY_DRAIN_US      (5 * 1000 * 1000)
+
+typedef enum _RTReplayRecordType {
+    RT_REPLAY_RECORD_STREAM = 1,    // declares a stream, data is the name
+    RT_REPLAY_RECORD_BUFFER,
+} RTReplayRecordType;
+
+typedef enum _RTReplayDirection {
+    RT_REPLAY_INPUT = 0,            // packet queued to a graph input stream
+    RT_REPLAY_OUTPUT,               // buffer seen on an observed output stream
+} RTReplayDirection;
+
+typedef enum _RTReplayTiming {
+    RT_REPLAY_ORIGINAL = 0,         // same spacing as recorded
+    RT_REPLAY_FASTEST,              // as fast as the graph accepts them
+} RTReplayTiming;
+
+typedef struct _RTReplayFileHeader {
+    UINT32  magic;
+    UINT32  version;
+    INT64   createUs;
+} RTReplayFileHeader;
+
+/*
+ * every record is 8 byte aligned: this header, dataSize bytes of data, then
+ * metaCount entries of RTReplayMetaEntry each followed by its value.
+ */
+typedef struct _RTReplayRecordHeader {
+    UINT32  magic;
+    UINT16  type;
+    UINT16  streamId;
+    UINT32  dataSize;
+    UINT32  metaCount;
+    INT64   timeUs;         // since the first record
+    UINT32  direction;
+    UINT32  recordSize;     // header, data and meta, aligned
+} RTReplayRecordHeader;
+
+typedef struct _RTReplayMetaEntry {
+    UINT64  key;
+    UINT32  type;
+    UINT32  size;
+} RTReplayMetaEntry;
+
+typedef struct _RTReplayEntry {
+    UINT16                      streamId;
+    RTReplayDirection           direction;
+    INT64                       timeUs;
+    void                       *data;       // points into the mapped file
+    UINT32                      dataSize;
+    UINT32                      metaCount;
+    const RTReplayMetaEntry    *meta;       // first entry, walk with nextMeta()
+} RTReplayEntry;
+
+/*
+ * writes the buffers of a graph run to a container file. the buffer
+ * metadata has no iterator, so only the keys given to setMetaKeys() are
+ * stored (frame size, timestamps and eos by default); pointer values are
+ * never stored. a record that cannot be written completely is cut off
+ * again and the writer stops, the file ends with the last whole record.
+ */
+class RTReplayWriter {
+ public:
+    RTReplayWriter() : mFd(-1), mFailed(RT_FALSE), mBeginUs(0), mSize(0), mRecords(0), mBytes(0) {
+        static const UINT64 kDefaultKeys[] = {
+            kKeyFrameW, kKeyFrameH, kKeyFrameType, kKeyFramePts, kKeyFrameDts,
+            kKeyFrameEOS, kKeyFrameDuration, kKeyFrameSequence,
+            kKeyPacketPts, kKeyPacketDts, kKeyPacketFlag, kKeyPacketEOS,
+        };
+        mMetaKeys.assign(kDefaultKeys, kDefaultKeys + sizeof(kDefaultKeys) / sizeof(kDefaultKeys[0]));
+    }
+    ~RTReplayWriter() { close(); }
+
+    RTReplayWriter(const RTReplayWriter&) = delete;
+    RTReplayWriter& operator=(const RTReplayWriter&) = delete;
+
+    // a file still open is closed first.
+    RT_RET open(const char *path) {
+        RtAutoMutex autoLock(mLock);
+        closeLocked();
+        mFd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (mFd < 0) {
+            RT_LOGE("replay file %s open failed", path);
+            return RT_ERR_OPEN_FILE;
+        }
+        RTReplayFileHeader header;
+        rt_memset(&header, 0, sizeof(header));
+        header.magic    = RT_REPLAY_MAGIC;
+        header.version  = RT_REPLAY_VERSION;
+        header.createUs = (INT64)RtTime::getNowTimeUs();
+        mFailed = RT_FALSE;
+        mBeginUs = 0;
+        mSize = 0;
+        mRecords = 0;
+        mBytes = 0;
+        mStreams.clear();
+        struct iovec iov = { &header, sizeof(header) };
+        RT_RET ret = writeFully(&iov, 1);
+        if (ret != RT_OK) {
+            RT_LOGE("replay file %s header write failed", path);
+            closeLocked();
+            return ret;
+        }
+        mSize = sizeof(header);
+        return RT_OK;
+    }
+
+    void close() {
+        RtAutoMutex autoLock(mLock);
+        closeLocked();
+    }
+
+    void setMetaKeys(const std::vector<UINT64> &keys) {
+        RtAutoMutex autoLock(mLock);
+        mMetaKeys = keys;
+    }
+
+    RT_RET record(const std::string &streamName, RTReplayDirection direction, RTMediaBuffer *buffer) {
+        RtAutoMutex autoLock(mLock);
+        if (mFd < 0 || buffer == RT_NULL) {
+            return RT_ERR_NULL_PTR;
+        }
+        if (mFailed) {
+            return RT_ERR_BAD;
+        }
+        INT32 streamId = streamIdOf(streamName);
+        if (streamId < 0) {
+            return RT_ERR_BAD;
+        }
+
+        std::vector<UINT8> meta;
+        UINT32 metaCount = 0;
+        RtMetaData *metaData = buffer->getMetaData();
+        for (size_t i = 0; metaData != RT_NULL && i < mMetaKeys.size(); i++) {
+            UINT32 type = 0;
+            UINT32 size = 0;
+            const void *value = RT_NULL;
+            if (!metaData->findData(mMetaKeys[i], &type, &value, &size)
+                    || type == RtMetaData::TYPE_POINTER) {
+                continue;
+            }
+            RTReplayMetaEntry entry = { mMetaKeys[i], type, size };
+            size_t offset = meta.size();
+            meta.resize(offset + sizeof(entry) + RT_REPLAY_ALIGN(size), 0);
+            memcpy(&meta[offset], &entry, sizeof(entry));
+            memcpy(&meta[offset + sizeof(entry)], value, size);
+            metaCount++;
+        }
+
+        UINT8 *data = reinterpret_cast<UINT8 *>(buffer->getData());
+        UINT32 dataSize = (data != RT_NULL) ? buffer->getLength() : 0;
+        return writeRecord(RT_REPLAY_RECORD_BUFFER, streamId, direction,
+                           (data != RT_NULL) ? data + buffer->getOffset() : RT_NULL, dataSize,
+                           meta, metaCount);
+    }
+
+    INT64 records() {
+        RtAutoMutex autoLock(mLock);
+        return mRecords;
+    }
+    INT64 bytes() {
+        RtAutoMutex autoLock(mLock);
+        return mBytes;
+    }
+
+ private:
+    void closeLocked() {
+        if (mFd >= 0) {
+            ::close(mFd);
+            mFd = -1;
+        }
+    }
+
+    INT32 streamIdOf(const std::string &streamName) {
+        for (size_t i = 0; i < mStreams.size(); i++) {
+            if (mStreams[i] == streamName) {
+                return (INT32)i;
+            }
+        }
+        std::vector<UINT8> none;
+        INT32 streamId = (INT32)mStreams.size();
+        if (writeRecord(RT_REPLAY_RECORD_STREAM, streamId, RT_REPLAY_INPUT,
+                        streamName.c_str(), (UINT32)streamName.size() + 1, none, 0) != RT_OK) {
+            return -1;
+        }
+        mStreams.push_back(streamName);
+        return streamId;
+    }
+
+    RT_RET writeRecord(UINT16 type, INT32 streamId, RTReplayDirection direction,
+                       const void *data, UINT32 dataSize,
+                       const std::vector<UINT8> &meta, UINT32 metaCount) {
+        static const UINT8 kPadding[8] = { 0 };
+        UINT64 now = RtTime::getNowTimeUs();
+        if (mBeginUs == 0) {
+            mBeginUs = now;
+        }
+        RTReplayRecordHeader header;
+        rt_memset(&header, 0, sizeof(header));
+        header.magic      = RT_REPLAY_RECORD_MAGIC;
+        header.type       = type;
+        header.streamId   = (UINT16)streamId;
+        header.dataSize   = dataSize;
+        header.metaCount  = metaCount;
+        header.timeUs     = (INT64)(now - mBeginUs);
+        header.direction  = direction;
+        header.recordSize = (UINT32)(sizeof(header) + RT_REPLAY_ALIGN(dataSize) + meta.size());
+
+        struct iovec iov[4];
+        INT32 count = 0;
+        iov[count].iov_base = &header;
+        iov[count++].iov_len = sizeof(header);
+        if (dataSize > 0) {
+            iov[count].iov_base = const_cast<void *>(data);
+            iov[count++].iov_len = dataSize;
+        }
+        if (RT_REPLAY_ALIGN(dataSize) != dataSize) {
+            iov[count].iov_base = const_cast<UINT8 *>(kPadding);
+            iov[count++].iov_len = RT_REPLAY_ALIGN(dataSize) - dataSize;
+        }
+        if (!meta.empty()) {
+            iov[count].iov_base = const_cast<UINT8 *>(&meta[0]);
+            iov[count++].iov_len = meta.size();
+        }
+        if (writeFully(iov, count) != RT_OK) {
+            // a torn record would hide every later one from the reader
+            RT_LOGE("replay record write failed, stop recording at %lld bytes", (INT64)mSize);
+            if (ftruncate(mFd, (off_t)mSize) != 0) {
+                RT_LOGE("replay file cut back failed, error: %s", strerror(errno));
+            }
+            mFailed = RT_TRUE;
+            return RT_ERR_BAD;
+        }
+        mSize += header.recordSize;
+        mRecords++;
+        mBytes += header.recordSize;
+        return RT_OK;
+    }
+
+    // writev() until every byte is written, short writes advance iov.
+    RT_RET writeFully(struct iovec *iov, INT32 count) {
+        while (count > 0) {
+            ssize_t written = writev(mFd, iov, count);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return RT_ERR_BAD;
+            }
+            if (written == 0) {
+                return RT_ERR_BAD;
+            }
+            while (count > 0 && (size_t)written >= iov->iov_len) {
+                written -= iov->iov_len;
+                iov++;
+                count--;
+            }
+            if (count > 0) {
+                iov->iov_base = reinterpret_cast<UINT8 *>(iov->iov_base) + written;
+                iov->iov_len -= written;
+            }
+        }
+        return RT_OK;
+    }
+
+ private:
+    RtMutex                     mLock;
+    INT32                       mFd;
+    RT_BOOL                     mFailed;
+    UINT64                      mBeginUs;
+    UINT64                      mSize;          // whole records written
+    INT64                       mRecords;
+    INT64                       mBytes;
+    std::vector<std::string>    mStreams;
+    std::vector<UINT64>         mMetaKeys;
+};
+
+/*
+ * maps a container file written by RTReplayWriter. the mapping is private
+ * and writable, buffers handed out by makeBuffer() point into it without a
+ * copy and a node writing into one only touches its own copy-on-write page.
+ * the buffers come back through release() like the buffers of a pool and
+ * their wrappers are reused, the mapping stays until every one is back.
+ */
+class RTReplayReader : public RTBufferListener {
+ public:
+    RTReplayReader() : mMap(RT_NULL), mMapSize(0), mOffset(0), mLent(0) {}
+    // must not run with buffers still lent out, see close().
+    ~RTReplayReader() { close(); }
+
+    RTReplayReader(const RTReplayReader&) = delete;
+    RTReplayReader& operator=(const RTReplayReader&) = delete;
+
+    RT_RET open(const char *path) {
+        struct stat st;
+        RT_RET ret = close();
+        if (ret != RT_OK) {
+            return ret;
+        }
+        INT32 fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            RT_LOGE("replay file %s open failed", path);
+            return RT_ERR_OPEN_FILE;
+        }
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(RTReplayFileHeader)) {
+            ::close(fd);
+            return RT_ERR_BAD;
+        }
+        void *map = mmap(RT_NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) {
+            return RT_ERR_BAD;
+        }
+        const RTReplayFileHeader *header = reinterpret_cast<const RTReplayFileHeader *>(map);
+        if (header->magic != RT_REPLAY_MAGIC || header->version != RT_REPLAY_VERSION) {
+            munmap(map, st.st_size);
+            RT_LOGE("replay file %s has no valid header", path);
+            return RT_ERR_BAD;
+        }
+        mMap = reinterpret_cast<UINT8 *>(map);
+        mMapSize = st.st_size;
+        rewind();
+        return RT_OK;
+    }
+
+    // keeps the mapping and fails while a buffer of it is still lent out.
+    RT_RET close() {
+        std::vector<RTMediaBuffer *> wrappers;
+        {
+            RtAutoMutex autoLock(mLock);
+            if (mLent > 0) {
+                RT_LOGE("replay file still has %d buffers in use, keep it mapped", mLent);
+                return RT_ERR_BAD;
+            }
+            wrappers.swap(mWrappers);
+            mFree.clear();
+        }
+        for (size_t i = 0; i < wrappers.size(); i++) {
+            rt_safe_delete(wrappers[i]);
+        }
+        if (mMap != RT_NULL) {
+            munmap(mMap, mMapSize);
+            mMap = RT_NULL;
+            mMapSize = 0;
+        }
+        mStreams.clear();
+        return RT_OK;
+    }
+
+    void rewind() { mOffset = sizeof(RTReplayFileHeader); }
+
+    // next buffer record, RT_ERR_BAD on a torn tail (e.g. a recorder killed
+    // mid write), which ends the replay like the end of the file.
+    RT_RET next(RTReplayEntry *entry) {
+        while (mMap != RT_NULL && mOffset + sizeof(RTReplayRecordHeader) <= mMapSize) {
+            RTReplayRecordHeader *header = reinterpret_cast<RTReplayRecordHeader *>(mMap + mOffset);
+            if (header->magic != RT_REPLAY_RECORD_MAGIC
+                    || header->recordSize < sizeof(RTReplayRecordHeader)
+                    || mOffset + header->recordSize > mMapSize) {
+                return RT_ERR_BAD;
+            }
+            UINT8 *data = mMap + mOffset + sizeof(RTReplayRecordHeader);
+            mOffset += header->recordSize;
+            if (header->type == RT_REPLAY_RECORD_STREAM) {
+                if (header->streamId >= mStreams.size()) {
+                    mStreams.resize(header->streamId + 1);
+                }
+                mStreams[header->streamId] = reinterpret_cast<const char *>(data);
+                continue;
+            }
+            entry->streamId  = header->streamId;
+            entry->direction = (RTReplayDirection)header->direction;
+            entry->timeUs    = header->timeUs;
+            entry->data      = data;
+            entry->dataSize  = header->dataSize;
+            entry->metaCount = header->metaCount;
+            entry->meta      = reinterpret_cast<const RTReplayMetaEntry *>(
+                                    data + RT_REPLAY_ALIGN(header->dataSize));
+            return RT_OK;
+        }
+        return RT_ERR_BAD;
+    }
+
+    const std::string& streamName(UINT16 streamId) const {
+        static const std::string kUnknown;
+        return (streamId < mStreams.size()) ? mStreams[streamId] : kUnknown;
+    }
+
+    static const void* metaValue(const RTReplayMetaEntry *entry) {
+        return reinterpret_cast<const UINT8 *>(entry) + sizeof(RTReplayMetaEntry);
+    }
+    static const RTReplayMetaEntry* nextMeta(const RTReplayMetaEntry *entry) {
+        return reinterpret_cast<const RTReplayMetaEntry *>(
+                    reinterpret_cast<const UINT8 *>(metaValue(entry)) + RT_REPLAY_ALIGN(entry->size));
+    }
+
+    // wraps an entry without copying, release() hands the buffer back.
+    RTMediaBuffer* makeBuffer(const RTReplayEntry &entry) {
+        RTMediaBuffer *buffer = lendBuffer(entry.data, entry.dataSize);
+        RtMetaData *meta = buffer->getMetaData();
+        const RTReplayMetaEntry *item = entry.meta;
+        for (UINT32 i = 0; i < entry.metaCount; i++, item = nextMeta(item)) {
+            meta->setData(item->key, item->type, metaValue(item), item->size);
+        }
+        return buffer;
+    }
+
+    // an empty buffer flagged eos, ends a replayed input stream.
+    RTMediaBuffer* makeEosBuffer() {
+        RTMediaBuffer *buffer = lendBuffer(RT_NULL, 0);
+        buffer->getMetaData()->setInt32(kKeyPacketEOS, 1);
+        return buffer;
+    }
+
+    // waits until every lent buffer is back, RT_ERR_TIMEOUT if not in time.
+    RT_RET waitReleased(INT64 timeoutUs) {
+        RtAutoMutex autoLock(mLock);
+        UINT64 due = RtTime::getNowTimeUs() + timeoutUs;
+        while (mLent > 0) {
+            UINT64 now = RtTime::getNowTimeUs();
+            if (timeoutUs >= 0 && now >= due) {
+                return RT_ERR_TIMEOUT;
+            }
+            if (timeoutUs >= 0) {
+                mCondition.timedwait(mLock, due - now);
+            } else {
+                mCondition.wait(mLock);
+            }
+        }
+        return RT_OK;
+    }
+
+    INT32 lent() {
+        RtAutoMutex autoLock(mLock);
+        return mLent;
+    }
+
+ public:
+    // RTBufferListener
+    void onBufferAvailable(void *buffer) { (void)buffer; }
+    void onBufferRealloc(void *buffer, UINT32 size) {
+        (void)buffer;
+        (void)size;
+    }
+    void onBufferRelease(void *buffer, RT_BOOL render) {
+        (void)render;
+        RtAutoMutex autoLock(mLock);
+        mFree.push_back(reinterpret_cast<RTMediaBuffer *>(buffer));
+        mLent--;
+        mCondition.broadcast();
+    }
+
+ private:
+    RTMediaBuffer* lendBuffer(void *data, UINT32 size) {
+        RTMediaBuffer *buffer = RT_NULL;
+        {
+            RtAutoMutex autoLock(mLock);
+            if (!mFree.empty()) {
+                buffer = mFree.back();
+                mFree.pop_back();
+            }
+            mLent++;
+        }
+        if (buffer == RT_NULL) {
+            buffer = new RTMediaBuffer(data, size);
+            buffer->setListener(this);
+            RtAutoMutex autoLock(mLock);
+            mWrappers.push_back(buffer);
+        } else {
+            buffer->reset();
+            buffer->setData(data, size);
+        }
+        buffer->setRange(0, size);
+        return buffer;
+    }
+
+ private:
+    UINT8                          *mMap;
+    size_t                          mMapSize;
+    size_t                          mOffset;
+    std::vector<std::string>        mStreams;
+    RtMutex                         mLock;
+    RtCondition                     mCondition;
+    INT32                           mLent;
+    std::vector<RTMediaBuffer *>    mWrappers;
+    std::vector<RTMediaBuffer *>    mFree;
+};
+
+typedef struct _RTReplayStat {
+    INT64   fed;            // input packets queued
+    INT64   skipped;        // input packets the graph refused
+    INT64   outputs;        // recorded output buffers, the reference run
+    INT64   lateUs;         // worst delay behind the recorded timing
+    INT64   elapsedUs;
+} RTReplayStat;
+
+/*
+ * task graph with record and replay of its input streams. record mode
+ * stores every packet a subclass queues through feedInputStream() and, for
+ * the streams passed to recordOutputStream(), every output buffer. replay
+ * mode plays the input records of a file back in place of the external
+ * source (camera, fread) with the recorded or with no spacing, so a run
+ * can be repeated without the sensor. the graph, RTMediaBuffer and
+ * RtMetaData come from librockit, replay runs on the target like the
+ * recording; only the container format itself is host independent:
+ *
+ *     RTReplayGraph graph("uvc");
+ *     graph.autoBuild("aicamera_uvc.json");
+ *     graph.prepare();
+ *     graph.start();
+ *     graph.replay("/data/uvc.rtrp", RT_REPLAY_FASTEST, &stat);
+ *
+ * the end of the file sends eos to every replayed input stream, replay()
+ * then waits up to drainUs for the graph to hand all the buffers back. on
+ * RT_ERR_TIMEOUT the file stays mapped until the graph is stopped, a graph
+ * destroyed with replayed buffers still in it leaks the mapping instead of
+ * pulling it from under a node.
+ */
+class RTReplayGraph : public RTTaskGraph {
+ public:
+    explicit RTReplayGraph(const char *tagName) : RTTaskGraph(tagName), mReader(new RTReplayReader()) {}
+    RTReplayGraph(UINT64 uid, const char *tagName)
+            : RTTaskGraph(uid, tagName), mReader(new RTReplayReader()) {}
+    virtual ~RTReplayGraph() {
+        stopRecord();
+        if (mReader->close() == RT_OK) {
+            delete mReader;
+        }
+    }
+
+    RT_RET startRecord(const char *path) {
+        return mWriter.open(path);
+    }
+
+    RT_RET stopRecord() {
+        for (size_t i = 0; i < mRecordHandles.size(); i++) {
+            cancelObserveOutputStream(mRecordHandles[i]);
+        }
+        mRecordHandles.clear();
+        mWriter.close();
+        return RT_OK;
+    }
+
+    // the output of the node that feeds streamName, e.g. "rockx_out".
+    RT_RET recordOutputStream(const std::string &streamName) {
+        RTReplayWriter *writer = &mWriter;
+        RTCBHandle handle = observeOutputStream(streamName,
+            [writer, streamName](RTMediaBuffer *buffer) {
+                return writer->record(streamName, RT_REPLAY_OUTPUT, buffer);
+            });
+        mRecordHandles.push_back(handle);
+        return RT_OK;
+    }
+
+    RT_RET replay(const char *path, RTReplayTiming timing, RTReplayStat *stat = RT_NULL,
+                  INT64 timeoutUs = -1, INT64 drainUs = RT_REPLAY_DRAIN_US) {
+        RTReplayReader *reader = mReader;
+        RTReplayEntry entry;
+        RTReplayStat result;
+        std::vector<UINT16> streams;
+        rt_memset(&result, 0, sizeof(RTReplayStat));
+        RT_RET ret = reader->open(path);
+        if (ret != RT_OK) {
+            return ret;
+        }
+        UINT64 begin = RtTime::getNowTimeUs();
+        while (reader->next(&entry) == RT_OK) {
+            if (entry.direction == RT_REPLAY_OUTPUT) {
+                result.outputs++;
+                continue;
+            }
+            if (timing == RT_REPLAY_ORIGINAL) {
+                INT64 ahead = (INT64)(begin + entry.timeUs) - (INT64)RtTime::getNowTimeUs();
+                if (ahead > 0) {
+                    usleep(ahead);
+                } else if (-ahead > result.lateUs) {
+                    result.lateUs = -ahead;
+                }
+            }
+            if (std::find(streams.begin(), streams.end(), entry.streamId) == streams.end()) {
+                streams.push_back(entry.streamId);
+            }
+            RTMediaBuffer *buffer = reader->makeBuffer(entry);
+            if (RTTaskGraph::addPacketToInputStream(reader->streamName(entry.streamId),
+                                                    timeoutUs, buffer) != RT_OK) {
+                buffer->release();
+                result.skipped++;
+                continue;
+            }
+            result.fed++;
+        }
+        for (size_t i = 0; i < streams.size(); i++) {
+            RTMediaBuffer *eos = reader->makeEosBuffer();
+            if (RTTaskGraph::addPacketToInputStream(reader->streamName(streams[i]),
+                                                    timeoutUs, eos) != RT_OK) {
+                eos->release();
+            }
+        }
+        // the buffers point into the mapping, let the graph finish with them.
+        UINT64 due = RtTime::getNowTimeUs() + drainUs;
+        ret = waitUntilDone(drainUs);
+        if (ret == RT_OK) {
+            INT64 leftUs = (INT64)(due - RtTime::getNowTimeUs());
+            ret = reader->waitReleased((drainUs < 0) ? -1 : ((leftUs > 0) ? leftUs : 0));
+        }
+        if (ret == RT_OK) {
+            ret = reader->close();
+        } else {
+            RT_LOGE("%s replay %s not drained in %lld us, %d buffers in use",
+                     mTagName.c_str(), path, drainUs, reader->lent());
+        }
+        result.elapsedUs = (INT64)(RtTime::getNowTimeUs() - begin);
+        RT_LOGD("%s replay %s fed(%lld) skipped(%lld) late(%lld us) elapsed(%lld us)",
+                 mTagName.c_str(), path, result.fed, result.skipped, result.lateUs,
+                 result.elapsedUs);
+        if (stat != RT_NULL) {
+            *stat = result;
+        }
+        return ret;
+    }
+
+ protected:
+    /*
+     * records the packet, then queues it like addPacketToInputStream().
+     * that one is not virtual, subclasses call this one to be recorded.
+     */
+    RT_RET feedInputStream(std::string streamName, INT64 timeoutUs, RTMediaBuffer *packet) {
+        mWriter.record(streamName, RT_REPLAY_INPUT, packet);
+        return RTTaskGraph::addPacketToInputStream(streamName, timeoutUs, packet);
+    }
+
+ private:
+    RTReplayWriter              mWriter;
+    RTReplayReader             *mReader;
+    std::vector<RTCBHandle>     mRecordHandles;
+};
+
+#endif  // SRC_RT_TASK_TASK_GRAPH_RTGRAPHREPLAY_H_
@@ -0,0 +1,313 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *     module: RTGraphTracer
+ */
+
+#ifndef SRC_RT_TASK_TASK_GRAPH_RTGRAPHTRACER_H_
+#define SRC_RT_TASK_TASK_GRAPH_RTGRAPHTRACER_H_
+
+#include <stdio.h>
+#include <atomic>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_thread.h"
+
+// "rt_graph_trace=1" turns tracing on at startup, the trace is written to
+// "rt_graph_trace_path" (default below) by dumpChromeTrace().
+#define RT_GRAPH_TRACE_ENV          "rt_graph_trace"
+#define RT_GRAPH_TRACE_PATH_ENV     "rt_graph_trace_path"
+#define RT_GRAPH_TRACE_PATH         "/tmp/rt_graph_trace.json"
+// events kept per thread, older events are overwritten.
+#define RT_GRAPH_TRACE_RING_SIZE    8192
+
+typedef enum _RTTraceType {
+    RT_TRACE_ENQUEUE = 0,       // buffer queued to a node input stream
+    RT_TRACE_DEQUEUE,           // buffer taken by the node
+    RT_TRACE_PROCESS_BEGIN,     // node process() entered
+    RT_TRACE_PROCESS_END,       // node process() returned
+    RT_TRACE_MAX,
+} RTTraceType;
+
+typedef struct _RTTraceEvent {
+    UINT64  timeUs;
+    INT64   seq;            // buffer sequence or pts, -1 if unknown
+    INT32   nodeId;
+    INT32   type;
+    INT32   depth;          // input queue depth after the operation
+    INT32   reserved;
+} RTTraceEvent;
+
+/*
+ * per-buffer timestamps for every node, written into a lock-free ring per
+ * thread and exported as chrome trace-event json (chrome://tracing or
+ * https://ui.perfetto.dev). recording is wait-free for the writer, the
+ * only lock is taken once per thread when it gets its ring.
+ *
+ * a thread hands its ring back when it exits and the next new thread takes
+ * it over, so the rings only grow to the peak thread count; the events of
+ * an exited thread are in a dump until its ring is taken over. the tracer
+ * and its rings are never freed, a thread still tracing while the process
+ * exits cannot write into freed memory.
+ */
+class RTGraphTracer {
+ public:
+    static RTGraphTracer* instance() {
+        static RTGraphTracer *sTracer = new RTGraphTracer();
+        return sTracer;
+    }
+
+    void    setEnable(RT_BOOL enable) { mEnabled.store(enable, std::memory_order_relaxed); }
+    RT_BOOL isEnabled() const { return mEnabled.load(std::memory_order_relaxed); }
+
+    void setNodeName(INT32 nodeId, const char *name) {
+        RtAutoMutex autoLock(mLock);
+        mNodeNames[nodeId] = (name != RT_NULL) ? name : "";
+    }
+
+    void record(RTTraceType type, INT32 nodeId, INT64 seq = -1, INT32 depth = -1) {
+        if (!isEnabled()) {
+            return;
+        }
+        RTTraceRing *ring = threadRing();
+        UINT64 index = ring->writeIndex.load(std::memory_order_relaxed);
+        RTTraceEvent *event = &ring->events[index % RT_GRAPH_TRACE_RING_SIZE];
+        event->timeUs = RtTime::getNowTimeUs();
+        event->seq    = seq;
+        event->nodeId = nodeId;
+        event->type   = type;
+        event->depth  = depth;
+        ring->writeIndex.store(index + 1, std::memory_order_release);
+    }
+
+    void reset() {
+        RtAutoMutex autoLock(mLock);
+        for (size_t i = 0; i < mRings.size(); i++) {
+            mRings[i]->readIndex = mRings[i]->writeIndex.load(std::memory_order_acquire);
+        }
+    }
+
+    RT_RET dumpChromeTrace(const char *path = RT_NULL) {
+        if (path == RT_NULL) {
+            RT_ENV_GET_STR(RT_GRAPH_TRACE_PATH_ENV, &path, RT_GRAPH_TRACE_PATH);
+        }
+        FILE *fp = fopen(path, "w");
+        if (fp == RT_NULL) {
+            RT_LOGE("open trace file %s failed", path);
+            return RT_ERR_OPEN_FILE;
+        }
+
+        RtAutoMutex autoLock(mLock);
+        fprintf(fp, "{\"traceEvents\":[\n");
+        RT_BOOL first = RT_TRUE;
+        std::map<INT32, std::string>::iterator it;
+        for (it = mNodeNames.begin(); it != mNodeNames.end(); ++it) {
+            fprintf(fp, "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+                        "\"args\":{\"name\":\"node_%d %s\"}}",
+                        first ? "" : ",\n", it->first, it->first,
+                        escapeJson(it->second).c_str());
+            first = RT_FALSE;
+        }
+
+        // a node shows up as a process, its threads are named once for each
+        // node they ran.
+        std::set<std::pair<INT32, INT32> > named;
+        std::vector<RTTraceEvent> events;
+        for (size_t i = 0; i < mRings.size(); i++) {
+            RTTraceRing *ring = mRings[i];
+            collect(ring, &events);
+            for (size_t j = 0; j < events.size(); j++) {
+                if (named.insert(std::make_pair(events[j].nodeId, ring->threadId)).second) {
+                    writeThreadName(fp, events[j].nodeId, ring->threadId, &first);
+                }
+                writeEvent(fp, ring->threadId, events[j], &first);
+            }
+        }
+        fprintf(fp, "\n]}\n");
+        fclose(fp);
+        RT_LOGD("graph trace of %d threads written to %s", (INT32)mRings.size(), path);
+        return RT_OK;
+    }
+
+ private:
+    typedef struct RTTraceRing {
+        std::atomic<UINT64>  writeIndex;
+        std::atomic<RT_BOOL> retired;       // its thread exited
+        UINT64               readIndex;
+        INT32                threadId;
+        RTTraceEvent         events[RT_GRAPH_TRACE_RING_SIZE];
+    } RTTraceRing;
+
+    // hands the ring of a thread back on thread exit, without the tracer.
+    class RTTraceRingOwner {
+     public:
+        RTTraceRingOwner() : ring(RT_NULL) {}
+        ~RTTraceRingOwner() {
+            if (ring != RT_NULL) {
+                ring->retired.store(RT_TRUE, std::memory_order_release);
+            }
+        }
+        RTTraceRing *ring;
+    };
+
+    RTGraphTracer() : mEnabled(RT_FALSE) {
+        UINT32 enable = 0;
+        RT_ENV_GET_U32(RT_GRAPH_TRACE_ENV, &enable, 0);
+        mEnabled.store(enable != 0);
+    }
+
+    ~RTGraphTracer() {}
+
+    RTTraceRing* threadRing() {
+        static thread_local RTTraceRingOwner sOwner;
+        if (sOwner.ring == RT_NULL) {
+            sOwner.ring = claimRing();
+        }
+        return sOwner.ring;
+    }
+
+    RTTraceRing* claimRing() {
+        RtAutoMutex autoLock(mLock);
+        RTTraceRing *ring = RT_NULL;
+        for (size_t i = 0; i < mRings.size() && ring == RT_NULL; i++) {
+            if (mRings[i]->retired.load(std::memory_order_acquire)) {
+                ring = mRings[i];
+            }
+        }
+        if (ring == RT_NULL) {
+            ring = new RTTraceRing();
+            ring->writeIndex.store(0);
+            mRings.push_back(ring);
+        }
+        // the write index keeps counting, collect() relies on it.
+        ring->readIndex = ring->writeIndex.load(std::memory_order_acquire);
+        ring->threadId  = RtThread::getThreadID();
+        ring->retired.store(RT_FALSE, std::memory_order_relaxed);
+        return ring;
+    }
+
+    // copies the events still present in the ring. entries the writer may
+    // have overwritten while we were copying are dropped, and so is the slot
+    // of index 'now' - SIZE, the writer may be filling it right now.
+    void collect(RTTraceRing *ring, std::vector<RTTraceEvent> *events) {
+        events->clear();
+        UINT64 end   = ring->writeIndex.load(std::memory_order_acquire);
+        UINT64 begin = ring->readIndex;
+        if (end + 1 - begin > RT_GRAPH_TRACE_RING_SIZE) {
+            begin = end + 1 - RT_GRAPH_TRACE_RING_SIZE;
+        }
+        for (UINT64 i = begin; i < end; i++) {
+            events->push_back(ring->events[i % RT_GRAPH_TRACE_RING_SIZE]);
+        }
+        UINT64 now = ring->writeIndex.load(std::memory_order_acquire);
+        if (now + 1 - begin > RT_GRAPH_TRACE_RING_SIZE) {
+            size_t stale = (size_t)(now + 1 - begin - RT_GRAPH_TRACE_RING_SIZE);
+            events->erase(events->begin(),
+                          events->begin() + (stale < events->size() ? stale : events->size()));
+        }
+    }
+
+    static std::string escapeJson(const std::string &str) {
+        std::string out;
+        char code[8];
+        for (size_t i = 0; i < str.size(); i++) {
+            UINT8 c = (UINT8)str[i];
+            if (c == '"' || c == '\\') {
+                out.push_back('\\');
+                out.push_back((char)c);
+            } else if (c < 0x20) {
+                snprintf(code, sizeof(code), "\\u%04x", c);
+                out.append(code);
+            } else {
+                out.push_back((char)c);
+            }
+        }
+        return out;
+    }
+
+    void writeThreadName(FILE *fp, INT32 nodeId, INT32 tid, RT_BOOL *first) {
+        fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                    "\"args\":{\"name\":\"thread_%d\"}}",
+                    *first ? "" : ",\n", nodeId, tid, tid);
+        *first = RT_FALSE;
+    }
+
+    void writeEvent(FILE *fp, INT32 tid, const RTTraceEvent &event, RT_BOOL *first) {
+        const char *sep = *first ? "" : ",\n";
+        *first = RT_FALSE;
+        switch (event.type) {
+          case RT_TRACE_PROCESS_BEGIN:
+          case RT_TRACE_PROCESS_END:
+            fprintf(fp, "%s{\"name\":\"process\",\"cat\":\"node\",\"ph\":\"%s\",\"ts\":%llu,"
+                        "\"pid\":%d,\"tid\":%d,\"args\":{\"seq\":%lld}}",
+                        sep, (event.type == RT_TRACE_PROCESS_BEGIN) ? "B" : "E",
+                        (unsigned long long)event.timeUs, event.nodeId, tid, (long long)event.seq);
+            break;
+          case RT_TRACE_ENQUEUE:
+          case RT_TRACE_DEQUEUE:
+            fprintf(fp, "%s{\"name\":\"%s\",\"cat\":\"stream\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%llu,"
+                        "\"pid\":%d,\"tid\":%d,\"args\":{\"seq\":%lld,\"depth\":%d}}",
+                        sep, (event.type == RT_TRACE_ENQUEUE) ? "enqueue" : "dequeue",
+                        (unsigned long long)event.timeUs, event.nodeId, tid,
+                        (long long)event.seq, event.depth);
+            if (event.depth >= 0) {
+                fprintf(fp, ",\n{\"name\":\"queue_depth\",\"ph\":\"C\",\"ts\":%llu,\"pid\":%d,"
+                            "\"args\":{\"depth\":%d}}",
+                            (unsigned long long)event.timeUs, event.nodeId, event.depth);
+            }
+            break;
+          default:
+            break;
+        }
+    }
+
+ private:
+    std::atomic<RT_BOOL>            mEnabled;
+    RtMutex                         mLock;
+    std::vector<RTTraceRing *>      mRings;
+    std::map<INT32, std::string>    mNodeNames;
+};
+
+// records PROCESS_BEGIN/PROCESS_END around a scope, e.g. a node process().
+class RTTraceProcessScope {
+ public:
+    inline RTTraceProcessScope(INT32 nodeId, INT64 seq = -1)
+            : mNodeId(nodeId), mSeq(seq) {
+        RTGraphTracer::instance()->record(RT_TRACE_PROCESS_BEGIN, mNodeId, mSeq);
+    }
+    inline ~RTTraceProcessScope() {
+        RTGraphTracer::instance()->record(RT_TRACE_PROCESS_END, mNodeId, mSeq);
+    }
+
+ private:
+    INT32 mNodeId;
+    INT64 mSeq;
+};
+
+#define RT_TRACE_BUFFER_ENQUEUE(nodeId, seq, depth) \
+        RTGraphTracer::instance()->record(RT_TRACE_ENQUEUE, nodeId, seq, depth)
+#define RT_TRACE_BUFFER_DEQUEUE(nodeId, seq, depth) \
+        RTGraphTracer::instance()->record(RT_TRACE_DEQUEUE, nodeId, seq, depth)
+#define RT_TRACE_SCOPE_VAR_INNER(line)  __rt_trace_scope_##line##__
+#define RT_TRACE_SCOPE_VAR(line)        RT_TRACE_SCOPE_VAR_INNER(line)
+#define RT_TRACE_NODE_PROCESS(nodeId, seq) \
+        RTTraceProcessScope RT_TRACE_SCOPE_VAR(__LINE__)(nodeId, seq)
+
+#endif  // SRC_RT_TASK_TASK_GRAPH_RTGRAPHTRACER_H_
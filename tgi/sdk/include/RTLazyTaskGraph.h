@@ -0,0 +1,322 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *     module: RTLazyTaskGraph
+ */
+
+#ifndef SRC_RT_TASK_TASK_GRAPH_RTLAZYTASKGRAPH_H_
+#define SRC_RT_TASK_TASK_GRAPH_RTLAZYTASKGRAPH_H_
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_metadata.h"
+#include "rt_thread.h"
+#include "RTGraphReconfigurator.h"
+#include "RTNodeCommon.h"
+#include "RTTaskGraph.h"
+#include "RTTaskNode.h"
+
+#define RT_LAZY_REAP_PERIOD_US      (100 * 1000)
+
+typedef struct _RTLazyNodeStat {
+    RT_BOOL active;
+    INT32   opens;
+    INT32   closes;
+    INT64   lastOpenUs;
+    INT64   maxOpenUs;
+    INT64   totalOpenUs;
+    INT64   lastCloseUs;
+    INT64   maxCloseUs;
+    INT64   idleTimeoutUs;
+} RTLazyNodeStat;
+
+/*
+ * task node that stays a stub until it is needed. the graph prepare()
+ * only records the context, the expensive part (model load, rga/dma
+ * buffers) runs in onOpen() when the node gets its first packet or a
+ * selected link mode references it, and onClose() runs again once the
+ * node was idle for OPT_NODE_IDLE_TIMEOUT us (0 keeps it open until the
+ * graph closes it).
+ *
+ *     class RTRockxNode : public RTLazyTaskNode {
+ *      protected:
+ *         RT_RET onOpen(RTTaskNodeContext *context);     // load the model
+ *         RT_RET onProcess(RTTaskNodeContext *context);
+ *         RT_RET onClose(RTTaskNodeContext *context);    // unload it
+ *     };
+ */
+class RTLazyTaskNode : public RTTaskNode {
+ public:
+    RTLazyTaskNode()
+            : mContext(RT_NULL),
+              mPrepared(RT_FALSE),
+              mCalls(0),
+              mLastActiveUs(0) {
+        rt_memset(&mStat, 0, sizeof(RTLazyNodeStat));
+    }
+    virtual ~RTLazyTaskNode() {}
+
+    RT_RET open(RTTaskNodeContext *context) {
+        INT32 timeoutUs = 0;
+        RtMetaData *options = context->options();
+        if (options != RT_NULL && options->findInt32(OPT_NODE_IDLE_TIMEOUT, &timeoutUs)) {
+            mStat.idleTimeoutUs = (timeoutUs > 0) ? timeoutUs : 0;
+        }
+        {
+            RtAutoMutex autoLock(mLazyLock);
+            mContext = context;
+            mPrepared = RT_TRUE;
+        }
+        if (mStat.idleTimeoutUs > 0) {
+            RTLazyNodeReaper::instance()->add(this);
+        }
+        return RT_OK;
+    }
+
+    RT_RET process(RTTaskNodeContext *context) {
+        {
+            RtAutoMutex autoLock(mLazyLock);
+            if (!mStat.active) {
+                RT_RET ret = activateLocked();
+                if (ret != RT_OK) {
+                    return ret;
+                }
+            }
+            mCalls++;
+        }
+        RT_RET ret = onProcess(context);
+        RtAutoMutex autoLock(mLazyLock);
+        mCalls--;
+        mLastActiveUs = RtTime::getNowTimeUs();
+        return ret;
+    }
+
+    RT_RET close(RTTaskNodeContext *context) {
+        (void)context;
+        RTLazyNodeReaper::instance()->remove(this);
+        RtAutoMutex autoLock(mLazyLock);
+        mPrepared = RT_FALSE;
+        return mStat.active ? deactivateLocked() : RT_OK;
+    }
+
+    // opens the node ahead of its first packet, no-op before prepare().
+    RT_RET activate() {
+        RtAutoMutex autoLock(mLazyLock);
+        if (!mPrepared || mStat.active) {
+            return RT_OK;
+        }
+        return activateLocked();
+    }
+
+    // closes the node when nothing ran on it for the idle timeout.
+    void reapIfIdle(UINT64 now) {
+        RtAutoMutex autoLock(mLazyLock);
+        if (mStat.active && mCalls == 0 && mStat.idleTimeoutUs > 0
+                && now - mLastActiveUs >= (UINT64)mStat.idleTimeoutUs) {
+            deactivateLocked();
+        }
+    }
+
+    void queryLazyStat(RTLazyNodeStat *stat) {
+        RtAutoMutex autoLock(mLazyLock);
+        *stat = mStat;
+    }
+
+ protected:
+    virtual RT_RET onOpen(RTTaskNodeContext *context) = 0;
+    virtual RT_RET onProcess(RTTaskNodeContext *context) = 0;
+    virtual RT_RET onClose(RTTaskNodeContext *context) = 0;
+
+ private:
+    RT_RET activateLocked() {
+        UINT64 begin = RtTime::getNowTimeUs();
+        RT_RET ret = onOpen(mContext);
+        INT64 costUs = (INT64)(RtTime::getNowTimeUs() - begin);
+        if (ret != RT_OK) {
+            RT_LOGE("lazy node %d open failed, ret = %d", getID(), ret);
+            return ret;
+        }
+        mStat.active = RT_TRUE;
+        mStat.opens++;
+        mStat.lastOpenUs = costUs;
+        mStat.totalOpenUs += costUs;
+        mStat.maxOpenUs = std::max(mStat.maxOpenUs, costUs);
+        mLastActiveUs = RtTime::getNowTimeUs();
+        return RT_OK;
+    }
+
+    RT_RET deactivateLocked() {
+        UINT64 begin = RtTime::getNowTimeUs();
+        RT_RET ret = onClose(mContext);
+        INT64 costUs = (INT64)(RtTime::getNowTimeUs() - begin);
+        mStat.active = RT_FALSE;
+        mStat.closes++;
+        mStat.lastCloseUs = costUs;
+        mStat.maxCloseUs = std::max(mStat.maxCloseUs, costUs);
+        return ret;
+    }
+
+ private:
+    /*
+     * one thread for all lazy nodes of the process, it only runs while at
+     * least one node with an idle timeout is prepared.
+     */
+    class RTLazyNodeReaper {
+     public:
+        static RTLazyNodeReaper* instance() {
+            static RTLazyNodeReaper sReaper;
+            return &sReaper;
+        }
+
+        void add(RTLazyTaskNode *node) {
+            RtAutoMutex autoLock(mLock);
+            if (std::find(mNodes.begin(), mNodes.end(), node) == mNodes.end()) {
+                mNodes.push_back(node);
+            }
+            if (mThread == RT_NULL) {
+                mRunning = RT_TRUE;
+                mThread = new RtThread(reapLoop, this);
+                mThread->setName("lazy_node_reaper");
+                mThread->start();
+            }
+        }
+
+        void remove(RTLazyTaskNode *node) {
+            RtThread *thread = RT_NULL;
+            {
+                RtAutoMutex autoLock(mLock);
+                mNodes.erase(std::remove(mNodes.begin(), mNodes.end(), node), mNodes.end());
+                // wait out a reap pass that may still hold the node.
+                while (mReaping) {
+                    mCondition.wait(mLock);
+                }
+                if (mNodes.empty() && mThread != RT_NULL) {
+                    thread = mThread;
+                    mThread = RT_NULL;
+                    mRunning = RT_FALSE;
+                    mCondition.broadcast();
+                }
+            }
+            if (thread != RT_NULL) {
+                thread->join();
+                delete thread;
+            }
+        }
+
+     private:
+        RTLazyNodeReaper() : mThread(RT_NULL), mRunning(RT_FALSE), mReaping(RT_FALSE) {}
+        ~RTLazyNodeReaper() {}
+
+        static void* reapLoop(void *data) {
+            RTLazyNodeReaper *self = reinterpret_cast<RTLazyNodeReaper *>(data);
+            RtAutoMutex autoLock(self->mLock);
+            while (self->mRunning) {
+                self->mCondition.timedwait(self->mLock, RT_LAZY_REAP_PERIOD_US);
+                if (!self->mRunning) {
+                    break;
+                }
+                std::vector<RTLazyTaskNode *> nodes = self->mNodes;
+                self->mReaping = RT_TRUE;
+                self->mLock.unlock();
+                UINT64 now = RtTime::getNowTimeUs();
+                for (size_t i = 0; i < nodes.size(); i++) {
+                    nodes[i]->reapIfIdle(now);
+                }
+                self->mLock.lock();
+                self->mReaping = RT_FALSE;
+                self->mCondition.broadcast();
+            }
+            return RT_NULL;
+        }
+
+     private:
+        RtMutex                         mLock;
+        RtCondition                     mCondition;
+        RtThread                       *mThread;
+        RT_BOOL                         mRunning;
+        RT_BOOL                         mReaping;
+        std::vector<RTLazyTaskNode *>   mNodes;
+    };
+
+ private:
+    RtMutex             mLazyLock;
+    RTTaskNodeContext  *mContext;
+    RT_BOOL             mPrepared;
+    INT32               mCalls;
+    UINT64              mLastActiveUs;
+    RTLazyNodeStat      mStat;
+};
+
+/*
+ * task graph that opens lazy nodes per link mode. activateLinkMode() opens
+ * the lazy nodes the link ship of the mode references, then selects the
+ * mode, so the first frame does not pay for the model load; nodes no
+ * selected mode references stay stubs. RTTaskGraph::selectLinkMode() is
+ * not virtual, so these are named methods rather than overrides: a plain
+ * selectLinkMode() still works and opens the nodes on their first packet.
+ * dumpLazyNodes() logs the open/close timings of every lazy node.
+ */
+class RTLazyTaskGraph : public RTTaskGraph {
+ public:
+    explicit RTLazyTaskGraph(const char *tagName) : RTTaskGraph(tagName) {}
+    RTLazyTaskGraph(UINT64 uid, const char *tagName) : RTTaskGraph(uid, tagName) {}
+    virtual ~RTLazyTaskGraph() {}
+
+    RT_RET activateLinkMode(std::string mode) {
+        if (mLinkShips.find(mode) != mLinkShips.end()) {
+            std::set<INT32> nodeIds;
+            RTLinkShipDiff::nodesOf(mLinkShips[mode], &nodeIds);
+            std::set<INT32>::iterator it;
+            for (it = nodeIds.begin(); it != nodeIds.end(); ++it) {
+                RTLazyTaskNode *node = lazyNodeOf(*it);
+                if (node != RT_NULL && node->activate() != RT_OK) {
+                    RT_LOGE("%s mode %s: node %d open failed", mTagName.c_str(), mode.c_str(), *it);
+                }
+            }
+        }
+        return selectLinkMode(mode);
+    }
+
+    RT_RET dumpLazyNodes() {
+        std::map<INT32, RTTaskNode *>::iterator it;
+        for (it = mNodes.begin(); it != mNodes.end(); ++it) {
+            RTLazyTaskNode *node = dynamic_cast<RTLazyTaskNode *>(it->second);
+            if (node == RT_NULL) {
+                continue;
+            }
+            RTLazyNodeStat stat;
+            node->queryLazyStat(&stat);
+            RT_LOGE("lazy node %d %s opens(%d) closes(%d) open last(%lld us) max(%lld us) "
+                    "avg(%lld us) close last(%lld us) max(%lld us) idle-timeout(%lld us)",
+                     it->first, stat.active ? "active" : "stub", stat.opens, stat.closes,
+                     stat.lastOpenUs, stat.maxOpenUs,
+                     (stat.opens > 0) ? stat.totalOpenUs / stat.opens : 0,
+                     stat.lastCloseUs, stat.maxCloseUs, stat.idleTimeoutUs);
+        }
+        return RT_OK;
+    }
+
+ private:
+    RTLazyTaskNode* lazyNodeOf(INT32 nodeId) {
+        std::map<INT32, RTTaskNode *>::iterator it = mNodes.find(nodeId);
+        return (it != mNodes.end()) ? dynamic_cast<RTLazyTaskNode *>(it->second) : RT_NULL;
+    }
+};
+
+#endif  // SRC_RT_TASK_TASK_GRAPH_RTLAZYTASKGRAPH_H_
@@ -122,8 +122,12 @@
 #define OPT_NODE_MAX_INPUT_COUNT         "node_max_input_count"
 #define OPT_NODE_GATE_MODE               "node_gate_mode"
 #define OPT_NODE_BATCH_SIZE              "node_batch_size"
+#define OPT_NODE_BATCH_TIMEOUT           "node_batch_timeout"
 #define OPT_NODE_SRC_MB_TYPE             "node_src_mbtype"
 #define OPT_NODE_DST_MB_TYPE             "node_dst_mbtype"
+#define OPT_NODE_LATENCY_BUDGET          "node_latency_budget"
+#define OPT_NODE_DROP_LATE               "node_drop_late"
+#define OPT_NODE_IDLE_TIMEOUT            "node_idle_timeout"
 
 #define OPT_FILE_READ_SIZE               "opt_read_size"
 
@@ -312,6 +316,11 @@
 
 #define OPT_EXEC_THREAD_NUM             "exec_thread_num"
 #define OPT_EXEC_THREAD_NAME            "exec_name"
+// read by RTWorkStealingExecutor::create() only, an executor built from a
+// graph json by librockit ignores them.
+#define OPT_EXEC_CPU_SET                "exec_cpu_set"
+#define OPT_EXEC_SCHED_POLICY           "exec_sched_policy"
+#define OPT_EXEC_SCHED_PRIOR            "exec_sched_prior"
 
 #define OPT_RGA_BLEND                   "opt_rga_blend"
 #define OPT_MPP_MPI_TYPE                "opt_mpp_mpi_type"
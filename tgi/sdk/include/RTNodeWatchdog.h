@@ -0,0 +1,378 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *     module: RTNodeWatchdog
+ */
+
+#ifndef SRC_RT_TASK_TASK_GRAPH_RTNODEWATCHDOG_H_
+#define SRC_RT_TASK_TASK_GRAPH_RTNODEWATCHDOG_H_
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_message.h"
+#include "rt_thread.h"
+#include "RTTaskNode.h"
+
+#define RT_WATCHDOG_PERIOD_US       (100 * 1000)
+#define RT_WATCHDOG_MULTIPLE        8
+#define RT_WATCHDOG_MIN_STALL_US    (500 * 1000)
+#define RT_WATCHDOG_INTERRUPT       "watchdog stall"
+
+// event is RT_NODE_INFO_STALL, stallUs how long the node is in process().
+typedef std::function<void(INT32 event, INT32 nodeId, INT64 stallUs)> RTWatchdogListener;
+
+typedef struct _RTWatchdogNodeStat {
+    INT64   processed;
+    INT64   avgCostUs;      // EWMA of finished process() calls
+    INT64   maxCostUs;
+    INT64   sinceProgressUs;// time since the last process() returned
+    INT64   stalls;
+    RT_BOOL inProcess;
+    RT_BOOL stalled;        // currently flagged
+} RTWatchdogNodeStat;
+
+/*
+ * stall detection for task nodes. a node brackets process() with
+ * onProcessBegin()/onProcessEnd() (or RT_WATCHDOG_PROCESS); a monitor
+ * thread flags every node that is inside process() for longer than
+ * multiple x its rolling average cost, and never less than minStallUs so
+ * the first frames and idle periods do not trigger it. a flagged node is
+ * reported once per stall through the listener as RT_NODE_INFO_STALL and,
+ * with interrupt enabled, gets sendInterrupt(RT_WATCHDOG_INTERRUPT); the
+ * interrupt is cancelled again when the node returns from process().
+ *
+ * node ids are only unique within a graph, so every graph gets its own
+ * watchdog, e.g. kept next to the graph and handed to its nodes:
+ *
+ *     RTNodeWatchdog *watchdog = new RTNodeWatchdog();
+ *     watchdog->watch(this);
+ *     ...
+ *     RT_RET process(RTTaskNodeContext *context) {
+ *         RT_WATCHDOG_PROCESS(watchdog, getID());
+ *         ...
+ *     }
+ */
+class RTNodeWatchdog {
+ public:
+    RTNodeWatchdog()
+            : mThread(RT_NULL),
+              mRunning(RT_FALSE),
+              mActing(RT_FALSE),
+              mMultiple(RT_WATCHDOG_MULTIPLE),
+              mMinStallUs(RT_WATCHDOG_MIN_STALL_US),
+              mInterrupt(RT_FALSE) {}
+    ~RTNodeWatchdog() { stop(); }
+
+    RTNodeWatchdog(const RTNodeWatchdog&) = delete;
+    RTNodeWatchdog& operator=(const RTNodeWatchdog&) = delete;
+
+    void setListener(RTWatchdogListener listener) {
+        RtAutoMutex autoLock(mLock);
+        mListener = listener;
+    }
+
+    void setThreshold(INT32 multiple, INT64 minStallUs) {
+        RtAutoMutex autoLock(mLock);
+        mMultiple = (multiple > 1) ? multiple : 2;
+        mMinStallUs = (minStallUs > 0) ? minStallUs : 0;
+    }
+
+    void setInterrupt(RT_BOOL interrupt) {
+        RtAutoMutex autoLock(mLock);
+        mInterrupt = interrupt;
+    }
+
+    // node may be RT_NULL, such a node is only reported, never interrupted.
+    void watch(INT32 nodeId, RTTaskNode *node = RT_NULL) {
+        {
+            RtAutoMutex autoLock(mLock);
+            while (mActing) {
+                mIdle.wait(mLock);
+            }
+            RTWatchdogNode &entry = mNodes[nodeId];
+            rt_memset(&entry.stat, 0, sizeof(RTWatchdogNodeStat));
+            entry.node = node;
+            entry.beginUs = 0;
+            entry.lastProgressUs = RtTime::getNowTimeUs();
+            entry.interrupt = RT_WATCHDOG_IRQ_NONE;
+        }
+        start();
+    }
+    void watch(RTTaskNode *node) { watch(node->getID(), node); }
+
+    // the node may be freed on return, an interrupt in flight has finished.
+    void unwatch(INT32 nodeId) {
+        RtAutoMutex autoLock(mLock);
+        while (mActing) {
+            mIdle.wait(mLock);
+        }
+        mNodes.erase(nodeId);
+    }
+
+    void onProcessBegin(INT32 nodeId) {
+        RtAutoMutex autoLock(mLock);
+        std::map<INT32, RTWatchdogNode>::iterator it = mNodes.find(nodeId);
+        if (it != mNodes.end()) {
+            it->second.beginUs = RtTime::getNowTimeUs();
+            it->second.stat.inProcess = RT_TRUE;
+        }
+    }
+
+    void onProcessEnd(INT32 nodeId) {
+        RTTaskNode *cancel = RT_NULL;
+        {
+            RtAutoMutex autoLock(mLock);
+            std::map<INT32, RTWatchdogNode>::iterator it = mNodes.find(nodeId);
+            if (it == mNodes.end() || !it->second.stat.inProcess) {
+                return;
+            }
+            RTWatchdogNode &entry = it->second;
+            UINT64 now = RtTime::getNowTimeUs();
+            INT64 costUs = (INT64)(now - entry.beginUs);
+            entry.stat.inProcess = RT_FALSE;
+            entry.stat.processed++;
+            entry.lastProgressUs = now;
+            // a stall is not a sample of the normal cost.
+            if (!entry.stat.stalled) {
+                entry.stat.avgCostUs = (entry.stat.avgCostUs == 0)
+                        ? costUs : entry.stat.avgCostUs + (costUs - entry.stat.avgCostUs) / 8;
+            }
+            if (costUs > entry.stat.maxCostUs) {
+                entry.stat.maxCostUs = costUs;
+            }
+            entry.stat.stalled = RT_FALSE;
+            // an interrupt still being sent is cancelled by check() after it
+            if (entry.interrupt == RT_WATCHDOG_IRQ_SENDING) {
+                entry.interrupt = RT_WATCHDOG_IRQ_CANCEL;
+            } else if (entry.interrupt == RT_WATCHDOG_IRQ_SENT) {
+                entry.interrupt = RT_WATCHDOG_IRQ_NONE;
+                cancel = entry.node;
+            }
+        }
+        if (cancel != RT_NULL) {
+            cancel->cancelInterrupt(RT_WATCHDOG_INTERRUPT);
+        }
+    }
+
+    RT_RET queryNodeStat(INT32 nodeId, RTWatchdogNodeStat *stat) {
+        RtAutoMutex autoLock(mLock);
+        std::map<INT32, RTWatchdogNode>::iterator it = mNodes.find(nodeId);
+        if (it == mNodes.end()) {
+            return RT_ERR_VALUE;
+        }
+        *stat = it->second.stat;
+        stat->sinceProgressUs = (INT64)(RtTime::getNowTimeUs() - it->second.lastProgressUs);
+        return RT_OK;
+    }
+
+    RT_RET dump() {
+        RtAutoMutex autoLock(mLock);
+        UINT64 now = RtTime::getNowTimeUs();
+        std::map<INT32, RTWatchdogNode>::iterator it;
+        for (it = mNodes.begin(); it != mNodes.end(); ++it) {
+            const RTWatchdogNodeStat &stat = it->second.stat;
+            RT_LOGE("watchdog node %d processed(%lld) avg(%lld us) max(%lld us) "
+                    "since-progress(%lld us) stalls(%lld)%s%s",
+                     it->first, stat.processed, stat.avgCostUs, stat.maxCostUs,
+                     (INT64)(now - it->second.lastProgressUs), stat.stalls,
+                     stat.inProcess ? " in-process" : "", stat.stalled ? " STALLED" : "");
+        }
+        return RT_OK;
+    }
+
+    void stop() {
+        {
+            RtAutoMutex autoLock(mLock);
+            if (mThread == RT_NULL) {
+                return;
+            }
+            mRunning = RT_FALSE;
+            mCondition.signal();
+        }
+        mThread->join();
+        rt_safe_delete(mThread);
+    }
+
+ private:
+    // interrupt of a stalled node, sent and cancelled outside the lock.
+    typedef enum RTWatchdogIrq {
+        RT_WATCHDOG_IRQ_NONE = 0,
+        RT_WATCHDOG_IRQ_SENDING,    // check() is sending it
+        RT_WATCHDOG_IRQ_SENT,       // onProcessEnd() cancels it
+        RT_WATCHDOG_IRQ_CANCEL,     // returned while sending, check() cancels it
+    } RTWatchdogIrq;
+
+    typedef struct RTWatchdogNode {
+        RTTaskNode         *node;
+        UINT64              beginUs;
+        UINT64              lastProgressUs;
+        RTWatchdogIrq       interrupt;
+        RTWatchdogNodeStat  stat;
+    } RTWatchdogNode;
+
+    typedef struct RTWatchdogStall {
+        INT32       nodeId;
+        RTTaskNode *node;           // to interrupt, RT_NULL if not
+        INT64       stallUs;
+    } RTWatchdogStall;
+
+    void start() {
+        RtAutoMutex autoLock(mLock);
+        if (mThread != RT_NULL) {
+            return;
+        }
+        mRunning = RT_TRUE;
+        mThread = new RtThread(monitorLoop, this);
+        mThread->setName("node_watchdog");
+        mThread->start();
+    }
+
+    /*
+     * flags new stalls under the lock and interrupts them after it, so no
+     * node code runs with the lock held. mActing keeps unwatch() from
+     * freeing a node in between, the interrupt state orders the send
+     * before the cancel of a node that returns meanwhile. logging and the
+     * listener run last, the listener may unwatch.
+     */
+    void check() {
+        std::vector<RTWatchdogStall> stalls;
+        RTWatchdogListener listener;
+        {
+            RtAutoMutex autoLock(mLock);
+            UINT64 now = RtTime::getNowTimeUs();
+            std::map<INT32, RTWatchdogNode>::iterator it;
+            for (it = mNodes.begin(); it != mNodes.end(); ++it) {
+                RTWatchdogNode &entry = it->second;
+                if (!entry.stat.inProcess || entry.stat.stalled) {
+                    continue;
+                }
+                INT64 elapsedUs = (INT64)(now - entry.beginUs);
+                INT64 limitUs = entry.stat.avgCostUs * mMultiple;
+                if (limitUs < mMinStallUs) {
+                    limitUs = mMinStallUs;
+                }
+                if (elapsedUs <= limitUs) {
+                    continue;
+                }
+                entry.stat.stalled = RT_TRUE;
+                entry.stat.stalls++;
+                RTWatchdogStall stall = { it->first, RT_NULL, elapsedUs };
+                if (mInterrupt && entry.node != RT_NULL) {
+                    entry.interrupt = RT_WATCHDOG_IRQ_SENDING;
+                    stall.node = entry.node;
+                }
+                stalls.push_back(stall);
+            }
+            listener = mListener;
+            mActing = !stalls.empty();
+        }
+        if (stalls.empty()) {
+            return;
+        }
+
+        for (size_t i = 0; i < stalls.size(); i++) {
+            if (stalls[i].node != RT_NULL) {
+                stalls[i].node->sendInterrupt(RT_WATCHDOG_INTERRUPT);
+            }
+        }
+        std::vector<RTTaskNode *> cancels;
+        {
+            RtAutoMutex autoLock(mLock);
+            for (size_t i = 0; i < stalls.size(); i++) {
+                std::map<INT32, RTWatchdogNode>::iterator it = mNodes.find(stalls[i].nodeId);
+                if (stalls[i].node == RT_NULL || it == mNodes.end()) {
+                    continue;
+                }
+                if (it->second.interrupt == RT_WATCHDOG_IRQ_CANCEL) {
+                    it->second.interrupt = RT_WATCHDOG_IRQ_NONE;
+                    cancels.push_back(stalls[i].node);
+                } else if (it->second.interrupt == RT_WATCHDOG_IRQ_SENDING) {
+                    it->second.interrupt = RT_WATCHDOG_IRQ_SENT;
+                }
+            }
+        }
+        for (size_t i = 0; i < cancels.size(); i++) {
+            cancels[i]->cancelInterrupt(RT_WATCHDOG_INTERRUPT);
+        }
+        {
+            RtAutoMutex autoLock(mLock);
+            mActing = RT_FALSE;
+            mIdle.broadcast();
+        }
+
+        for (size_t i = 0; i < stalls.size(); i++) {
+            RT_LOGE("node %d stalled in process for %lld us%s", stalls[i].nodeId,
+                     stalls[i].stallUs, (stalls[i].node != RT_NULL) ? ", interrupted" : "");
+            if (listener) {
+                listener(RT_NODE_INFO_STALL, stalls[i].nodeId, stalls[i].stallUs);
+            }
+        }
+    }
+
+    static void* monitorLoop(void *data) {
+        RTNodeWatchdog *self = reinterpret_cast<RTNodeWatchdog *>(data);
+        while (1) {
+            {
+                RtAutoMutex autoLock(self->mLock);
+                if (self->mRunning) {
+                    self->mCondition.timedwait(self->mLock, RT_WATCHDOG_PERIOD_US);
+                }
+                if (!self->mRunning) {
+                    break;
+                }
+            }
+            self->check();
+        }
+        return RT_NULL;
+    }
+
+ private:
+    RtMutex                             mLock;
+    RtCondition                         mCondition;
+    RtCondition                         mIdle;
+    RtThread                           *mThread;
+    RT_BOOL                             mRunning;
+    RT_BOOL                             mActing;    // check() works on nodes unlocked
+    INT32                               mMultiple;
+    INT64                               mMinStallUs;
+    RT_BOOL                             mInterrupt;
+    RTWatchdogListener                  mListener;
+    std::map<INT32, RTWatchdogNode>     mNodes;
+};
+
+class RTWatchdogScope {
+ public:
+    RTWatchdogScope(RTNodeWatchdog *watchdog, INT32 nodeId)
+            : mWatchdog(watchdog),
+              mNodeId(nodeId) {
+        mWatchdog->onProcessBegin(mNodeId);
+    }
+    ~RTWatchdogScope() { mWatchdog->onProcessEnd(mNodeId); }
+
+ private:
+    RTNodeWatchdog *mWatchdog;
+    INT32           mNodeId;
+};
+
+#define RT_WATCHDOG_SCOPE_VAR2(line)        __rt_watchdog_scope_##line
+#define RT_WATCHDOG_SCOPE_VAR(line)         RT_WATCHDOG_SCOPE_VAR2(line)
+#define RT_WATCHDOG_PROCESS(watchdog, nodeId) \
+    RTWatchdogScope RT_WATCHDOG_SCOPE_VAR(__LINE__)((watchdog), (nodeId))
+
+#endif  // SRC_RT_TASK_TASK_GRAPH_RTNODEWATCHDOG_H_
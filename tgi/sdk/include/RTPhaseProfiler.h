@@ -0,0 +1,151 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *     module: RTPhaseProfiler
+ */
+
+#ifndef SRC_RT_TASK_TASK_GRAPH_RTPHASEPROFILER_H_
+#define SRC_RT_TASK_TASK_GRAPH_RTPHASEPROFILER_H_
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "rt_header.h"
+
+typedef struct _RTPhaseRecord {
+    std::string name;
+    UINT64      startUs;    // relative to the profiler creation
+    UINT64      costUs;
+} RTPhaseRecord;
+
+/*
+ * wall clock breakdown of a start sequence, e.g.
+ *
+ *     RTPhaseProfiler profiler("uvc_graph");
+ *     profiler.begin("config");
+ *     ...
+ *     profiler.begin("auto_build");   // ends "config"
+ *     graph->autoBuild(config, RT_FALSE);
+ *     profiler.end();
+ *     profiler.dump();
+ *
+ * phases are sequential, begin() closes the running phase.
+ */
+class RTPhaseProfiler {
+ public:
+    explicit RTPhaseProfiler(const char *name)
+            : mName((name != RT_NULL) ? name : "profiler"),
+              mBaseUs(RtTime::getNowTimeUs()),
+              mRunning(RT_FALSE) {}
+
+    void begin(const char *phase) {
+        RtAutoMutex autoLock(mLock);
+        endLocked();
+        RTPhaseRecord record;
+        record.name    = (phase != RT_NULL) ? phase : "";
+        record.startUs = RtTime::getNowTimeUs() - mBaseUs;
+        record.costUs  = 0;
+        mPhases.push_back(record);
+        mRunning = RT_TRUE;
+    }
+
+    void end() {
+        RtAutoMutex autoLock(mLock);
+        endLocked();
+    }
+
+    // cost of the named phase, 0 if it never ran.
+    UINT64 costOf(const char *phase) {
+        RtAutoMutex autoLock(mLock);
+        UINT64 cost = 0;
+        for (size_t i = 0; i < mPhases.size(); i++) {
+            if (mPhases[i].name == phase) {
+                cost += mPhases[i].costUs;
+            }
+        }
+        return cost;
+    }
+
+    UINT64 totalUs() {
+        RtAutoMutex autoLock(mLock);
+        return totalLocked();
+    }
+
+    void getPhases(std::vector<RTPhaseRecord> *phases) {
+        RtAutoMutex autoLock(mLock);
+        *phases = mPhases;
+    }
+
+    void reset() {
+        RtAutoMutex autoLock(mLock);
+        mPhases.clear();
+        mRunning = RT_FALSE;
+        mBaseUs = RtTime::getNowTimeUs();
+    }
+
+    // writes to fd when valid, to the log otherwise.
+    void dump(INT32 fd = -1) {
+        RtAutoMutex autoLock(mLock);
+        UINT64 total = totalLocked();
+        char line[256];
+        snprintf(line, sizeof(line), "%s startup total %lld us, %d phases\n",
+                 mName.c_str(), (long long)total, (INT32)mPhases.size());
+        output(fd, line);
+        for (size_t i = 0; i < mPhases.size(); i++) {
+            const RTPhaseRecord &phase = mPhases[i];
+            snprintf(line, sizeof(line), "  %-24s start %8lld us cost %8lld us %3d%%%s\n",
+                     phase.name.c_str(), (long long)phase.startUs, (long long)phase.costUs,
+                     (total > 0) ? (INT32)(phase.costUs * 100 / total) : 0,
+                     (mRunning && i == mPhases.size() - 1) ? " (running)" : "");
+            output(fd, line);
+        }
+    }
+
+ private:
+    void endLocked() {
+        if (!mRunning || mPhases.empty()) {
+            return;
+        }
+        RTPhaseRecord &phase = mPhases.back();
+        phase.costUs = RtTime::getNowTimeUs() - mBaseUs - phase.startUs;
+        mRunning = RT_FALSE;
+    }
+
+    UINT64 totalLocked() {
+        UINT64 total = 0;
+        for (size_t i = 0; i < mPhases.size(); i++) {
+            total += mPhases[i].costUs;
+        }
+        return total;
+    }
+
+    void output(INT32 fd, const char *line) {
+        if (fd >= 0) {
+            dprintf(fd, "%s", line);
+        } else {
+            RT_LOGE("%s", line);
+        }
+    }
+
+ private:
+    std::string                 mName;
+    RtMutex                     mLock;
+    UINT64                      mBaseUs;
+    RT_BOOL                     mRunning;
+    std::vector<RTPhaseRecord>  mPhases;
+};
+
+#endif  // SRC_RT_TASK_TASK_GRAPH_RTPHASEPROFILER_H_
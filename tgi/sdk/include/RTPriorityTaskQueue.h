@@ -0,0 +1,264 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *     module: RTPriorityTaskQueue
+ */
+
+#ifndef SRC_RT_TASK_TASK_GRAPH_RTPRIORITYTASKQUEUE_H_
+#define SRC_RT_TASK_TASK_GRAPH_RTPRIORITYTASKQUEUE_H_
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_metadata.h"
+#include "RTDropAccounting.h"
+#include "RTExecutor.h"
+#include "RTMediaBuffer.h"
+#include "RTMediaMetaKeys.h"
+#include "RTNodeCommon.h"
+
+#define RT_NO_DEADLINE      (0x7fffffffffffffffLL)
+
+typedef struct _RTPriorityTaskStat {
+    INT64   scheduled;
+    INT64   executed;
+    INT64   dropped;        // late tasks dropped before running
+    INT64   late;           // late tasks that still ran
+    INT64   maxLateUs;
+    INT32   pending;
+} RTPriorityTaskStat;
+
+/*
+ * maps the pts of one stream to wall clock deadlines. the first pts seen is
+ * anchored to the current time, every later frame is due at
+ * anchor + (pts - firstPts) + budget. a pts jump backwards (seek, loop,
+ * source restart) re-anchors the stream.
+ */
+class RTDeadlineClock {
+ public:
+    explicit RTDeadlineClock(INT64 budgetUs = 0)
+            : mBudgetUs(budgetUs) { reset(); }
+
+    void  setBudget(INT64 budgetUs) { mBudgetUs = budgetUs; }
+    INT64 getBudget() const { return mBudgetUs; }
+
+    void reset() {
+        mBasePts = -1;
+        mBaseTimeUs = 0;
+        mLastPts = -1;
+    }
+
+    INT64 deadlineOf(INT64 ptsUs) {
+        if (mBudgetUs <= 0 || ptsUs < 0) {
+            return RT_NO_DEADLINE;
+        }
+        if (mBasePts < 0 || ptsUs < mLastPts) {
+            mBasePts = ptsUs;
+            mBaseTimeUs = (INT64)RtTime::getNowTimeUs();
+        }
+        mLastPts = ptsUs;
+        return mBaseTimeUs + (ptsUs - mBasePts) + mBudgetUs;
+    }
+
+    INT64 deadlineOf(RTMediaBuffer *buffer) {
+        INT64 pts = -1;
+        if (buffer == RT_NULL || buffer->getMetaData() == RT_NULL
+                || !buffer->getMetaData()->findInt64(kKeyFramePts, &pts)) {
+            return RT_NO_DEADLINE;
+        }
+        return deadlineOf(pts);
+    }
+
+ private:
+    INT64   mBudgetUs;
+    INT64   mBasePts;
+    INT64   mBaseTimeUs;
+    INT64   mLastPts;
+};
+
+/*
+ * ready queue ordered by node priority (OPT_NODE_PRIOR_TYPE, higher first),
+ * then earliest deadline first, then submission order. an executor drains
+ * it through runNextTask(), so a late AI node no longer runs ahead of the
+ * encoder just because it was queued first.
+ *
+ * when drop-late is enabled, tasks whose deadline already passed and that
+ * carry a drop callback are dropped instead of run. callers only pass a
+ * drop callback for buffers flagged RT_MB_FLAG_DROP_IF_FULL, the same
+ * buffers that may be dropped when an input queue is full. every such drop
+ * is also added as RT_DROP_LATE to the counter given to setDropCounter().
+ *
+ * every addTask() hands the executor a pointer to the queue, so the queue
+ * must outlive the executor, or at least every task queued to it: destroy
+ * the executor first. a queue destroyed with tasks pending asserts.
+ */
+class RTPriorityTaskQueue : public RTTaskQueue {
+ public:
+    explicit RTPriorityTaskQueue(RTExecutor *executor)
+            : mExecutor(executor),
+              mDrops(RT_NULL),
+              mDropLate(RT_FALSE),
+              mSeq(0) {
+        rt_memset(&mStat, 0, sizeof(RTPriorityTaskStat));
+    }
+    ~RTPriorityTaskQueue() override {
+        RtAutoMutex autoLock(mLock);
+        // one executor slot per pending task still points at this queue
+        RT_ASSERT(mTasks.empty());
+    }
+
+    RTPriorityTaskQueue(const RTPriorityTaskQueue&) = delete;
+    RTPriorityTaskQueue& operator=(const RTPriorityTaskQueue&) = delete;
+
+    // reads the scheduling options of a node, missing keys keep the defaults.
+    static void readNodeOptions(RtMetaData *options, INT32 *priority,
+                                INT64 *budgetUs, RT_BOOL *dropLate) {
+        INT32 value = 0;
+        if (options == RT_NULL) {
+            return;
+        }
+        if (priority != RT_NULL) {
+            options->findInt32(OPT_NODE_PRIOR_TYPE, priority);
+        }
+        if (budgetUs != RT_NULL && options->findInt32(OPT_NODE_LATENCY_BUDGET, &value)) {
+            *budgetUs = value;
+        }
+        if (dropLate != RT_NULL && options->findInt32(OPT_NODE_DROP_LATE, &value)) {
+            *dropLate = (value != 0) ? RT_TRUE : RT_FALSE;
+        }
+    }
+
+    static RT_BOOL isDroppable(RTMediaBuffer *buffer) {
+        return (buffer != RT_NULL && buffer->hasFlag(RT_MB_FLAG_DROP_IF_FULL)) ? RT_TRUE : RT_FALSE;
+    }
+
+    void setDropLate(RT_BOOL dropLate) {
+        RtAutoMutex autoLock(mLock);
+        mDropLate = dropLate;
+    }
+
+    // e.g. the node counter of RTDropAccounting, must outlive the queue.
+    void setDropCounter(RTDropCounter *drops) {
+        RtAutoMutex autoLock(mLock);
+        mDrops = drops;
+    }
+
+    void addTask(std::function<void()> task, INT32 priority = 0,
+                 INT64 deadlineUs = RT_NO_DEADLINE, std::function<void()> onDrop = nullptr) {
+        {
+            RtAutoMutex autoLock(mLock);
+            RTPriorityTask item;
+            item.task       = std::move(task);
+            item.onDrop     = std::move(onDrop);
+            item.priority   = priority;
+            item.deadlineUs = deadlineUs;
+            item.seq        = mSeq++;
+            mTasks.push_back(std::move(item));
+            std::push_heap(mTasks.begin(), mTasks.end(), RTPriorityTaskLess());
+            mStat.scheduled++;
+        }
+        // one executor slot per task, runNextTask() decides which one runs.
+        mExecutor->addTask(this);
+    }
+
+    void runNextTask() override {
+        RTPriorityTask item;
+        RT_BOOL drop = RT_FALSE;
+        {
+            RtAutoMutex autoLock(mLock);
+            if (mTasks.empty()) {
+                return;
+            }
+            std::pop_heap(mTasks.begin(), mTasks.end(), RTPriorityTaskLess());
+            item = std::move(mTasks.back());
+            mTasks.pop_back();
+            if (item.deadlineUs != RT_NO_DEADLINE) {
+                INT64 lateUs = (INT64)RtTime::getNowTimeUs() - item.deadlineUs;
+                if (lateUs > 0) {
+                    drop = (mDropLate && item.onDrop) ? RT_TRUE : RT_FALSE;
+                    if (drop) {
+                        mStat.dropped++;
+                        if (mDrops != RT_NULL) {
+                            mDrops->add(RT_DROP_LATE);
+                        }
+                    } else {
+                        mStat.late++;
+                    }
+                    if (lateUs > mStat.maxLateUs) {
+                        mStat.maxLateUs = lateUs;
+                    }
+                }
+            }
+            if (!drop) {
+                mStat.executed++;
+            }
+        }
+        if (drop) {
+            item.onDrop();
+        } else if (item.task) {
+            item.task();
+        }
+    }
+
+    void queryStat(RTPriorityTaskStat *stat) {
+        RtAutoMutex autoLock(mLock);
+        *stat = mStat;
+        stat->pending = (INT32)mTasks.size();
+    }
+
+    RT_RET dump() {
+        RTPriorityTaskStat stat;
+        queryStat(&stat);
+        RT_LOGE("priority queue scheduled(%lld) executed(%lld) dropped(%lld) late(%lld) "
+                "max-late(%lld us) pending(%d)",
+                 stat.scheduled, stat.executed, stat.dropped, stat.late,
+                 stat.maxLateUs, stat.pending);
+        return RT_OK;
+    }
+
+ private:
+    typedef struct RTPriorityTask {
+        std::function<void()>   task;
+        std::function<void()>   onDrop;
+        INT32                   priority;
+        INT64                   deadlineUs;
+        UINT64                  seq;
+    } RTPriorityTask;
+
+    // heap comparator, "less" means runs later.
+    struct RTPriorityTaskLess {
+        bool operator()(const RTPriorityTask &a, const RTPriorityTask &b) const {
+            if (a.priority != b.priority) {
+                return a.priority < b.priority;
+            }
+            if (a.deadlineUs != b.deadlineUs) {
+                return a.deadlineUs > b.deadlineUs;
+            }
+            return a.seq > b.seq;
+        }
+    };
+
+    RTExecutor                     *mExecutor;
+    RTDropCounter                  *mDrops;
+    RtMutex                         mLock;
+    RT_BOOL                         mDropLate;
+    UINT64                          mSeq;
+    std::vector<RTPriorityTask>     mTasks;
+    RTPriorityTaskStat              mStat;
+};
+
+#endif  // SRC_RT_TASK_TASK_GRAPH_RTPRIORITYTASKQUEUE_H_
@@ -0,0 +1,367 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *     module: RTSharedPoolManager
+ */
+
+#ifndef SRC_RT_TASK_TASK_GRAPH_RTSHAREDPOOLMANAGER_H_
+#define SRC_RT_TASK_TASK_GRAPH_RTSHAREDPOOLMANAGER_H_
+
+#include <stdlib.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "rt_header.h"
+#include "RTMediaBuffer.h"
+
+class RTMediaBuffer;
+
+// largest size class, bigger requests are refused.
+#define RT_SHARED_MAX_CLASS_SIZE    0x80000000U
+
+// one block of backing memory, a dma buffer or plain heap memory.
+typedef struct _RTSharedBlock {
+    void           *data;
+    UINT32          size;       // size class, may exceed the requested size
+    INT32           fd;
+    INT32           handle;
+    INT32           streamId;   // owner while in use
+    RTMediaBuffer  *buffer;     // wrapper of acquireBuffer(), lives as long as the block
+} RTSharedBlock;
+
+// backing memory provider, e.g. drm/dma-heap on device.
+typedef struct _RTSharedAllocator {
+    void*  (*alloc)(UINT32 size, INT32 *fd, INT32 *handle);
+    void   (*free)(void *data, UINT32 size, INT32 fd, INT32 handle);
+} RTSharedAllocator;
+
+typedef struct _RTSharedStreamStat {
+    INT32   inUse;
+    INT32   highWater;      // most blocks the stream held at once
+    INT64   inUseBytes;
+    INT64   highWaterBytes;
+    UINT32  largestClass;   // largest block acquired since the last resetHighWater()
+    INT64   acquires;
+    INT64   misses;         // acquires that had to allocate
+} RTSharedStreamStat;
+
+typedef struct _RTSharedPoolStat {
+    INT64   allocatedBytes; // in use + cached
+    INT64   inUseBytes;
+    INT64   cachedBytes;
+    INT64   peakBytes;      // high-water of allocatedBytes
+    INT64   steadyBytes;    // EWMA of inUseBytes, what the graphs really need
+    INT32   allocatedBlocks;
+    INT32   cachedBlocks;
+    INT64   allocs;
+    INT64   frees;
+} RTSharedPoolStat;
+
+/*
+ * buffer memory shared by every node and every graph of the process,
+ * instead of one fixed node_buff_count x node_buff_size pool per node.
+ *
+ * blocks are bucketed in size classes of a quarter power of two (4M, 5M,
+ * 6M, 7M, 8M, ...), so frames of similar size reuse each other's memory
+ * with at most 25% slack. every stream keeps a high-water mark of what it
+ * held at once; trim() gives the cached blocks above the high-water back
+ * between graph runs, trim(RT_TRUE) gives all of them back.
+ *
+ *     RTSharedPoolManager *pools = RTSharedPoolManager::instance();
+ *     INT32 stream = pools->registerStream("isp_bypass");
+ *     RTMediaBuffer *buffer = pools->acquireBuffer(stream, 5529600);
+ *     ...
+ *     buffer->release();      // memory goes back to the size class
+ */
+class RTSharedPoolManager : public RTBufferListener {
+ public:
+    static RTSharedPoolManager* instance() {
+        static RTSharedPoolManager sManager;
+        return &sManager;
+    }
+
+    // must be called before the first acquire.
+    void setAllocator(const RTSharedAllocator &allocator) {
+        RtAutoMutex autoLock(mLock);
+        mAllocator = allocator;
+    }
+
+    INT32 registerStream(const std::string &name) {
+        RtAutoMutex autoLock(mLock);
+        for (size_t i = 0; i < mStreams.size(); i++) {
+            if (mStreams[i].name == name) {
+                return (INT32)i;
+            }
+        }
+        RTSharedStream stream;
+        stream.name = name;
+        rt_memset(&stream.stat, 0, sizeof(RTSharedStreamStat));
+        mStreams.push_back(stream);
+        return (INT32)mStreams.size() - 1;
+    }
+
+    // 0 when size is above RT_SHARED_MAX_CLASS_SIZE.
+    static UINT32 sizeClassOf(UINT32 size) {
+        if (size > RT_SHARED_MAX_CLASS_SIZE) {
+            return 0;
+        }
+        UINT32 pow2 = 4096;
+        while (pow2 < size) {
+            pow2 <<= 1;
+        }
+        if (pow2 <= 4096) {
+            return 4096;
+        }
+        UINT32 step = (pow2 >> 1) / 4;
+        UINT32 cls = pow2 >> 1;
+        while (cls < size) {
+            cls += step;
+        }
+        return cls;
+    }
+
+    RTSharedBlock* acquireBlock(INT32 streamId, UINT32 size) {
+        RtAutoMutex autoLock(mLock);
+        if (streamId < 0 || streamId >= (INT32)mStreams.size() || size == 0) {
+            return RT_NULL;
+        }
+        UINT32 cls = sizeClassOf(size);
+        if (cls == 0) {
+            RT_LOGE("shared pool can not hold %u bytes for %s, max %u",
+                     size, mStreams[streamId].name.c_str(), RT_SHARED_MAX_CLASS_SIZE);
+            return RT_NULL;
+        }
+        RTSharedStreamStat &stat = mStreams[streamId].stat;
+        RTSharedBlock *block = RT_NULL;
+        std::vector<RTSharedBlock *> &bucket = mBuckets[cls];
+        stat.acquires++;
+        if (!bucket.empty()) {
+            block = bucket.back();
+            bucket.pop_back();
+            mStat.cachedBytes -= cls;
+            mStat.cachedBlocks--;
+        } else {
+            block = new RTSharedBlock();
+            block->fd = -1;
+            block->handle = 0;
+            block->size = cls;
+            block->buffer = RT_NULL;
+            block->data = mAllocator.alloc(cls, &block->fd, &block->handle);
+            if (block->data == RT_NULL) {
+                RT_LOGE("shared pool alloc %d bytes for %s failed",
+                         cls, mStreams[streamId].name.c_str());
+                delete block;
+                return RT_NULL;
+            }
+            stat.misses++;
+            mStat.allocs++;
+            mStat.allocatedBlocks++;
+            mStat.allocatedBytes += cls;
+            if (mStat.allocatedBytes > mStat.peakBytes) {
+                mStat.peakBytes = mStat.allocatedBytes;
+            }
+        }
+        block->streamId = streamId;
+        stat.inUse++;
+        stat.inUseBytes += cls;
+        if (stat.inUse > stat.highWater) {
+            stat.highWater = stat.inUse;
+        }
+        if (stat.inUseBytes > stat.highWaterBytes) {
+            stat.highWaterBytes = stat.inUseBytes;
+        }
+        if (cls > stat.largestClass) {
+            stat.largestClass = cls;
+        }
+        mStat.inUseBytes += cls;
+        // 1/16 weight, smooths the per-frame swing of in-use memory.
+        mStat.steadyBytes += (mStat.inUseBytes - mStat.steadyBytes) / 16;
+        return block;
+    }
+
+    void releaseBlock(RTSharedBlock *block) {
+        RtAutoMutex autoLock(mLock);
+        if (block == RT_NULL) {
+            return;
+        }
+        RTSharedStreamStat &stat = mStreams[block->streamId].stat;
+        stat.inUse--;
+        stat.inUseBytes -= block->size;
+        mStat.inUseBytes -= block->size;
+        mStat.cachedBytes += block->size;
+        mStat.cachedBlocks++;
+        block->streamId = -1;
+        mBuckets[block->size].push_back(block);
+    }
+
+    /*
+     * wraps a block in a media buffer, release() hands the block back. the
+     * wrapper is created with the block and reused by every later acquire,
+     * like the buffers of a node pool, so it must not be deleted.
+     */
+    RTMediaBuffer* acquireBuffer(INT32 streamId, UINT32 size) {
+        RTSharedBlock *block = acquireBlock(streamId, size);
+        if (block == RT_NULL) {
+            return RT_NULL;
+        }
+        RTMediaBuffer *buffer = block->buffer;
+        if (buffer == RT_NULL) {
+            buffer = new RTMediaBuffer(block->data, block->size, block->handle, block->fd);
+            buffer->setUserData(block);
+            buffer->setListener(this);
+            block->buffer = buffer;
+        } else {
+            buffer->reset();
+        }
+        buffer->setRange(0, size);
+        return buffer;
+    }
+
+    /*
+     * gives cached memory back. by default every size class keeps as many
+     * blocks as the streams using it needed at their high-water mark, with
+     * all set every cached block is freed, e.g. after the last graph stopped.
+     */
+    void trim(RT_BOOL all = RT_FALSE) {
+        std::vector<RTSharedBlock *> frees;
+        {
+            RtAutoMutex autoLock(mLock);
+            std::map<UINT32, INT32> keeps;
+            if (!all) {
+                highWaterByClass(&keeps);
+            }
+            std::map<UINT32, std::vector<RTSharedBlock *> >::iterator it;
+            for (it = mBuckets.begin(); it != mBuckets.end(); ++it) {
+                INT32 keep = all ? 0 : keeps[it->first];
+                while ((INT32)it->second.size() > keep) {
+                    frees.push_back(it->second.back());
+                    it->second.pop_back();
+                }
+            }
+            for (size_t i = 0; i < frees.size(); i++) {
+                mStat.cachedBytes -= frees[i]->size;
+                mStat.cachedBlocks--;
+                mStat.allocatedBytes -= frees[i]->size;
+                mStat.allocatedBlocks--;
+                mStat.frees++;
+            }
+        }
+        for (size_t i = 0; i < frees.size(); i++) {
+            rt_safe_delete(frees[i]->buffer);
+            mAllocator.free(frees[i]->data, frees[i]->size, frees[i]->fd, frees[i]->handle);
+            delete frees[i];
+        }
+    }
+
+    // starts a new measuring period, e.g. when a graph run begins.
+    void resetHighWater() {
+        RtAutoMutex autoLock(mLock);
+        for (size_t i = 0; i < mStreams.size(); i++) {
+            mStreams[i].stat.highWater = mStreams[i].stat.inUse;
+            mStreams[i].stat.highWaterBytes = mStreams[i].stat.inUseBytes;
+            mStreams[i].stat.largestClass = 0;
+        }
+        mStat.peakBytes = mStat.allocatedBytes;
+    }
+
+    void queryStat(RTSharedPoolStat *stat) {
+        RtAutoMutex autoLock(mLock);
+        *stat = mStat;
+    }
+
+    RT_RET queryStreamStat(INT32 streamId, RTSharedStreamStat *stat) {
+        RtAutoMutex autoLock(mLock);
+        if (streamId < 0 || streamId >= (INT32)mStreams.size()) {
+            return RT_ERR_OUTOF_RANGE;
+        }
+        *stat = mStreams[streamId].stat;
+        return RT_OK;
+    }
+
+    RT_RET dump() {
+        RtAutoMutex autoLock(mLock);
+        RT_LOGE("shared pool allocated(%lld KB, %d blocks) in-use(%lld KB) cached(%lld KB) "
+                "peak(%lld KB) steady(%lld KB)",
+                 mStat.allocatedBytes >> 10, mStat.allocatedBlocks, mStat.inUseBytes >> 10,
+                 mStat.cachedBytes >> 10, mStat.peakBytes >> 10, mStat.steadyBytes >> 10);
+        for (size_t i = 0; i < mStreams.size(); i++) {
+            RTSharedStreamStat &stat = mStreams[i].stat;
+            RT_LOGE("  stream(%s) in-use(%d) high-water(%d, %lld KB) acquires(%lld) misses(%lld)",
+                     mStreams[i].name.c_str(), stat.inUse, stat.highWater,
+                     stat.highWaterBytes >> 10, stat.acquires, stat.misses);
+        }
+        return RT_OK;
+    }
+
+ public:
+    // RTBufferListener
+    void onBufferAvailable(void *buffer) { (void)buffer; }
+    void onBufferRealloc(void *buffer, UINT32 size) {
+        (void)buffer;
+        (void)size;
+    }
+    void onBufferRelease(void *buffer, RT_BOOL render) {
+        (void)render;
+        RTMediaBuffer *mb = reinterpret_cast<RTMediaBuffer *>(buffer);
+        releaseBlock(reinterpret_cast<RTSharedBlock *>(mb->getUserData()));
+    }
+
+ private:
+    typedef struct RTSharedStream {
+        std::string         name;
+        RTSharedStreamStat  stat;
+    } RTSharedStream;
+
+    RTSharedPoolManager() {
+        rt_memset(&mStat, 0, sizeof(RTSharedPoolStat));
+        mAllocator.alloc = heapAlloc;
+        mAllocator.free  = heapFree;
+    }
+    ~RTSharedPoolManager() { trim(RT_TRUE); }
+
+    static void* heapAlloc(UINT32 size, INT32 *fd, INT32 *handle) {
+        *fd = -1;
+        *handle = 0;
+        return malloc(size);
+    }
+    static void heapFree(void *data, UINT32 size, INT32 fd, INT32 handle) {
+        (void)size;
+        (void)fd;
+        (void)handle;
+        free(data);
+    }
+
+    // per size class, the high-water blocks of the streams that used it
+    // last. a stream is counted in the class of its largest block.
+    void highWaterByClass(std::map<UINT32, INT32> *keeps) {
+        for (size_t i = 0; i < mStreams.size(); i++) {
+            const RTSharedStreamStat &stat = mStreams[i].stat;
+            if (stat.highWater <= stat.inUse) {
+                continue;
+            }
+            (*keeps)[stat.largestClass] += stat.highWater - stat.inUse;
+        }
+    }
+
+ private:
+    RtMutex                                         mLock;
+    RTSharedAllocator                               mAllocator;
+    std::vector<RTSharedStream>                     mStreams;
+    std::map<UINT32, std::vector<RTSharedBlock *> > mBuckets;
+    RTSharedPoolStat                                mStat;
+};
+
+#endif  // SRC_RT_TASK_TASK_GRAPH_RTSHAREDPOOLMANAGER_H_
@@ -0,0 +1,330 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *     module: RTStreamQueue
+ */
+
+#ifndef SRC_RT_TASK_TASK_GRAPH_RTSTREAMQUEUE_H_
+#define SRC_RT_TASK_TASK_GRAPH_RTSTREAMQUEUE_H_
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "rt_header.h"
+
+class RTMediaBuffer;
+
+static inline UINT32 rt_queue_round_pow2(UINT32 value) {
+    UINT32 cap = 2;
+    while (cap < value) {
+        cap <<= 1;
+    }
+    return cap;
+}
+
+/*
+ * bounded single-producer/single-consumer ring, used for 1:1 links.
+ * each side keeps a cached copy of the other side's index so the common
+ * case is one relaxed load, one store and no shared cache line ping-pong.
+ */
+template <typename T>
+class RTSpscQueue {
+ public:
+    explicit RTSpscQueue(UINT32 capacity)
+            : mMask(rt_queue_round_pow2(capacity) - 1),
+              mHead(0),
+              mTailCache(0),
+              mTail(0),
+              mHeadCache(0) {
+        mSlots = new T[mMask + 1];
+    }
+    ~RTSpscQueue() { delete[] mSlots; }
+
+    RTSpscQueue(const RTSpscQueue&) = delete;
+    RTSpscQueue& operator=(const RTSpscQueue&) = delete;
+
+    // producer side
+    RT_BOOL push(const T &item) {
+        UINT64 tail = mTail.load(std::memory_order_relaxed);
+        if (tail - mHeadCache > mMask) {
+            mHeadCache = mHead.load(std::memory_order_acquire);
+            if (tail - mHeadCache > mMask) {
+                return RT_FALSE;
+            }
+        }
+        mSlots[tail & mMask] = item;
+        mTail.store(tail + 1, std::memory_order_release);
+        return RT_TRUE;
+    }
+
+    // consumer side
+    RT_BOOL pop(T *item) {
+        UINT64 head = mHead.load(std::memory_order_relaxed);
+        if (head == mTailCache) {
+            mTailCache = mTail.load(std::memory_order_acquire);
+            if (head == mTailCache) {
+                return RT_FALSE;
+            }
+        }
+        *item = mSlots[head & mMask];
+        mHead.store(head + 1, std::memory_order_release);
+        return RT_TRUE;
+    }
+
+    // consumer side
+    RT_BOOL front(T *item) {
+        UINT64 head = mHead.load(std::memory_order_relaxed);
+        if (head == mTail.load(std::memory_order_acquire)) {
+            return RT_FALSE;
+        }
+        *item = mSlots[head & mMask];
+        return RT_TRUE;
+    }
+
+    INT32 size() const {
+        return (INT32)(mTail.load(std::memory_order_acquire) - mHead.load(std::memory_order_acquire));
+    }
+    INT32 capacity() const { return (INT32)(mMask + 1); }
+
+ private:
+    const UINT64        mMask;
+    T                  *mSlots;
+    // consumer owned
+    std::atomic<UINT64> mHead;
+    UINT64              mTailCache;
+    char                mPad[64];
+    // producer owned
+    std::atomic<UINT64> mTail;
+    UINT64              mHeadCache;
+};
+
+/*
+ * bounded multi-producer/single-consumer ring, used for fan-in links.
+ * every slot carries a sequence number, producers claim a slot with one
+ * CAS on the tail and publish it by bumping the slot sequence.
+ */
+template <typename T>
+class RTMpscQueue {
+ public:
+    explicit RTMpscQueue(UINT32 capacity)
+            : mMask(rt_queue_round_pow2(capacity) - 1),
+              mTail(0),
+              mHead(0) {
+        mCells = new RTCell[mMask + 1];
+        for (UINT64 i = 0; i <= mMask; i++) {
+            mCells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+    ~RTMpscQueue() { delete[] mCells; }
+
+    RTMpscQueue(const RTMpscQueue&) = delete;
+    RTMpscQueue& operator=(const RTMpscQueue&) = delete;
+
+    // any producer
+    RT_BOOL push(const T &item) {
+        UINT64 pos = mTail.load(std::memory_order_relaxed);
+        RTCell *cell = RT_NULL;
+        while (1) {
+            cell = &mCells[pos & mMask];
+            UINT64 seq = cell->seq.load(std::memory_order_acquire);
+            INT64 diff = (INT64)seq - (INT64)pos;
+            if (diff == 0) {
+                if (mTail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return RT_FALSE;
+            } else {
+                pos = mTail.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = item;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return RT_TRUE;
+    }
+
+    // single consumer
+    RT_BOOL pop(T *item) {
+        UINT64 pos = mHead.load(std::memory_order_relaxed);
+        RTCell *cell = &mCells[pos & mMask];
+        if (cell->seq.load(std::memory_order_acquire) != pos + 1) {
+            return RT_FALSE;
+        }
+        *item = cell->data;
+        cell->seq.store(pos + mMask + 1, std::memory_order_release);
+        mHead.store(pos + 1, std::memory_order_release);
+        return RT_TRUE;
+    }
+
+    // single consumer
+    RT_BOOL front(T *item) {
+        UINT64 pos = mHead.load(std::memory_order_relaxed);
+        RTCell *cell = &mCells[pos & mMask];
+        if (cell->seq.load(std::memory_order_acquire) != pos + 1) {
+            return RT_FALSE;
+        }
+        *item = cell->data;
+        return RT_TRUE;
+    }
+
+    // approximate while producers are running.
+    INT32 size() const {
+        INT64 size = (INT64)mTail.load(std::memory_order_acquire)
+                   - (INT64)mHead.load(std::memory_order_acquire);
+        return size > 0 ? (INT32)size : 0;
+    }
+    INT32 capacity() const { return (INT32)(mMask + 1); }
+
+ private:
+    typedef struct RTCell {
+        std::atomic<UINT64> seq;
+        T                   data;
+    } RTCell;
+
+    const UINT64        mMask;
+    RTCell             *mCells;
+    std::atomic<UINT64> mTail;
+    char                mPad[64];
+    std::atomic<UINT64> mHead;
+};
+
+/*
+ * input streams of a node resolved to integer slots. stream names are
+ * looked up once (at prepareForRun time), after that every queue/deque
+ * call is an array index plus one lock-free ring operation.
+ *
+ * streams with a single upstream producer use the SPSC ring, fan-in
+ * streams (numProducers > 1) use the MPSC ring.
+ */
+class RTInputStreamSlots {
+ public:
+    RTInputStreamSlots() {}
+    ~RTInputStreamSlots() { clear(); }
+
+    RTInputStreamSlots(const RTInputStreamSlots&) = delete;
+    RTInputStreamSlots& operator=(const RTInputStreamSlots&) = delete;
+
+    // returns the slot of the stream, must not race with queue/deque.
+    INT32 addStream(const std::string &streamType, INT32 numProducers, UINT32 capacity) {
+        std::map<std::string, INT32>::iterator it = mSlotMaps.find(streamType);
+        if (it != mSlotMaps.end()) {
+            return it->second;
+        }
+        RTStreamSlot slot;
+        slot.name = streamType;
+        slot.spsc = RT_NULL;
+        slot.mpsc = RT_NULL;
+        if (numProducers > 1) {
+            slot.mpsc = new RTMpscQueue<RTMediaBuffer *>(capacity);
+        } else {
+            slot.spsc = new RTSpscQueue<RTMediaBuffer *>(capacity);
+        }
+        mSlots.push_back(slot);
+        INT32 index = (INT32)mSlots.size() - 1;
+        mSlotMaps[streamType] = index;
+        return index;
+    }
+
+    INT32 slotOf(const std::string &streamType) const {
+        std::map<std::string, INT32>::const_iterator it = mSlotMaps.find(streamType);
+        return (it == mSlotMaps.end()) ? RT_INVALID_STREAM_SLOT : it->second;
+    }
+
+    INT32 numStreams() const { return (INT32)mSlots.size(); }
+    const std::string& streamName(INT32 slot) const { return mSlots[slot].name; }
+
+    RT_RET queueInputBuffer(INT32 slot, RTMediaBuffer *buffer) {
+        if (slot < 0 || slot >= (INT32)mSlots.size()) {
+            return RT_ERR_OUTOF_RANGE;
+        }
+        RTStreamSlot &s = mSlots[slot];
+        RT_BOOL ok = (s.spsc != RT_NULL) ? s.spsc->push(buffer) : s.mpsc->push(buffer);
+        return ok ? RT_OK : RT_ERR_LIST_FULL;
+    }
+
+    RTMediaBuffer* dequeInputBuffer(INT32 slot) {
+        RTMediaBuffer *buffer = RT_NULL;
+        if (slot < 0 || slot >= (INT32)mSlots.size()) {
+            return RT_NULL;
+        }
+        RTStreamSlot &s = mSlots[slot];
+        if (s.spsc != RT_NULL) {
+            s.spsc->pop(&buffer);
+        } else {
+            s.mpsc->pop(&buffer);
+        }
+        return buffer;
+    }
+
+    RTMediaBuffer* inputHeadBuffer(INT32 slot) {
+        RTMediaBuffer *buffer = RT_NULL;
+        if (slot < 0 || slot >= (INT32)mSlots.size()) {
+            return RT_NULL;
+        }
+        RTStreamSlot &s = mSlots[slot];
+        if (s.spsc != RT_NULL) {
+            s.spsc->front(&buffer);
+        } else {
+            s.mpsc->front(&buffer);
+        }
+        return buffer;
+    }
+
+    INT32 inputQueueSize(INT32 slot) const {
+        if (slot < 0 || slot >= (INT32)mSlots.size()) {
+            return 0;
+        }
+        const RTStreamSlot &s = mSlots[slot];
+        return (s.spsc != RT_NULL) ? s.spsc->size() : s.mpsc->size();
+    }
+
+    RT_BOOL inputIsEmpty(INT32 slot) const {
+        return inputQueueSize(slot) == 0;
+    }
+
+    // buffers still queued are handed back to the caller through drain().
+    void drain(INT32 slot, std::vector<RTMediaBuffer *> *buffers) {
+        RTMediaBuffer *buffer = RT_NULL;
+        while ((buffer = dequeInputBuffer(slot)) != RT_NULL) {
+            buffers->push_back(buffer);
+        }
+    }
+
+    void clear() {
+        for (size_t i = 0; i < mSlots.size(); i++) {
+            rt_safe_delete(mSlots[i].spsc);
+            rt_safe_delete(mSlots[i].mpsc);
+        }
+        mSlots.clear();
+        mSlotMaps.clear();
+    }
+
+ public:
+    enum { RT_INVALID_STREAM_SLOT = -1 };
+
+ private:
+    typedef struct RTStreamSlot {
+        std::string                      name;
+        RTSpscQueue<RTMediaBuffer *>    *spsc;
+        RTMpscQueue<RTMediaBuffer *>    *mpsc;
+    } RTStreamSlot;
+
+    std::vector<RTStreamSlot>       mSlots;
+    std::map<std::string, INT32>    mSlotMaps;
+};
+
+#endif  // SRC_RT_TASK_TASK_GRAPH_RTSTREAMQUEUE_H_
@@ -0,0 +1,282 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *     module: RTThumbnailBatch
+ */
+
+#ifndef SRC_RT_PLAYER_RTTHUMBNAILBATCH_H_
+#define SRC_RT_PLAYER_RTTHUMBNAILBATCH_H_
+
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_metadata.h"
+#include "rt_thread.h"
+#include "RTMediaBuffer.h"
+#include "RTMediaMetaKeys.h"
+#include "RTMetadataRetriever.h"
+
+#define RT_THUMBNAIL_MAX_WORKERS    4
+
+// index into the caller's timestamp list, frame is RT_NULL on failure and
+// belongs to the callee otherwise. runs on the worker threads, one at a time.
+typedef std::function<void(INT32 index, INT64 timeUs, RTMediaBuffer *frame)> RTThumbnailCallback;
+
+typedef struct _RTThumbnailStat {
+    INT32   requested;
+    INT32   decoded;        // distinct timestamps sent to a decoder
+    INT32   failed;
+    INT32   workers;
+    INT64   firstFrameUs;   // batch start to the first delivered frame
+    INT64   elapsedUs;
+    float   thumbsPerSec;
+} RTThumbnailStat;
+
+/*
+ * batch front end of RTMetadataRetriever for thumbnail strips. timestamps
+ * are sorted and deduplicated, then cut into ascending runs; every worker
+ * keeps one retriever (extractor and decoder) open for the whole batch and
+ * takes the next run when it is done, so a decoder only ever seeks forward
+ * and the runs of several workers demux and decode in parallel. frames are
+ * delivered as soon as they are ready, not in request order:
+ *
+ *     RTThumbnailBatch batch(2);
+ *     batch.setDataSource("/sdcard/movie.mp4");
+ *     batch.getFramesAtTimes(times, options, onThumbnail, &stat);
+ *
+ * options are copied into every per-frame request, e.g. with
+ * kRetrieverDstColorFormat or kRetrieverFrameOption.
+ */
+class RTThumbnailBatch {
+ public:
+    explicit RTThumbnailBatch(INT32 workers = 2)
+            : mWorkers(std::max(1, std::min(workers, RT_THUMBNAIL_MAX_WORKERS))),
+              mFd(-1),
+              mOffset(0),
+              mLength(0),
+              mOptions(RT_NULL),
+              mNextRun(0),
+              mBeginUs(0) {
+        rt_memset(&mStat, 0, sizeof(RTThumbnailStat));
+    }
+    ~RTThumbnailBatch() { releaseRetrievers(); }
+
+    RTThumbnailBatch(const RTThumbnailBatch&) = delete;
+    RTThumbnailBatch& operator=(const RTThumbnailBatch&) = delete;
+
+    RT_RET setDataSource(const char *url, const char *headers = RT_NULL) {
+        releaseRetrievers();
+        mUrl = (url != RT_NULL) ? url : "";
+        mHeaders = (headers != RT_NULL) ? headers : "";
+        mFd = -1;
+        return mUrl.empty() ? RT_ERR_NULL_PTR : RT_OK;
+    }
+
+    // the retrievers would share the file offset of one fd, so fd sources
+    // run on a single worker.
+    RT_RET setDataSource(INT32 fd, INT64 offset, INT64 length) {
+        releaseRetrievers();
+        mUrl.clear();
+        mFd = fd;
+        mOffset = offset;
+        mLength = length;
+        return (fd >= 0) ? RT_OK : RT_ERR_VALUE;
+    }
+
+    RT_RET getFramesAtTimes(const std::vector<INT64> &timesUs, RtMetaData *options,
+                            RTThumbnailCallback callback, RTThumbnailStat *stat = RT_NULL) {
+        RtAutoMutex batchLock(mBatchLock);
+        rt_memset(&mStat, 0, sizeof(RTThumbnailStat));
+        mStat.requested = (INT32)timesUs.size();
+        mBeginUs = RtTime::getNowTimeUs();
+        mCallback = callback;
+        mOptions = options;
+
+        // sorted (time, index) pairs, equal times are decoded once.
+        mRequests.clear();
+        for (size_t i = 0; i < timesUs.size(); i++) {
+            mRequests.push_back(std::make_pair(timesUs[i], (INT32)i));
+        }
+        std::sort(mRequests.begin(), mRequests.end());
+        splitRuns();
+
+        INT32 workers = (mFd >= 0) ? 1 : std::min(mWorkers, (INT32)mRuns.size());
+        RT_RET ret = openRetrievers(workers);
+        if (ret != RT_OK) {
+            return ret;
+        }
+        mStat.workers = workers;
+        mNextRun = 0;
+
+        std::vector<RtThread *> threads;
+        for (INT32 i = 1; i < workers; i++) {
+            RtThread *thread = new RtThread(workerLoop, new RTThumbnailWorker(this, i));
+            thread->setName("thumbnail");
+            thread->start();
+            threads.push_back(thread);
+        }
+        if (workers > 0) {
+            RTThumbnailWorker self(this, 0);
+            runWorker(&self);
+        }
+        for (size_t i = 0; i < threads.size(); i++) {
+            threads[i]->join();
+            delete threads[i];
+        }
+
+        mStat.elapsedUs = (INT64)(RtTime::getNowTimeUs() - mBeginUs);
+        mStat.thumbsPerSec = (mStat.elapsedUs > 0)
+                ? (mStat.requested - mStat.failed) * 1000000.0f / mStat.elapsedUs : 0.0f;
+        RT_LOGD("thumbnails requested(%d) decoded(%d) failed(%d) workers(%d) first(%lld us) "
+                "elapsed(%lld us) %.2f thumbs/s",
+                 mStat.requested, mStat.decoded, mStat.failed, mStat.workers,
+                 mStat.firstFrameUs, mStat.elapsedUs, mStat.thumbsPerSec);
+        if (stat != RT_NULL) {
+            *stat = mStat;
+        }
+        mOptions = RT_NULL;
+        return (mStat.failed == mStat.requested && mStat.requested > 0) ? RT_ERR_UNKNOWN : RT_OK;
+    }
+
+ private:
+    typedef struct RTThumbnailWorker {
+        RTThumbnailWorker(RTThumbnailBatch *owner, INT32 index) : batch(owner), id(index) {}
+        RTThumbnailBatch   *batch;
+        INT32               id;
+    } RTThumbnailWorker;
+
+    // [begin, end) of mRequests, one forward seek sequence each.
+    typedef std::pair<size_t, size_t> RTThumbnailRun;
+
+    // about two runs per worker, runs stay long enough to reuse the decoder
+    // and short enough that a fast worker can pick up more of the tail.
+    void splitRuns() {
+        mRuns.clear();
+        size_t count = mRequests.size();
+        size_t pieces = (size_t)mWorkers * 2;
+        size_t runSize = std::max((size_t)1, (count + pieces - 1) / pieces);
+        for (size_t begin = 0; begin < count; begin += runSize) {
+            mRuns.push_back(RTThumbnailRun(begin, std::min(count, begin + runSize)));
+        }
+    }
+
+    RT_RET openRetrievers(INT32 count) {
+        while ((INT32)mRetrievers.size() < count) {
+            RTMetadataRetriever *retriever = new RTMetadataRetriever();
+            RT_RET ret = (mFd >= 0)
+                    ? retriever->setDataSource(mFd, mOffset, mLength)
+                    : retriever->setDataSource(mUrl.c_str(), mHeaders.empty() ? RT_NULL : mHeaders.c_str());
+            if (ret != RT_OK) {
+                RT_LOGE("thumbnail retriever %d set data source failed, ret = %d",
+                         (INT32)mRetrievers.size(), ret);
+                delete retriever;
+                return ret;
+            }
+            mRetrievers.push_back(retriever);
+        }
+        return RT_OK;
+    }
+
+    void releaseRetrievers() {
+        for (size_t i = 0; i < mRetrievers.size(); i++) {
+            delete mRetrievers[i];
+        }
+        mRetrievers.clear();
+    }
+
+    RT_BOOL takeRun(RTThumbnailRun *run) {
+        RtAutoMutex autoLock(mLock);
+        if (mNextRun >= mRuns.size()) {
+            return RT_FALSE;
+        }
+        *run = mRuns[mNextRun++];
+        return RT_TRUE;
+    }
+
+    void runWorker(RTThumbnailWorker *worker) {
+        RTMetadataRetriever *retriever = mRetrievers[worker->id];
+        RTThumbnailRun run;
+        while (takeRun(&run)) {
+            size_t i = run.first;
+            while (i < run.second) {
+                INT64 timeUs = mRequests[i].first;
+                size_t end = i + 1;
+                while (end < run.second && mRequests[end].first == timeUs) {
+                    end++;
+                }
+                RtMetaData request;
+                if (mOptions != RT_NULL) {
+                    request = *mOptions;
+                }
+                request.setInt64(kRetrieverFrameAtTime, timeUs);
+                RTMediaBuffer *frame = retriever->getSingleFrameAtTime(&request);
+                deliver(i, end, frame);
+                i = end;
+            }
+        }
+    }
+
+    // one decoded frame for the requests [begin, end) of equal time.
+    void deliver(size_t begin, size_t end, RTMediaBuffer *frame) {
+        {
+            RtAutoMutex autoLock(mLock);
+            mStat.decoded++;
+            if (frame == RT_NULL) {
+                mStat.failed += (INT32)(end - begin);
+            } else if (mStat.firstFrameUs == 0) {
+                mStat.firstFrameUs = (INT64)(RtTime::getNowTimeUs() - mBeginUs);
+            }
+        }
+        for (size_t i = begin; i < end; i++) {
+            if (frame != RT_NULL && i + 1 < end) {
+                frame->addRefs();
+            }
+            RtAutoMutex callbackLock(mCallbackLock);
+            mCallback(mRequests[i].second, mRequests[i].first, frame);
+        }
+    }
+
+    static void* workerLoop(void *data) {
+        RTThumbnailWorker *worker = reinterpret_cast<RTThumbnailWorker *>(data);
+        worker->batch->runWorker(worker);
+        delete worker;
+        return RT_NULL;
+    }
+
+ private:
+    const INT32                             mWorkers;
+    std::string                             mUrl;
+    std::string                             mHeaders;
+    INT32                                   mFd;
+    INT64                                   mOffset;
+    INT64                                   mLength;
+    std::vector<RTMetadataRetriever *>      mRetrievers;
+    RtMutex                                 mBatchLock;
+    RtMutex                                 mLock;
+    RtMutex                                 mCallbackLock;
+    RTThumbnailCallback                     mCallback;
+    RtMetaData                             *mOptions;
+    std::vector<std::pair<INT64, INT32> >   mRequests;
+    std::vector<RTThumbnailRun>             mRuns;
+    size_t                                  mNextRun;
+    UINT64                                  mBeginUs;
+    RTThumbnailStat                         mStat;
+};
+
+#endif  // SRC_RT_PLAYER_RTTHUMBNAILBATCH_H_
@@ -0,0 +1,247 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *     module: RTTypedMetaData
+ */
+
+#ifndef SRC_RT_TASK_TASK_GRAPH_RTTYPEDMETADATA_H_
+#define SRC_RT_TASK_TASK_GRAPH_RTTYPEDMETADATA_H_
+
+#include <type_traits>
+
+#include "rt_header.h"
+#include "rt_metadata.h"
+#include "rt_string_utils.h"
+#include "RTMediaMetaKeys.h"
+#include "RTNodeCommon.h"
+
+/*
+ * keys of the per-frame paths, each gets a fixed slot in RTTypedMetaData.
+ * STR keys are the OPT_* strings of RTNodeCommon.h, TAG keys the MKTAG
+ * values of RTMediaMetaKeys.h. at most 64 entries, one presence bit each.
+ */
+#define RT_TYPED_META_SLOTS(X) \
+    X(RTKeyWidth,        INT32,  STR,  OPT_VIDEO_WIDTH) \
+    X(RTKeyHeight,       INT32,  STR,  OPT_VIDEO_HEIGHT) \
+    X(RTKeyVirWidth,     INT32,  STR,  OPT_VIDEO_VIR_WIDTH) \
+    X(RTKeyVirHeight,    INT32,  STR,  OPT_VIDEO_VIR_HEIGHT) \
+    X(RTKeyPixFormat,    INT32,  STR,  OPT_VIDEO_PIX_FORMAT) \
+    X(RTKeyFrameW,       INT32,  TAG,  kKeyFrameW) \
+    X(RTKeyFrameH,       INT32,  TAG,  kKeyFrameH) \
+    X(RTKeyFramePts,     INT64,  TAG,  kKeyFramePts) \
+    X(RTKeyFrameDts,     INT64,  TAG,  kKeyFrameDts) \
+    X(RTKeyFrameEOS,     INT32,  TAG,  kKeyFrameEOS) \
+    X(RTKeyFrameSequence, INT32, TAG,  kKeyFrameSequence) \
+    X(RTKeyPacketPts,    INT64,  TAG,  kKeyPacketPts)
+
+typedef enum _RTTypedMetaSlot {
+#define RT_TYPED_META_SLOT_ENUM(name, type, form, id)  RT_META_SLOT_##name,
+    RT_TYPED_META_SLOTS(RT_TYPED_META_SLOT_ENUM)
+#undef RT_TYPED_META_SLOT_ENUM
+    RT_META_SLOT_MAX,
+} RTTypedMetaSlot;
+
+static_assert(RT_META_SLOT_MAX <= 64, "typed meta slots exceed the presence mask");
+
+// key declarations, a key type carries its value type, its id and its slot.
+#define RT_META_KEY_STR(name, type, str, slot) \
+    struct name { \
+        typedef type Type; \
+        static constexpr UINT64 kId = func_hash_bkdr_constexpr(str); \
+        static constexpr INT32 kSlot = slot; \
+        static const char* key() { return str; } \
+    }
+#define RT_META_KEY_TAG(name, type, tag, slot) \
+    struct name { \
+        typedef type Type; \
+        static constexpr UINT64 kId = (UINT64)(tag); \
+        static constexpr INT32 kSlot = slot; \
+        static UINT64 key() { return kId; } \
+    }
+
+// keys outside of the slot table always go through RtMetaData.
+#define RT_META_DYNAMIC_KEY_STR(name, type, str)    RT_META_KEY_STR(name, type, str, -1)
+#define RT_META_DYNAMIC_KEY_TAG(name, type, tag)    RT_META_KEY_TAG(name, type, tag, -1)
+
+#define RT_TYPED_META_KEY_DECL(name, type, form, id) \
+    RT_META_KEY_##form(name, type, id, RT_META_SLOT_##name);
+RT_TYPED_META_SLOTS(RT_TYPED_META_KEY_DECL)
+#undef RT_TYPED_META_KEY_DECL
+
+// RtMetaData accessors per value type, key is either a string or a tag.
+template <typename T> struct RTMetaAccess;
+#define RT_META_ACCESS(type, suffix) \
+    template <> struct RTMetaAccess<type> { \
+        template <typename K> \
+        static RT_BOOL find(const RtMetaData *meta, K key, type *value) { \
+            return meta->find##suffix(key, value); \
+        } \
+        template <typename K> \
+        static RT_BOOL set(RtMetaData *meta, K key, type value) { \
+            return meta->set##suffix(key, value); \
+        } \
+    };
+RT_META_ACCESS(INT32, Int32)
+RT_META_ACCESS(INT64, Int64)
+RT_META_ACCESS(float, Float)
+RT_META_ACCESS(RT_PTR, Pointer)
+RT_META_ACCESS(const char *, CString)
+#undef RT_META_ACCESS
+
+/*
+ * RtMetaData front end with compile-time keys. the keys of
+ * RT_TYPED_META_SLOTS live in a fixed array indexed by a constant, so a
+ * lookup is a bit test and a load, no string hash and no map walk; a key
+ * used with the wrong value type does not compile. other keys fall back
+ * to the wrapped RtMetaData:
+ *
+ *     RTTypedMetaData meta(context->options());
+ *     INT32 width = 0;
+ *     meta.find<RTKeyWidth>(&width);
+ *     meta.set<RTKeyFramePts>(pts);
+ *
+ * load() copies the slot keys from the wrapped RtMetaData once, e.g. in
+ * open(); store() writes them back for code that still reads RtMetaData.
+ * set<>() of a slot key only writes the slot, the wrapped RtMetaData sees
+ * the value after store(); call it before the RtMetaData is handed to
+ * anything that is not RTTypedMetaData. remove<>() drops the key from
+ * both, clear() only empties the slots.
+ */
+class RTTypedMetaData {
+ public:
+    explicit RTTypedMetaData(RtMetaData *fallback = RT_NULL)
+            : mPresent(0),
+              mFallback(fallback) {
+        rt_memset(mSlots, 0, sizeof(mSlots));
+    }
+
+    template <typename K>
+    RT_BOOL find(typename K::Type *value) const {
+        return findImpl<K>(value, std::integral_constant<bool, (K::kSlot >= 0)>());
+    }
+
+    template <typename K>
+    RT_BOOL set(typename K::Type value) {
+        return setImpl<K>(value, std::integral_constant<bool, (K::kSlot >= 0)>());
+    }
+
+    template <typename K>
+    RT_BOOL has() const {
+        typename K::Type value;
+        return find<K>(&value);
+    }
+
+    template <typename K>
+    void remove() {
+        if (K::kSlot >= 0) {
+            mPresent &= ~(1ULL << K::kSlot);
+        }
+        // a slot key may have been load()-ed or store()-d, drop that copy too.
+        if (mFallback != RT_NULL) {
+            mFallback->remove(K::kId);
+        }
+    }
+
+    void clear() { mPresent = 0; }
+
+    RtMetaData* fallback() const { return mFallback; }
+
+    void load() {
+        if (mFallback == RT_NULL) {
+            return;
+        }
+#define RT_TYPED_META_LOAD(name, type, form, id) \
+        { \
+            type value; \
+            if (RTMetaAccess<type>::find(mFallback, name::key(), &value)) { \
+                put<name>(value); \
+            } \
+        }
+        RT_TYPED_META_SLOTS(RT_TYPED_META_LOAD)
+#undef RT_TYPED_META_LOAD
+    }
+
+    void store() const {
+        if (mFallback == RT_NULL) {
+            return;
+        }
+#define RT_TYPED_META_STORE(name, type, form, id) \
+        if (mPresent & (1ULL << name::kSlot)) { \
+            RTMetaAccess<type>::set(mFallback, name::key(), get<name>()); \
+        }
+        RT_TYPED_META_SLOTS(RT_TYPED_META_STORE)
+#undef RT_TYPED_META_STORE
+    }
+
+ private:
+    union RTMetaSlotValue {
+        INT32   i32;
+        INT64   i64;
+        float   f32;
+        RT_PTR  ptr;
+    };
+
+    template <typename K>
+    RT_BOOL findImpl(typename K::Type *value, std::true_type) const {
+        if (!(mPresent & (1ULL << K::kSlot))) {
+            return RT_FALSE;
+        }
+        *value = get<K>();
+        return RT_TRUE;
+    }
+    template <typename K>
+    RT_BOOL findImpl(typename K::Type *value, std::false_type) const {
+        return (mFallback != RT_NULL)
+                ? RTMetaAccess<typename K::Type>::find(mFallback, K::key(), value) : RT_FALSE;
+    }
+
+    template <typename K>
+    RT_BOOL setImpl(typename K::Type value, std::true_type) {
+        put<K>(value);
+        return RT_TRUE;
+    }
+    template <typename K>
+    RT_BOOL setImpl(typename K::Type value, std::false_type) {
+        return (mFallback != RT_NULL)
+                ? RTMetaAccess<typename K::Type>::set(mFallback, K::key(), value) : RT_FALSE;
+    }
+
+    template <typename K>
+    typename K::Type get() const { return slotValue(mSlots[K::kSlot], (typename K::Type *)0); }
+
+    template <typename K>
+    void put(typename K::Type value) {
+        static_assert(!std::is_same<typename K::Type, const char *>::value,
+                      "string keys do not own their value, keep them dynamic");
+        slotValue(&mSlots[K::kSlot], value);
+        mPresent |= (1ULL << K::kSlot);
+    }
+
+    static INT32  slotValue(const RTMetaSlotValue &slot, INT32 *) { return slot.i32; }
+    static INT64  slotValue(const RTMetaSlotValue &slot, INT64 *) { return slot.i64; }
+    static float  slotValue(const RTMetaSlotValue &slot, float *) { return slot.f32; }
+    static RT_PTR slotValue(const RTMetaSlotValue &slot, RT_PTR *) { return slot.ptr; }
+    static void   slotValue(RTMetaSlotValue *slot, INT32 value)  { slot->i32 = value; }
+    static void   slotValue(RTMetaSlotValue *slot, INT64 value)  { slot->i64 = value; }
+    static void   slotValue(RTMetaSlotValue *slot, float value)  { slot->f32 = value; }
+    static void   slotValue(RTMetaSlotValue *slot, RT_PTR value) { slot->ptr = value; }
+
+ private:
+    RTMetaSlotValue mSlots[RT_META_SLOT_MAX];
+    UINT64          mPresent;
+    RtMetaData     *mFallback;
+};
+
+#endif  // SRC_RT_TASK_TASK_GRAPH_RTTYPEDMETADATA_H_
@@ -0,0 +1,586 @@
+/*
+ * Copyright 2022 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *     module: RTWorkStealingExecutor
+ */
+
+#ifndef SRC_RT_TASK_TASK_GRAPH_RTWORKSTEALINGEXECUTOR_H_
+#define SRC_RT_TASK_TASK_GRAPH_RTWORKSTEALINGEXECUTOR_H_
+
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_thread.h"
+#include "rt_metadata.h"
+#include "rt_string_utils.h"
+#include "RTNodeCommon.h"
+#include "RTExecutor.h"
+
+#define RT_WS_DEQUE_CAPACITY        256
+#define RT_WS_SPIN_ROUNDS           64
+#define RT_WS_PARK_TIMEOUT_US       MAX_COND_TIMETOUT
+
+typedef struct _RTWorkStealingStat {
+    INT32  numThreads;
+    UINT64 executed;       // tasks run by the worker(s)
+    UINT64 localHits;      // tasks popped from the worker's own deque
+    UINT64 steals;         // tasks taken from another worker's deque
+    UINT64 stealMisses;    // steal attempts that lost a race or found nothing
+    UINT64 injected;       // tasks submitted from threads outside the pool
+    UINT64 idleWaits;      // times a worker parked because nothing was runnable
+    UINT64 idleTimeUs;     // total time spent parked
+    UINT64 waitAvgUs;      // schedule() to task start
+    UINT64 waitStdUs;      // deviation of the above, the jitter pinning removes
+    UINT64 waitMaxUs;
+} RTWorkStealingStat;
+
+// cpu set and scheduling class applied to every worker of an executor.
+typedef struct _RTExecThreadPolicy {
+    std::vector<INT32>  cpus;       // empty: float over all cpus
+    RTThreadSched       policy;
+    INT32               priority;   // only used with RT_SCHED_FIFO/RR
+
+    _RTExecThreadPolicy() : policy(RT_SCHED_OTHER), priority(0) {}
+} RTExecThreadPolicy;
+
+/*
+ * bounded Chase-Lev deque. only the owner worker may push() and pop(),
+ * any thread may steal(). tasks are kept as heap pointers so a slot is
+ * a single atomic word.
+ */
+template <typename T, INT32 kCapacity>
+class RTWorkStealingDeque {
+ public:
+    RTWorkStealingDeque() : mTop(0), mBottom(0) {
+        static_assert((kCapacity & (kCapacity - 1)) == 0, "capacity must be a power of two");
+        for (INT32 i = 0; i < kCapacity; i++) {
+            mSlots[i].store(RT_NULL, std::memory_order_relaxed);
+        }
+    }
+
+    RT_BOOL push(T *item) {
+        INT64 b = mBottom.load(std::memory_order_relaxed);
+        INT64 t = mTop.load(std::memory_order_acquire);
+        if (b - t >= kCapacity) {
+            return RT_FALSE;
+        }
+        mSlots[b & (kCapacity - 1)].store(item, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        mBottom.store(b + 1, std::memory_order_relaxed);
+        return RT_TRUE;
+    }
+
+    T* pop() {
+        INT64 b = mBottom.load(std::memory_order_relaxed) - 1;
+        mBottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        INT64 t = mTop.load(std::memory_order_relaxed);
+        if (t > b) {
+            mBottom.store(b + 1, std::memory_order_relaxed);
+            return RT_NULL;
+        }
+        T *item = mSlots[b & (kCapacity - 1)].load(std::memory_order_relaxed);
+        if (t == b) {
+            // last item, race against thieves for it.
+            if (!mTop.compare_exchange_strong(t, t + 1,
+                    std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                item = RT_NULL;
+            }
+            mBottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    T* steal() {
+        INT64 t = mTop.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        INT64 b = mBottom.load(std::memory_order_acquire);
+        if (t >= b) {
+            return RT_NULL;
+        }
+        T *item = mSlots[t & (kCapacity - 1)].load(std::memory_order_relaxed);
+        if (!mTop.compare_exchange_strong(t, t + 1,
+                std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return RT_NULL;
+        }
+        return item;
+    }
+
+    INT32 size() const {
+        INT64 b = mBottom.load(std::memory_order_relaxed);
+        INT64 t = mTop.load(std::memory_order_relaxed);
+        return b > t ? (INT32)(b - t) : 0;
+    }
+
+ private:
+    std::atomic<INT64> mTop;
+    char               mPad[64];    // keep thieves and owner on different cache lines
+    std::atomic<INT64> mBottom;
+    std::atomic<T *>   mSlots[kCapacity];
+};
+
+// A multithreaded executor where every worker owns a lock-free deque and
+// idle workers steal from their peers. Tasks scheduled from a worker thread
+// stay on that worker's deque, so a node that wakes its downstream node does
+// not touch any shared lock. Tasks from outside the pool and tasks pinned to a
+// thread (threadId > 0, same contract as RT_THREAD_POOL_ASSIGN_MODE) go
+// through small locked queues instead.
+//
+// Sample usage:
+//
+//   RtMetaData *opts = new RtMetaData();
+//   opts->setInt32(OPT_EXEC_THREAD_NUM, 4);
+//   opts->setCString(OPT_EXEC_THREAD_NAME, "ws_exec");
+//   opts->setCString(OPT_EXEC_CPU_SET, "4-7");      // big cores on rk3588
+//   opts->setCString(OPT_EXEC_SCHED_POLICY, "fifo");
+//   opts->setInt32(OPT_EXEC_SCHED_PRIOR, 10);
+//   RTExecutor *executor = RTWorkStealingExecutor::create(opts);
+//   graph->setExternalExecutor(executor);
+//
+// The cpu set and scheduling keys are only read here, by create(); they have
+// no effect in the executor_opts of a graph json, which librockit turns into
+// its own executors. Nodes are bound to an executor built in code with
+// OPT_NODE_DISPATCH_EXEC, e.g. the encoder feeding nodes to a big core
+// executor and audio nodes to one on a dedicated core.
+class RTWorkStealingExecutor : public RTExecutor {
+ public:
+    typedef std::function<void()> RTTask;
+
+    static RTExecutor* create(RtMetaData *extendOptions) {
+        INT32 numThreads = 0;
+        const char *name = "ws_exec";
+        const char *cpus = RT_NULL;
+        const char *policy = RT_NULL;
+        RTExecThreadPolicy threadPolicy;
+        if (extendOptions != RT_NULL) {
+            extendOptions->findInt32(OPT_EXEC_THREAD_NUM, &numThreads);
+            extendOptions->findCString(OPT_EXEC_THREAD_NAME, &name);
+            if (extendOptions->findCString(OPT_EXEC_CPU_SET, &cpus)) {
+                parseCpuSet(cpus, &threadPolicy.cpus);
+            }
+            if (extendOptions->findCString(OPT_EXEC_SCHED_POLICY, &policy)) {
+                threadPolicy.policy = parseSchedPolicy(policy);
+            }
+            extendOptions->findInt32(OPT_EXEC_SCHED_PRIOR, &threadPolicy.priority);
+        }
+        if (numThreads <= 0) {
+            numThreads = threadPolicy.cpus.empty()
+                       ? (INT32)sysconf(_SC_NPROCESSORS_ONLN) : (INT32)threadPolicy.cpus.size();
+        }
+        return new RTWorkStealingExecutor(name, numThreads, threadPolicy);
+    }
+
+    // "0-3,6" style list, returns the number of cpus found.
+    static INT32 parseCpuSet(const char *str, std::vector<INT32> *cpus) {
+        cpus->clear();
+        while (str != RT_NULL && *str != '\0') {
+            char *end = RT_NULL;
+            INT32 first = (INT32)strtol(str, &end, 10);
+            INT32 last = first;
+            if (end == str) {
+                break;
+            }
+            if (*end == '-') {
+                str = end + 1;
+                last = (INT32)strtol(str, &end, 10);
+            }
+            for (INT32 cpu = first; cpu <= last && cpus->size() < MAX_BIND_CPUS_NUM; cpu++) {
+                cpus->push_back(cpu);
+            }
+            str = (*end == ',') ? end + 1 : end;
+            if (*end != ',') {
+                break;
+            }
+        }
+        return (INT32)cpus->size();
+    }
+
+    static RTThreadSched parseSchedPolicy(const char *str) {
+        RTSTRING_SWITCH(str) {
+          RTSTRING_CASE("fifo"):
+            return RT_SCHED_FIFO;
+          RTSTRING_CASE("rr"):
+            return RT_SCHED_RR;
+          default:
+            return RT_SCHED_OTHER;
+        }
+    }
+
+    explicit RTWorkStealingExecutor(const std::string& namePrefix, INT32 numThreads,
+                                    const RTExecThreadPolicy& threadPolicy = RTExecThreadPolicy())
+            : mNamePrefix(namePrefix),
+              mThreadPolicy(threadPolicy),
+              mPending(0),
+              mSleepers(0),
+              mStopped(RT_FALSE) {
+        if (numThreads <= 0) {
+            numThreads = 1;
+        }
+        for (INT32 i = 0; i < numThreads; i++) {
+            RTWorker *worker = new RTWorker();
+            worker->owner = this;
+            worker->index = i;
+            worker->seed  = (UINT32)(i + 1) * 2654435761U;
+            mWorkers.push_back(worker);
+        }
+        for (INT32 i = 0; i < numThreads; i++) {
+            char name[16];
+            snprintf(name, sizeof(name), "%.10s/%d", mNamePrefix.c_str(), i);
+            mWorkers[i]->thread = new RtThread(threadLoop, mWorkers[i]);
+            mWorkers[i]->thread->setName(name);
+            mWorkers[i]->thread->start();
+        }
+    }
+
+    ~RTWorkStealingExecutor() override {
+        mStopped.store(RT_TRUE);
+        {
+            RtAutoMutex autoLock(mParkMutex);
+            for (size_t i = 0; i < mWorkers.size(); i++) {
+                mWorkers[i]->parkCond.signal();
+            }
+        }
+        for (size_t i = 0; i < mWorkers.size(); i++) {
+            mWorkers[i]->thread->join();
+            rt_safe_delete(mWorkers[i]->thread);
+        }
+        for (size_t i = 0; i < mWorkers.size(); i++) {
+            delete mWorkers[i];
+        }
+        mWorkers.clear();
+    }
+
+ public:
+    void schedule(std::function<void()> task, INT32 threadId = 0) override {
+        RTTaskItem *item = new RTTaskItem(std::move(task));
+        RTWorker *self = currentWorker();
+        if (threadId > 0) {
+            // only the target may run it, wake that one and not any sleeper.
+            RTWorker *target = mWorkers[threadId % mWorkers.size()];
+            {
+                RtAutoMutex autoLock(target->pinnedMutex);
+                target->pinned.push_back(item);
+            }
+            target->pinnedPending.fetch_add(1);
+            if (mSleepers.load() > 0) {
+                RtAutoMutex autoLock(mParkMutex);
+                target->parked = RT_FALSE;
+                target->parkCond.signal();
+            }
+            return;
+        }
+        if (self != RT_NULL && self->owner == this && self->deque.push(item)) {
+            // fast path, nothing shared was touched.
+        } else {
+            RtAutoMutex autoLock(mInjectMutex);
+            mInjected.push_back(item);
+            mInjectCount.fetch_add(1, std::memory_order_relaxed);
+        }
+        mPending.fetch_add(1);
+        if (mSleepers.load() > 0) {
+            RtAutoMutex autoLock(mParkMutex);
+            for (size_t i = 0; i < mWorkers.size(); i++) {
+                if (mWorkers[i]->parked) {
+                    mWorkers[i]->parked = RT_FALSE;
+                    mWorkers[i]->parkCond.signal();
+                    break;
+                }
+            }
+        }
+    }
+
+    INT32 getNumThreads() const override { return (INT32)mWorkers.size(); }
+
+    // workerId < 0 sums all workers.
+    RT_RET queryStat(RTWorkStealingStat *stat, INT32 workerId = -1) {
+        if (stat == RT_NULL) {
+            return RT_ERR_NULL_PTR;
+        }
+        if (workerId >= (INT32)mWorkers.size()) {
+            return RT_ERR_OUTOF_RANGE;
+        }
+        memset(stat, 0, sizeof(RTWorkStealingStat));
+        UINT64 waitCount = 0;
+        double waitMean  = 0;
+        double waitM2    = 0;
+        stat->numThreads = (INT32)mWorkers.size();
+        for (size_t i = 0; i < mWorkers.size(); i++) {
+            if (workerId >= 0 && workerId != (INT32)i) {
+                continue;
+            }
+            RTWorker *worker = mWorkers[i];
+            stat->executed    += worker->executed.load(std::memory_order_relaxed);
+            stat->localHits   += worker->localHits.load(std::memory_order_relaxed);
+            stat->steals      += worker->steals.load(std::memory_order_relaxed);
+            stat->stealMisses += worker->stealMisses.load(std::memory_order_relaxed);
+            stat->idleWaits   += worker->idleWaits.load(std::memory_order_relaxed);
+            stat->idleTimeUs  += worker->idleTimeUs.load(std::memory_order_relaxed);
+            mergeWait(worker, &waitCount, &waitMean, &waitM2);
+            UINT64 waitMax     = worker->waitMaxUs.load(std::memory_order_relaxed);
+            if (waitMax > stat->waitMaxUs) {
+                stat->waitMaxUs = waitMax;
+            }
+        }
+        if (waitCount > 0) {
+            stat->waitAvgUs = (UINT64)waitMean;
+            stat->waitStdUs = (UINT64)sqrt(waitM2 / waitCount);
+        }
+        stat->injected = mInjectCount.load(std::memory_order_relaxed);
+        return RT_OK;
+    }
+
+    RT_RET dump() {
+        RTWorkStealingStat stat;
+        for (size_t i = 0; i < mWorkers.size(); i++) {
+            queryStat(&stat, (INT32)i);
+            RT_LOGD("%s worker(%d) executed(%llu) local(%llu) steals(%llu) misses(%llu) "
+                    "idle(%llu times, %llu us)",
+                    mNamePrefix.c_str(), (INT32)i, (unsigned long long)stat.executed,
+                    (unsigned long long)stat.localHits, (unsigned long long)stat.steals,
+                    (unsigned long long)stat.stealMisses, (unsigned long long)stat.idleWaits,
+                    (unsigned long long)stat.idleTimeUs);
+        }
+        queryStat(&stat);
+        RT_LOGD("%s total executed(%llu) steals(%llu) injected(%llu) "
+                "wait avg(%llu us) std(%llu us) max(%llu us) cpus(%d) policy(%d/%d)",
+                mNamePrefix.c_str(), (unsigned long long)stat.executed,
+                (unsigned long long)stat.steals, (unsigned long long)stat.injected,
+                (unsigned long long)stat.waitAvgUs, (unsigned long long)stat.waitStdUs,
+                (unsigned long long)stat.waitMaxUs,
+                (INT32)mThreadPolicy.cpus.size(), mThreadPolicy.policy, mThreadPolicy.priority);
+        return RT_OK;
+    }
+
+ private:
+    typedef struct RTTaskItem {
+        RTTask  task;
+        UINT64  queuedUs;
+
+        explicit RTTaskItem(RTTask&& func)
+            : task(std::move(func)), queuedUs(RtTime::getNowTimeUs()) {}
+    } RTTaskItem;
+
+    typedef struct RTWorker {
+        RTWorkStealingExecutor            *owner;
+        INT32                              index;
+        UINT32                             seed;
+        RtThread                          *thread;
+        RTWorkStealingDeque<RTTaskItem, RT_WS_DEQUE_CAPACITY> deque;
+        RtMutex                            pinnedMutex;
+        std::deque<RTTaskItem *>           pinned;
+        std::atomic<INT64>                 pinnedPending;
+        // both guarded by mParkMutex of the owner.
+        RtCondition                        parkCond;
+        RT_BOOL                            parked;
+        std::atomic<UINT64>                executed;
+        std::atomic<UINT64>                localHits;
+        std::atomic<UINT64>                steals;
+        std::atomic<UINT64>                stealMisses;
+        std::atomic<UINT64>                idleWaits;
+        std::atomic<UINT64>                idleTimeUs;
+        // running mean and sum of squared deviations of the wait (Welford),
+        // written by the worker only.
+        std::atomic<UINT64>                waitCount;
+        std::atomic<double>                waitMeanUs;
+        std::atomic<double>                waitM2;
+        std::atomic<UINT64>                waitMaxUs;
+
+        RTWorker() : owner(RT_NULL), index(0), seed(1), thread(RT_NULL),
+                     pinnedPending(0), parked(RT_FALSE), executed(0), localHits(0), steals(0), stealMisses(0),
+                     idleWaits(0), idleTimeUs(0), waitCount(0), waitMeanUs(0), waitM2(0),
+                     waitMaxUs(0) {}
+    } RTWorker;
+
+    static void addWait(RTWorker *self, UINT64 waitUs) {
+        UINT64 count = self->waitCount.load(std::memory_order_relaxed) + 1;
+        double mean  = self->waitMeanUs.load(std::memory_order_relaxed);
+        double m2    = self->waitM2.load(std::memory_order_relaxed);
+        double delta = (double)waitUs - mean;
+        mean += delta / count;
+        m2   += delta * ((double)waitUs - mean);
+        self->waitM2.store(m2, std::memory_order_relaxed);
+        self->waitMeanUs.store(mean, std::memory_order_relaxed);
+        self->waitCount.store(count, std::memory_order_relaxed);
+        if (waitUs > self->waitMaxUs.load(std::memory_order_relaxed)) {
+            self->waitMaxUs.store(waitUs, std::memory_order_relaxed);
+        }
+    }
+
+    // pairwise merge of two running variances (Chan et al.).
+    static void mergeWait(RTWorker *worker, UINT64 *count, double *mean, double *m2) {
+        UINT64 other = worker->waitCount.load(std::memory_order_relaxed);
+        if (other == 0) {
+            return;
+        }
+        double otherMean = worker->waitMeanUs.load(std::memory_order_relaxed);
+        double otherM2   = worker->waitM2.load(std::memory_order_relaxed);
+        UINT64 total = *count + other;
+        double delta = otherMean - *mean;
+        *mean += delta * other / total;
+        *m2   += otherM2 + delta * delta * ((double)*count * other / total);
+        *count = total;
+    }
+
+    static RTWorker*& currentWorker() {
+        static thread_local RTWorker *sWorker = RT_NULL;
+        return sWorker;
+    }
+
+    static void* threadLoop(void *arg) {
+        RTWorker *worker = reinterpret_cast<RTWorker *>(arg);
+        currentWorker() = worker;
+        worker->owner->applyThreadPolicy(worker);
+        worker->owner->runWorker(worker);
+        currentWorker() = RT_NULL;
+        return RT_NULL;
+    }
+
+    // runs on the worker itself, so it does not depend on whether the
+    // thread attributes are honoured before or after RtThread::start().
+    void applyThreadPolicy(RTWorker *self) {
+        if (!mThreadPolicy.cpus.empty()) {
+            cpu_set_t cpuSet;
+            CPU_ZERO(&cpuSet);
+            for (size_t i = 0; i < mThreadPolicy.cpus.size(); i++) {
+                CPU_SET(mThreadPolicy.cpus[i], &cpuSet);
+            }
+            if (sched_setaffinity(0, sizeof(cpuSet), &cpuSet) != 0) {
+                RT_LOGE("%s worker(%d) bind %d cpus failed",
+                        mNamePrefix.c_str(), self->index, (INT32)mThreadPolicy.cpus.size());
+            }
+        }
+        if (mThreadPolicy.policy != RT_SCHED_OTHER) {
+            struct sched_param param;
+            INT32 policy = (mThreadPolicy.policy == RT_SCHED_FIFO) ? SCHED_FIFO : SCHED_RR;
+            param.sched_priority = mThreadPolicy.priority;
+            if (pthread_setschedparam(pthread_self(), policy, &param) != 0) {
+                RT_LOGE("%s worker(%d) set policy(%d) priority(%d) failed",
+                        mNamePrefix.c_str(), self->index, policy, mThreadPolicy.priority);
+            }
+        }
+    }
+
+    RTTaskItem* takeLocked(RtMutex *mutex, std::deque<RTTaskItem *> *queue) {
+        RtAutoMutex autoLock(mutex);
+        if (queue->empty()) {
+            return RT_NULL;
+        }
+        RTTaskItem *item = queue->front();
+        queue->pop_front();
+        return item;
+    }
+
+    RTTaskItem* findTask(RTWorker *self) {
+        RTTaskItem *item = self->deque.pop();
+        if (item != RT_NULL) {
+            mPending.fetch_sub(1);
+            self->localHits.fetch_add(1, std::memory_order_relaxed);
+            return item;
+        }
+        item = takeLocked(&self->pinnedMutex, &self->pinned);
+        if (item != RT_NULL) {
+            self->pinnedPending.fetch_sub(1);
+            return item;
+        }
+        item = takeLocked(&mInjectMutex, &mInjected);
+        if (item != RT_NULL) {
+            mPending.fetch_sub(1);
+            return item;
+        }
+        // start from a random victim so thieves spread over the pool.
+        INT32 count = (INT32)mWorkers.size();
+        self->seed = self->seed * 1103515245U + 12345U;
+        INT32 start = (INT32)((self->seed >> 16) % count);
+        for (INT32 i = 0; i < count; i++) {
+            RTWorker *victim = mWorkers[(start + i) % count];
+            if (victim == self || victim->deque.size() == 0) {
+                continue;
+            }
+            item = victim->deque.steal();
+            if (item != RT_NULL) {
+                mPending.fetch_sub(1);
+                self->steals.fetch_add(1, std::memory_order_relaxed);
+                return item;
+            }
+            self->stealMisses.fetch_add(1, std::memory_order_relaxed);
+        }
+        return RT_NULL;
+    }
+
+    void runWorker(RTWorker *self) {
+        INT32 spins = 0;
+        while (1) {
+            RTTaskItem *item = findTask(self);
+            if (item != RT_NULL) {
+                addWait(self, RtTime::getNowTimeUs() - item->queuedUs);
+                item->task();
+                delete item;
+                self->executed.fetch_add(1, std::memory_order_relaxed);
+                spins = 0;
+                continue;
+            }
+            // pinned tasks of other workers are no reason to stay awake.
+            RT_BOOL idle = (mPending.load() <= 0 && self->pinnedPending.load() <= 0);
+            if (mStopped.load() && idle) {
+                break;
+            }
+            if (++spins < RT_WS_SPIN_ROUNDS) {
+                continue;
+            }
+            spins = 0;
+
+            UINT64 parkUs = RtTime::getNowTimeUs();
+            {
+                RtAutoMutex autoLock(mParkMutex);
+                mSleepers.fetch_add(1);
+                if (mPending.load() <= 0 && self->pinnedPending.load() <= 0 && !mStopped.load()) {
+                    self->parked = RT_TRUE;
+                    self->parkCond.timedwait(mParkMutex, RT_WS_PARK_TIMEOUT_US);
+                    self->parked = RT_FALSE;
+                }
+                mSleepers.fetch_sub(1);
+            }
+            self->idleWaits.fetch_add(1, std::memory_order_relaxed);
+            self->idleTimeUs.fetch_add(RtTime::getNowTimeUs() - parkUs, std::memory_order_relaxed);
+        }
+    }
+
+ private:
+    std::string              mNamePrefix;
+    RTExecThreadPolicy       mThreadPolicy;
+    std::vector<RTWorker *>  mWorkers;
+
+    RtMutex                  mInjectMutex;
+    std::deque<RTTaskItem *> mInjected;
+    std::atomic<UINT64>      mInjectCount = ATOMIC_VAR_INIT(0);
+
+    // queued but not yet started tasks any worker may run, pinned tasks
+    // are counted per worker.
+    std::atomic<INT64>       mPending;
+    std::atomic<INT32>       mSleepers;
+    std::atomic<RT_BOOL>     mStopped;
+    RtMutex                  mParkMutex;
+};
+
+#endif  // SRC_RT_TASK_TASK_GRAPH_RTWORKSTEALINGEXECUTOR_H_
@@ -99,6 +99,9 @@ enum RTNodeEvent {
     RT_NODE_INFO_RESTART_SUBTE,
     RT_NODE_INFO_SET_SPEED,
     RT_NODE_INFO_MAX,
+
+    // raised by header-only helpers, pinned apart from the values librockit is built with.
+    RT_NODE_INFO_STALL = 2560,      // a node is stuck in process(), see RTNodeWatchdog
 };
 
 enum RTNodeRequest {